@@ -0,0 +1,190 @@
+/**
+ * Part of Epicinium NeuralNewt
+ * developed by A Bunch of Hacks.
+ *
+ * Copyright (c) 2020 A Bunch of Hacks
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * [authors:]
+ * Daan Mulder (daan@abunchofhacks.coop)
+ */
+
+
+#include "affinity.hpp"
+
+#include <fstream>
+#include <thread>
+#include <algorithm>
+#include <cstdlib>
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+#include "folders.hpp"
+
+
+#ifdef __linux__
+// Parses a list such as "0-3,8,10-11".
+static std::vector<int> parseCpuList(const std::string& list)
+{
+	std::vector<int> cpus;
+	const char* s = list.c_str();
+	while (*s != '\0' && *s != '\n')
+	{
+		char* end;
+		int first = std::strtol(s, &end, 10);
+		if (end == s) break;
+		int last = first;
+		if (*end == '-') last = std::strtol(end + 1, &end, 10);
+		for (int cpu = first; cpu <= last; cpu++) cpus.push_back(cpu);
+		s = (*end == ',') ? end + 1 : end;
+	}
+	return cpus;
+}
+#endif
+
+std::vector<Placement> currentTopology()
+{
+	std::vector<Placement> topology;
+#ifdef __linux__
+	cpu_set_t allowed;
+	CPU_ZERO(&allowed);
+	if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0)
+	{
+		CPU_ZERO(&allowed);
+		for (size_t i = 0; i < std::thread::hardware_concurrency(); i++)
+		{
+			CPU_SET(i, &allowed);
+		}
+	}
+
+	std::vector<size_t> nodes;
+	for (const std::string& entry : listFolder("/sys/devices/system/node"))
+	{
+		if (entry.compare(0, 4, "node") != 0) continue;
+		if (entry.find_first_not_of("0123456789", 4) != std::string::npos)
+			continue;
+		nodes.push_back(std::strtoul(entry.c_str() + 4, nullptr, 10));
+	}
+	std::sort(nodes.begin(), nodes.end());
+
+	for (size_t node : nodes)
+	{
+		std::ifstream file("/sys/devices/system/node/node"
+			+ std::to_string(node) + "/cpulist");
+		std::string list;
+		std::getline(file, list);
+		Placement placement = {node, {}};
+		for (int cpu : parseCpuList(list))
+		{
+			if (cpu >= CPU_SETSIZE || !CPU_ISSET(cpu, &allowed)) continue;
+			placement.cpus.push_back(cpu);
+		}
+		if (!placement.cpus.empty()) topology.push_back(placement);
+	}
+
+	// Without NUMA information, all allowed cores are on node 0.
+	if (topology.empty())
+	{
+		Placement placement = {0, {}};
+		for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+		{
+			if (CPU_ISSET(cpu, &allowed)) placement.cpus.push_back(cpu);
+		}
+		topology.push_back(placement);
+	}
+#else
+	Placement placement = {0, {}};
+	for (size_t i = 0; i < std::thread::hardware_concurrency(); i++)
+	{
+		placement.cpus.push_back(i);
+	}
+	topology.push_back(placement);
+#endif
+	return topology;
+}
+
+std::vector<Placement> planPlacements(const std::vector<Placement>& topology,
+	size_t count)
+{
+	std::vector<Placement> placements;
+	if (topology.empty() || count == 0) return placements;
+
+	if (count <= topology.size())
+	{
+		for (size_t i = 0; i < count; i++)
+		{
+			placements.push_back(topology[i]);
+		}
+		// Nodes that are left over are shared out as well.
+		for (size_t n = count; n < topology.size(); n++)
+		{
+			auto& cpus = placements[n % count].cpus;
+			cpus.insert(cpus.end(), topology[n].cpus.begin(),
+				topology[n].cpus.end());
+		}
+		return placements;
+	}
+
+	placements.resize(count);
+	for (size_t n = 0; n < topology.size(); n++)
+	{
+		const std::vector<int>& cpus = topology[n].cpus;
+		// Processes n, n + numNodes, n + 2 numNodes, ... are on node n.
+		size_t share = (count - n + topology.size() - 1) / topology.size();
+		for (size_t k = 0; k < share; k++)
+		{
+			Placement& placement = placements[n + k * topology.size()];
+			placement.node = topology[n].node;
+			size_t begin = k * cpus.size() / share;
+			size_t end = (k + 1) * cpus.size() / share;
+			// With more processes than cores, processes share a core.
+			if (end == begin) end = begin + 1;
+			for (size_t i = begin; i < end; i++)
+			{
+				placement.cpus.push_back(cpus[i % cpus.size()]);
+			}
+		}
+	}
+	return placements;
+}
+
+bool pinPlacement(const Placement& placement)
+{
+#ifdef __linux__
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	for (int cpu : placement.cpus) CPU_SET(cpu, &set);
+	return sched_setaffinity(0, sizeof(set), &set) == 0;
+#else
+	(void) placement;
+	return false;
+#endif
+}
+
+std::string describePlacement(const Placement& placement)
+{
+	std::string cpus;
+	const std::vector<int>& list = placement.cpus;
+	for (size_t i = 0; i < list.size(); /**/)
+	{
+		size_t j = i;
+		while (j + 1 < list.size() && list[j + 1] == list[j] + 1) j++;
+		if (!cpus.empty()) cpus += ",";
+		cpus += std::to_string(list[i]);
+		if (j > i) cpus += "-" + std::to_string(list[j]);
+		i = j + 1;
+	}
+	return "node " + std::to_string(placement.node) + ", cpus " + cpus;
+}
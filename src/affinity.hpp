@@ -0,0 +1,57 @@
+/**
+ * Part of Epicinium NeuralNewt
+ * developed by A Bunch of Hacks.
+ *
+ * Copyright (c) 2020 A Bunch of Hacks
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * [authors:]
+ * Daan Mulder (daan@abunchofhacks.coop)
+ */
+
+
+#pragma once
+
+#include <vector>
+#include <string>
+#include <cstddef>
+
+
+// Where a process runs: the cores it is pinned to, all on the same NUMA node
+// if possible. Memory that a process touches first is allocated on the node
+// of the core it runs on, so pinning keeps each process's brains close to the
+// cores that evaluate them.
+struct Placement
+{
+	size_t node;
+	std::vector<int> cpus;
+};
+
+// The cores that this process may run on, grouped by NUMA node, as far as
+// they can be determined (only Linux is supported; elsewhere all cores are
+// assumed to be on node 0).
+std::vector<Placement> currentTopology();
+
+// Divides the given cores over count processes. With fewer processes than
+// nodes, processes get whole nodes; otherwise the processes are spread over
+// the nodes and share the cores of their node evenly.
+std::vector<Placement> planPlacements(const std::vector<Placement>& topology,
+	size_t count);
+
+// Pins the calling thread, and any threads it starts afterwards, to the cores
+// of the placement. Returns false if this is not supported.
+bool pinPlacement(const Placement& placement);
+
+// For example "node 1, cpus 8-15".
+std::string describePlacement(const Placement& placement);
@@ -0,0 +1,105 @@
+/**
+ * Part of Epicinium NeuralNewt
+ * developed by A Bunch of Hacks.
+ *
+ * Copyright (c) 2020 A Bunch of Hacks
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * [authors:]
+ * Daan Mulder (daan@abunchofhacks.coop)
+ */
+
+#include "atomicfile.hpp"
+
+#include <stdexcept>
+#include <atomic>
+#ifdef _WIN32
+#include <io.h>
+#include <process.h>
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+
+// Several threads or processes may write the same destination at once, for
+// instance when two trainers store an identical brain, so each writer needs
+// a temporary file of its own.
+static std::string tmpPath(const std::string& filepath)
+{
+	static std::atomic<unsigned long> counter(0);
+#ifdef _WIN32
+	long pid = _getpid();
+#else
+	long pid = getpid();
+#endif
+	return filepath + ".tmp" + std::to_string(pid)
+		+ "-" + std::to_string(counter++);
+}
+
+
+AtomicFile::AtomicFile(const std::string& filepath) :
+	_filepath(filepath),
+	_tmppath(tmpPath(filepath)),
+	_file(std::fopen(_tmppath.c_str(), "wb")),
+	_ok(true)
+{
+	if (_file == nullptr)
+	{
+		throw std::runtime_error("Cannot open " + _tmppath + " for writing");
+	}
+}
+
+AtomicFile::~AtomicFile()
+{
+	if (_file != nullptr)
+	{
+		std::fclose(_file);
+		std::remove(_tmppath.c_str());
+	}
+}
+
+void AtomicFile::write(const void* data, size_t size)
+{
+	if (size == 0) return;
+	_ok = _ok && std::fwrite(data, 1, size, _file) == size;
+}
+
+void AtomicFile::commit()
+{
+	_ok = _ok && std::fflush(_file) == 0;
+#ifdef _WIN32
+	_ok = _ok && _commit(_fileno(_file)) == 0;
+#else
+	_ok = _ok && fsync(fileno(_file)) == 0;
+#endif
+	_ok = (std::fclose(_file) == 0) && _ok;
+	_file = nullptr;
+	if (!_ok)
+	{
+		std::remove(_tmppath.c_str());
+		throw std::runtime_error("Error while writing " + _filepath);
+	}
+#ifdef _WIN32
+	if (!MoveFileExA(_tmppath.c_str(), _filepath.c_str(),
+		MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH))
+#else
+	if (std::rename(_tmppath.c_str(), _filepath.c_str()) != 0)
+#endif
+	{
+		std::remove(_tmppath.c_str());
+		throw std::runtime_error("Cannot move " + _tmppath + " to "
+			+ _filepath);
+	}
+}
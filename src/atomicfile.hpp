@@ -0,0 +1,52 @@
+/**
+ * Part of Epicinium NeuralNewt
+ * developed by A Bunch of Hacks.
+ *
+ * Copyright (c) 2020 A Bunch of Hacks
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * [authors:]
+ * Daan Mulder (daan@abunchofhacks.coop)
+ */
+
+#pragma once
+
+#include <string>
+#include <cstdio>
+
+
+// Writes to a temporary file next to the destination, which replaces the
+// destination only once commit() has flushed all data to disk. Readers thus
+// either see the old file, or the complete new file, but never a partial one.
+class AtomicFile
+{
+private:
+	std::string _filepath;
+	std::string _tmppath;
+	FILE* _file;
+	bool _ok;
+
+public:
+	explicit AtomicFile(const std::string& filepath);
+	AtomicFile(const AtomicFile&) = delete;
+	AtomicFile(AtomicFile&&) = delete;
+	AtomicFile& operator=(const AtomicFile&) = delete;
+	AtomicFile& operator=(AtomicFile&&) = delete;
+	~AtomicFile();
+
+	void write(const void* data, size_t size);
+	void write(const std::string& data) { write(data.data(), data.size()); }
+
+	void commit();
+};
@@ -0,0 +1,252 @@
+/**
+ * Part of Epicinium NeuralNewt
+ * developed by A Bunch of Hacks.
+ *
+ * Copyright (c) 2020 A Bunch of Hacks
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * [authors:]
+ * Daan Mulder (daan@abunchofhacks.coop)
+ */
+
+
+#include "autotuner.hpp"
+
+#include <torch/torch.h>
+#include <iostream>
+#include <fstream>
+#include <chrono>
+#include <stdexcept>
+#ifndef _WIN32
+#include <unistd.h>
+#include <sys/wait.h>
+#endif
+
+#include "libs/jsoncpp/json.h"
+
+#include "setting.hpp"
+#include "atomicfile.hpp"
+#include "affinity.hpp"
+#include "brainname.hpp"
+#include "newtbraintrainer.hpp"
+#include "sharding.hpp"
+#include "nnet/neuralnewtbrain.hpp"
+
+
+struct Candidate
+{
+	size_t workers;
+	size_t threads;
+};
+
+// Plays the games the way a round of training would with this candidate:
+// with local workers through a shard coordinator, which forks them before
+// libtorch starts any threads or initializes CUDA, and otherwise directly.
+// Returns games per second.
+static double playCandidate(const Settings& settings,
+	const std::string& rulesetname, const std::vector<GameSpec>& games,
+	size_t numBrains, const Candidate& candidate)
+{
+	Settings candidateSettings = settings;
+	candidateSettings.torchThreads = candidate.threads;
+	candidateSettings.localWorkers = candidate.workers - 1;
+	candidateSettings.coordinatorPort = 0;
+	std::unique_ptr<ShardCoordinator> coordinator;
+	if (candidateSettings.localWorkers > 0)
+	{
+		coordinator.reset(new ShardCoordinator(candidateSettings,
+			rulesetname, "brains/autotune"));
+	}
+	torch::set_num_threads(candidate.threads);
+	if (candidateSettings.cuda && !torch::cuda::is_available())
+	{
+		candidateSettings.cuda = false;
+	}
+
+	// Local workers map these brains from a single pack.
+	std::vector<std::shared_ptr<NeuralNewtBrain>> brains;
+	for (size_t i = 0; i < numBrains; i++)
+	{
+		brains.push_back(std::make_shared<NeuralNewtBrain>(candidateSettings,
+			std::make_shared<SeedBrainName>(i)));
+	}
+
+	auto start = std::chrono::steady_clock::now();
+	if (coordinator) coordinator->play(0, brains, games);
+	else
+	{
+		NewtBrainTrainer::playGames(candidateSettings, rulesetname, brains,
+			games);
+	}
+	auto end = std::chrono::steady_clock::now();
+	double seconds = std::chrono::duration_cast<std::chrono::microseconds>(
+		end - start).count() / 1e6;
+	return (seconds > 0) ? games.size() / seconds : 0;
+}
+
+// Measures the candidate in a process of its own, so that every candidate
+// starts without libtorch threads or CUDA. Returns games per second, or 0 if
+// the candidate failed.
+static double measure(const Settings& settings,
+	const std::string& rulesetname, const std::vector<GameSpec>& games,
+	size_t numBrains, const Candidate& candidate)
+{
+#ifdef _WIN32
+	(void) settings;
+	(void) rulesetname;
+	(void) games;
+	(void) numBrains;
+	(void) candidate;
+	return 0;
+#else
+	int fds[2];
+	if (pipe(fds) != 0) throw std::runtime_error("Cannot create pipe");
+	std::cout.flush();
+	std::cerr.flush();
+	pid_t pid = fork();
+	if (pid < 0)
+	{
+		close(fds[0]);
+		close(fds[1]);
+		return 0;
+	}
+	if (pid == 0)
+	{
+		close(fds[0]);
+		double speed = 0;
+		try
+		{
+			speed = playCandidate(settings, rulesetname, games, numBrains,
+				candidate);
+		}
+		catch (const std::exception& e)
+		{
+			std::cerr << "ERROR: autotune: " << e.what() << std::endl;
+		}
+		int status = (write(fds[1], &speed, sizeof(speed)) == sizeof(speed))
+			? 0 : 1;
+		std::cout.flush();
+		std::cerr.flush();
+		_exit(status);
+	}
+	close(fds[1]);
+
+	double speed = 0;
+	if (read(fds[0], &speed, sizeof(speed)) != sizeof(speed)) speed = 0;
+	close(fds[0]);
+	waitpid(pid, nullptr, 0);
+	return speed;
+#endif
+}
+
+Settings autotune(const Settings& settings, const std::string& rulesetname)
+{
+	size_t cores = 0;
+	for (const Placement& node : currentTopology()) cores += node.cpus.size();
+	size_t numBrains = settings.numPools * settings.brainsPerPool;
+
+	// Signed, because that is how the reader parses them back.
+	Json::Value key = Json::objectValue;
+	key["cores"] = Json::Int64(cores);
+	key["num_channels"] = Json::Int64(settings.numChannels);
+	key["population"] = Json::Int64(numBrains);
+	key["cuda"] = settings.cuda;
+
+	Settings tuned = settings;
+	if (!settings.autotuneFile.empty())
+	{
+		Json::Reader reader;
+		Json::Value root;
+		std::ifstream file(settings.autotuneFile);
+		if (file && reader.parse(file, root) && root.isObject()
+			&& root["key"] == key)
+		{
+			tuned.torchThreads = root["torch_threads"].asUInt64();
+			tuned.localWorkers = root["local_workers"].asUInt64();
+			std::cout << "Using torch_threads " << tuned.torchThreads
+				<< " and local_workers " << tuned.localWorkers << " from "
+				<< settings.autotuneFile << std::endl;
+			return tuned;
+		}
+	}
+
+	// A real round with the same population, but only a few of its games,
+	// spread evenly over the round so that AI games are included too.
+	std::vector<GameSpec> round = NewtBrainTrainer::listGames(numBrains,
+		settings.numAIGames);
+	std::vector<GameSpec> games;
+	size_t count = std::min(settings.autotuneGames, round.size());
+	for (size_t i = 0; i < count; i++)
+	{
+		games.push_back(round[i * round.size() / count]);
+	}
+
+	Settings quiet = settings;
+	quiet.verbose = false;
+	quiet.recordingChance = 0;
+
+	Candidate best = {1, std::max(cores, size_t(1))};
+	double bestSpeed = 0;
+	auto tryCandidate = [&](const Candidate& candidate) {
+		double speed = measure(quiet, rulesetname, games, numBrains,
+			candidate);
+		std::cout << "Autotune: " << candidate.workers << " processes with "
+			<< candidate.threads << " threads play " << speed
+			<< " games per second" << std::endl;
+		if (speed > bestSpeed)
+		{
+			best = candidate;
+			bestSpeed = speed;
+		}
+	};
+
+	// First the number of processes, each using an equal share of the cores,
+	// then the number of threads for the best number of processes.
+	for (size_t workers = 1; workers <= std::max(cores, size_t(1));
+		workers *= 2)
+	{
+		tryCandidate({workers, std::max(cores / workers, size_t(1))});
+	}
+	size_t share = std::max(cores / best.workers, size_t(1));
+	size_t workers = best.workers;
+	for (size_t threads = 1; threads < share; threads *= 2)
+	{
+		tryCandidate({workers, threads});
+	}
+	if (bestSpeed <= 0)
+	{
+		std::cerr << "WARNING: autotune failed, keeping torch_threads and"
+			" local_workers as they are" << std::endl;
+		return tuned;
+	}
+
+	tuned.torchThreads = best.threads;
+	tuned.localWorkers = best.workers - 1;
+	std::cout << "Autotune chose torch_threads " << tuned.torchThreads
+		<< " and local_workers " << tuned.localWorkers << " ("
+		<< bestSpeed << " games per second)" << std::endl;
+
+	if (!settings.autotuneFile.empty())
+	{
+		Json::Value root = Json::objectValue;
+		root["key"] = key;
+		root["torch_threads"] = Json::UInt64(tuned.torchThreads);
+		root["local_workers"] = Json::UInt64(tuned.localWorkers);
+		root["games_per_second"] = bestSpeed;
+		AtomicFile file(settings.autotuneFile);
+		file.write(root.toStyledString());
+		file.commit();
+	}
+	return tuned;
+}
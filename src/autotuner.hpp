@@ -0,0 +1,37 @@
+/**
+ * Part of Epicinium NeuralNewt
+ * developed by A Bunch of Hacks.
+ *
+ * Copyright (c) 2020 A Bunch of Hacks
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * [authors:]
+ * Daan Mulder (daan@abunchofhacks.coop)
+ */
+
+
+#pragma once
+
+#include <string>
+
+struct Settings;
+
+
+// Plays a few games of a real round with fresh brains under several
+// combinations of torch_threads and local_workers, each in processes of
+// their own, and returns the settings with the fastest combination. With
+// autotune_file set, the result is stored there and reused by later sessions
+// on a machine with the same cores, num_channels and population size.
+// Must be called before libtorch starts any threads.
+Settings autotune(const Settings& settings, const std::string& rulesetname);
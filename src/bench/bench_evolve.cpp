@@ -0,0 +1,231 @@
+/**
+ * Part of Epicinium NeuralNewt
+ * developed by A Bunch of Hacks.
+ *
+ * Copyright (c) 2020 A Bunch of Hacks
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * [authors:]
+ * Daan Mulder (daan@abunchofhacks.coop)
+ */
+
+
+#include <iostream>
+#include <cstdio>
+#include <functional>
+#ifdef _MSC_VER
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+#include <torch/torch.h>
+
+#include "libs/jsoncpp/json.h"
+
+#include "setting.hpp"
+#include "folders.hpp"
+#include "memoryusage.hpp"
+#include "nnet/neuralnewtbrain.hpp"
+#include "nnet/brainpack.hpp"
+#include "bench/benchmark.hpp"
+
+
+typedef std::vector<std::shared_ptr<NeuralNewtBrain>> Population;
+
+static size_t fileSize(const std::string& filepath)
+{
+	struct stat buffer;
+	if (stat(filepath.c_str(), &buffer) != 0) return 0;
+	return buffer.st_size;
+}
+
+// Runs work once for each of count items, measuring each call and the peak
+// memory use over all of them. The result has parameters and megabytes per
+// second if the total number of parameters and bytes is given afterwards.
+static Json::Value measure(size_t count,
+	const std::function<void(size_t)>& work)
+{
+	size_t resident = residentBytes();
+	bool reset = resetPeakResident();
+	std::vector<double> times;
+	uint64_t allocations = Benchmark::allocations();
+	for (size_t i = 0; i < count; i++)
+	{
+		Benchmark::Stopwatch stopwatch;
+		work(i);
+		times.push_back(stopwatch.elapsed());
+	}
+	allocations = Benchmark::allocations() - allocations;
+	double seconds = 0.0;
+	for (double time : times) seconds += time / 1e6;
+
+	Json::Value json = Benchmark::summarize(times, 1, allocations);
+	json["seconds"] = seconds;
+	json["rss_before_mb"] = resident / 1048576.0;
+	json["peak_rss_mb"] = peakResidentBytes() / 1048576.0;
+	json["peak_is_since_start"] = !reset;
+	return json;
+}
+
+static void addThroughput(Json::Value& json, size_t parameters, size_t bytes)
+{
+	double seconds = json["seconds"].asDouble();
+	if (seconds <= 0.0) return;
+	if (parameters > 0) json["parameters_per_second"] = parameters / seconds;
+	if (bytes > 0) json["mb_per_second"] = bytes / 1048576.0 / seconds;
+}
+
+static Json::Value bench(const Settings& settings, size_t populationSize,
+	const std::string& folder)
+{
+	Population population;
+	for (size_t i = 0; i < populationSize; i++)
+	{
+		population.push_back(std::make_shared<NeuralNewtBrain>(settings,
+			std::make_shared<SeedBrainName>(i)));
+	}
+	size_t parameters = population[0]->numParameters();
+
+	Json::Value json = Json::objectValue;
+	json["num_channels"] = Json::UInt64(settings.numChannels);
+	json["population"] = Json::UInt64(populationSize);
+	json["parameters_per_brain"] = Json::UInt64(parameters);
+
+	Population offspring(populationSize);
+	json["mutate"] = measure(populationSize, [&](size_t i) {
+		offspring[i] = std::make_shared<NeuralNewtBrain>(
+			NeuralNewtBrain::mutate(*population[i], 1,
+				settings.mutationDeviationFactor,
+				settings.mutationSelectionChance));
+	});
+	addThroughput(json["mutate"], populationSize * parameters, 0);
+	offspring.clear();
+
+	// Each crossover produces two brains from a pair of parents.
+	size_t pairs = populationSize / 2;
+	offspring.resize(2 * pairs);
+	json["combine"] = measure(pairs, [&](size_t i) {
+		auto children = NeuralNewtBrain::combine(*population[2 * i],
+			*population[2 * i + 1], 1);
+		offspring[2 * i] = std::make_shared<NeuralNewtBrain>(
+			std::move(children.first));
+		offspring[2 * i + 1] = std::make_shared<NeuralNewtBrain>(
+			std::move(children.second));
+	});
+	addThroughput(json["combine"], 2 * pairs * parameters, 0);
+	offspring.clear();
+
+	auto archive = [](size_t i) {
+		return "bench" + std::to_string(i) + ".pth.tar";
+	};
+	size_t bytes = 0;
+	json["save_state_dict"] = measure(populationSize, [&](size_t i) {
+		std::remove((folder + "/" + archive(i)).c_str());
+		population[i]->save(folder, archive(i));
+	});
+	for (size_t i = 0; i < populationSize; i++)
+	{
+		bytes += fileSize(folder + "/" + archive(i));
+	}
+	addThroughput(json["save_state_dict"], 0, bytes);
+	json["load_state_dict"] = measure(populationSize, [&](size_t i) {
+		population[i]->load(folder, archive(i));
+	});
+	addThroughput(json["load_state_dict"], 0, bytes);
+	for (size_t i = 0; i < populationSize; i++)
+	{
+		std::remove((folder + "/" + archive(i)).c_str());
+	}
+
+	// A pack holds the whole population, so it is written in one go.
+	std::string packname = "bench.pack";
+	json["save_pack"] = measure(1, [&](size_t) {
+		NeuralNewtBrain::savePack(folder, packname, population);
+	});
+	bytes = fileSize(folder + "/" + packname);
+	addThroughput(json["save_pack"], 0, bytes);
+	{
+		BrainPack pack(folder + "/" + packname);
+		json["restore_pack"] = measure(populationSize, [&](size_t i) {
+			population[i]->restore(pack, i);
+		});
+		addThroughput(json["restore_pack"], 0, bytes);
+	}
+	std::remove((folder + "/" + packname).c_str());
+
+	return json;
+}
+
+static void run(int argc, char* argv[])
+{
+	std::vector<size_t> channelCounts = {16, 32, 48, 64};
+	std::vector<size_t> populationSizes = {10, 50, 100};
+	std::string folder = "brains/bench";
+	std::string output = "bench_evolve.json";
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		if (i + 1 >= argc)
+		{
+			throw std::runtime_error("Usage: bench_evolve"
+				" [--channels 16,32] [--populations 10,50]"
+				" [--folder brains/bench] [--output bench_evolve.json]");
+		}
+		std::string value = argv[++i];
+		if (arg == "--channels") channelCounts = Benchmark::parseList(value);
+		else if (arg == "--populations")
+			populationSizes = Benchmark::parseList(value);
+		else if (arg == "--folder") folder = value;
+		else if (arg == "--output") output = value;
+		else throw std::runtime_error("Unknown argument " + arg);
+	}
+
+	Settings settings = Setting::readSettings("settings.json");
+	if (settings.cuda && !torch::cuda::is_available()) settings.cuda = false;
+	if (settings.torchThreads > 0)
+		torch::set_num_threads(settings.torchThreads);
+	torch::NoGradGuard no_grad;
+	makeFolder(folder);
+
+	Json::Value json = Json::objectValue;
+	json["cuda"] = settings.cuda;
+	json["torch_threads"] = torch::get_num_threads();
+	json["results"] = Json::arrayValue;
+	for (size_t channels : channelCounts)
+	{
+		settings.numChannels = channels;
+		for (size_t populationSize : populationSizes)
+		{
+			std::cout << channels << " channels, population of "
+				<< populationSize << std::endl;
+			json["results"].append(bench(settings, populationSize, folder));
+		}
+	}
+
+	Benchmark::writeJson(json, output);
+}
+
+int main(int argc, char* argv[])
+{
+	try
+	{
+		run(argc, argv);
+	}
+	catch (const std::exception& e)
+	{
+		std::cerr << "Exception: " << e.what() << std::endl;
+		return 1;
+	}
+	return 0;
+}
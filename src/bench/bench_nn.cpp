@@ -0,0 +1,289 @@
+/**
+ * Part of Epicinium NeuralNewt
+ * developed by A Bunch of Hacks.
+ *
+ * Copyright (c) 2020 A Bunch of Hacks
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * [authors:]
+ * Daan Mulder (daan@abunchofhacks.coop)
+ */
+
+
+#include <iostream>
+#include <torch/torch.h>
+
+#include "libs/aftermath/writer.hpp"
+#include "libs/aftermath/library.hpp"
+#include "libs/aftermath/loginstaller.hpp"
+#include "libs/aftermath/automaton.hpp"
+#include "libs/aftermath/aineuralnewt.hpp"
+#include "libs/aftermath/aihungryhippo.hpp"
+#include "libs/aftermath/player.hpp"
+#include "libs/aftermath/difficulty.hpp"
+#include "libs/aftermath/position.hpp"
+#include "libs/jsoncpp/json.h"
+
+#include "setting.hpp"
+#include "nnet/module.hpp"
+#include "nnet/neuralnewtbrain.hpp"
+#include "bench/benchmark.hpp"
+
+
+// Captures the board states it is asked to evaluate, timing encode() on each
+// of them, and answers with neutral output.
+class CaptureBrain : public NewtBrain
+{
+public:
+	std::vector<std::vector<int8_t>> boards;
+	std::vector<double> encodeTimes;
+	uint64_t encodeAllocations = 0;
+
+private:
+	virtual void prepare(const AICommander& ai) override
+	{
+		uint64_t allocations = Benchmark::allocations();
+		Benchmark::Stopwatch stopwatch;
+		std::vector<int8_t> data = NeuralNewtBrain::encode(ai);
+		encodeTimes.push_back(stopwatch.elapsed());
+		encodeAllocations += Benchmark::allocations() - allocations;
+		boards.push_back(std::move(data));
+	}
+
+	virtual Output evaluate() override
+	{
+		Output output;
+		output.assign(std::vector<float>(Output::SIZE, 0.5f));
+		return output;
+	}
+};
+
+static void receive(const ChangeSet& cset, AICommander& ai1,
+	AICommander& ai2)
+{
+	ai1.receiveChanges(cset.get(ai1.player()));
+	ai2.receiveChanges(cset.get(ai2.player()));
+}
+
+// Plays a game between a neural newt with the given brain and a hungry hippo,
+// following the same phases as GameDirector::turn().
+static void playGame(const std::string& mapname,
+	const std::string& rulesetname, const std::shared_ptr<NewtBrain>& brain,
+	size_t maxTurns)
+{
+	static std::vector<Player> players = getPlayers(2);
+	Automaton automaton(players, rulesetname);
+	automaton.load(mapname, false);
+	std::shared_ptr<AICommander> ai1 = std::make_shared<AINeuralNewt>(
+		Player(1), Difficulty::HARD, rulesetname, 'A', brain);
+	std::shared_ptr<AICommander> ai2 = std::make_shared<AIHungryHippo>(
+		Player(2), Difficulty::HARD, rulesetname, 'B');
+
+	for (size_t turn = 0; turn < maxTurns; turn++)
+	{
+		while (automaton.active())
+		{
+			receive(automaton.act(), *ai1, *ai2);
+		}
+		if (automaton.gameover()) break;
+		receive(automaton.hibernate(), *ai1, *ai2);
+
+		ai1->preprocess();
+		ai2->preprocess();
+		bool finished1 = false;
+		bool finished2 = false;
+		while (!finished1 || !finished2)
+		{
+			if (!finished1) ai1->process();
+			if (!finished2) ai2->process();
+			if (!finished1) finished1 = ai1->postprocess();
+			if (!finished2) finished2 = ai2->postprocess();
+		}
+
+		receive(automaton.awake(), *ai1, *ai2);
+		automaton.receive(ai1->player(), ai1->orders());
+		automaton.receive(ai2->player(), ai2->orders());
+		receive(automaton.prepare(), *ai1, *ai2);
+	}
+}
+
+// Fills a batch with captured boards, repeating them if there are too few.
+static std::vector<int8_t> makeBatch(
+	const std::vector<std::vector<int8_t>>& boards, size_t batchSize)
+{
+	std::vector<int8_t> batch;
+	batch.reserve(batchSize * NeuralNewtBrain::INPUT_SIZE);
+	for (size_t i = 0; i < batchSize; i++)
+	{
+		const std::vector<int8_t>& board = boards[i % boards.size()];
+		batch.insert(batch.end(), board.begin(), board.end());
+	}
+	return batch;
+}
+
+static Json::Value benchForward(const Module& module,
+	const std::vector<int8_t>& batch, size_t batchSize, size_t iterations)
+{
+	const torch::Tensor& weight = module.parameters()[0];
+	torch::Tensor input = torch::from_blob(
+		const_cast<int8_t*>(batch.data()),
+		{
+			long(batchSize),
+			long(NeuralNewtBrain::NUM_PLANES),
+			long(Position::MAX_COLS),
+			long(Position::MAX_ROWS),
+		},
+		torch::kInt8
+	).to(weight.device(), weight.scalar_type());
+
+	std::vector<double> times;
+	uint64_t allocations = 0;
+	for (size_t i = 0; i <= iterations; i++)
+	{
+		// forward() replaces its argument, so each call gets a fresh handle.
+		torch::Tensor s = input;
+		uint64_t before = Benchmark::allocations();
+		Benchmark::Stopwatch stopwatch;
+		torch::Tensor result = module.forward(s);
+		// Reading a value waits for the device to finish.
+		result.sum().item<float>();
+		double elapsed = stopwatch.elapsed();
+		// The first call is a warm-up.
+		if (i == 0) continue;
+		times.push_back(elapsed);
+		allocations += Benchmark::allocations() - before;
+	}
+	return Benchmark::summarize(times, batchSize, allocations);
+}
+
+static Json::Value benchEvaluate(const Module& module,
+	const std::vector<int8_t>& batch, size_t batchSize, size_t iterations)
+{
+	std::vector<float> output(batchSize * NewtBrain::Output::SIZE);
+	std::vector<double> times;
+	uint64_t allocations = 0;
+	for (size_t i = 0; i <= iterations; i++)
+	{
+		uint64_t before = Benchmark::allocations();
+		Benchmark::Stopwatch stopwatch;
+		module.evaluate(batch.data(), batchSize, output.data());
+		double elapsed = stopwatch.elapsed();
+		if (i == 0) continue;
+		times.push_back(elapsed);
+		allocations += Benchmark::allocations() - before;
+	}
+	return Benchmark::summarize(times, batchSize, allocations);
+}
+
+static void run(int argc, char* argv[])
+{
+	std::vector<size_t> channelCounts = {16, 32, 48, 64};
+	std::vector<size_t> batchSizes = {1, 2, 4, 8, 16, 32, 64, 128, 256, 512};
+	size_t iterations = 20;
+	std::string mapname;
+	std::string output = "bench_nn.json";
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		if (i + 1 >= argc)
+		{
+			throw std::runtime_error("Usage: bench_nn [--channels 16,32]"
+				" [--batch-sizes 1,64] [--iterations 20] [--map name]"
+				" [--output bench_nn.json]");
+		}
+		std::string value = argv[++i];
+		if (arg == "--channels") channelCounts = Benchmark::parseList(value);
+		else if (arg == "--batch-sizes")
+			batchSizes = Benchmark::parseList(value);
+		else if (arg == "--iterations") iterations = std::stoul(value);
+		else if (arg == "--map") mapname = value;
+		else if (arg == "--output") output = value;
+		else throw std::runtime_error("Unknown argument " + arg);
+	}
+
+	Settings settings = Setting::readSettings("settings.json");
+	if (mapname.empty()) mapname = settings.mapNames[0];
+
+	Writer writer;
+	writer.install();
+	Library library;
+	library.load();
+	library.install();
+	LogInstaller("bench_nn", 20, settings.aftermathLoglevel).install();
+
+	if (settings.torchThreads > 0)
+		torch::set_num_threads(settings.torchThreads);
+	torch::NoGradGuard no_grad;
+
+	std::cout << "Capturing board states on " << mapname << std::endl;
+	auto capture = std::make_shared<CaptureBrain>();
+	playGame(mapname, Library::nameCurrentBible(), capture, 30);
+	if (capture->boards.empty())
+	{
+		throw std::runtime_error("No board states were captured");
+	}
+
+	Json::Value json = Json::objectValue;
+	json["map"] = mapname;
+	json["boards"] = Json::UInt64(capture->boards.size());
+	json["torch_threads"] = torch::get_num_threads();
+	json["encode"] = Benchmark::summarize(capture->encodeTimes, 1,
+		capture->encodeAllocations);
+	json["networks"] = Json::arrayValue;
+
+	// Half precision convolutions are only supported on the GPU.
+	std::vector<bool> halves = {false};
+	if (settings.cuda && torch::cuda::is_available()) halves.push_back(true);
+	for (bool half : halves)
+	{
+		for (size_t channels : channelCounts)
+		{
+			Module module(channels);
+			if (half) module.to(torch::kCUDA, torch::kHalf);
+			else module.to(torch::kFloat);
+			for (size_t batchSize : batchSizes)
+			{
+				std::cout << (half ? "half" : "float") << ", " << channels
+					<< " channels, batch size " << batchSize << std::endl;
+				std::vector<int8_t> batch = makeBatch(capture->boards,
+					batchSize);
+				Json::Value entry = Json::objectValue;
+				entry["dtype"] = half ? "half" : "float";
+				entry["num_channels"] = Json::UInt64(channels);
+				entry["batch_size"] = Json::UInt64(batchSize);
+				entry["forward"] = benchForward(module, batch, batchSize,
+					iterations);
+				entry["evaluate"] = benchEvaluate(module, batch, batchSize,
+					iterations);
+				json["networks"].append(entry);
+			}
+		}
+	}
+
+	Benchmark::writeJson(json, output);
+}
+
+int main(int argc, char* argv[])
+{
+	try
+	{
+		run(argc, argv);
+	}
+	catch (const std::exception& e)
+	{
+		std::cerr << "Exception: " << e.what() << std::endl;
+		return 1;
+	}
+	return 0;
+}
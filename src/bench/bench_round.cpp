@@ -0,0 +1,260 @@
+/**
+ * Part of Epicinium NeuralNewt
+ * developed by A Bunch of Hacks.
+ *
+ * Copyright (c) 2020 A Bunch of Hacks
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * [authors:]
+ * Daan Mulder (daan@abunchofhacks.coop)
+ */
+
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <cstdlib>
+#include <cstdio>
+#include <torch/torch.h>
+
+#include "libs/aftermath/writer.hpp"
+#include "libs/aftermath/library.hpp"
+#include "libs/aftermath/loginstaller.hpp"
+#include "libs/jsoncpp/json.h"
+
+#include "setting.hpp"
+#include "counters.hpp"
+#include "folders.hpp"
+#include "newtbraintrainer.hpp"
+#include "bench/benchmark.hpp"
+
+
+// Every .map file in the maps folder, in alphabetical order.
+static std::vector<std::string> allMaps()
+{
+	static const std::string extension = ".map";
+	std::vector<std::string> names;
+	for (const std::string& filename : listFolder("maps"))
+	{
+		if (filename.size() > extension.size()
+			&& filename.compare(filename.size() - extension.size(),
+				extension.size(), extension) == 0)
+		{
+			names.push_back(filename.substr(0,
+				filename.size() - extension.size()));
+		}
+	}
+	std::sort(names.begin(), names.end());
+	return names;
+}
+
+static Json::Value readJson(const std::string& filename)
+{
+	std::ifstream file(filename);
+	Json::Reader reader;
+	Json::Value root;
+	if (!file.is_open() || !reader.parse(file, root) || !root.isObject())
+	{
+		throw std::runtime_error("Cannot read baseline " + filename);
+	}
+	return root;
+}
+
+// Returns false if any of the throughputs dropped by more than the threshold,
+// a fraction of the baseline.
+static bool compare(const Json::Value& result, const Json::Value& baseline,
+	double threshold)
+{
+	static const char* const keys[] = {
+		"games_per_second",
+		"decisions_per_second",
+		"evaluations_per_second",
+	};
+	bool pass = true;
+	for (const char* key : keys)
+	{
+		double current = result[key].asDouble();
+		double previous = baseline[key].asDouble();
+		double change = (previous > 0.0) ? (current / previous - 1.0) : 0.0;
+		bool regressed = change < -threshold;
+		std::cout << key << ": " << current << " (baseline " << previous
+			<< ", " << (change >= 0.0 ? "+" : "") << (change * 100.0) << "%)"
+			<< (regressed ? " REGRESSED" : "") << std::endl;
+		if (regressed) pass = false;
+	}
+	return pass;
+}
+
+static int run(int argc, char* argv[])
+{
+	size_t numBrains = 6;
+	size_t numAIGames = 2;
+	size_t numRounds = 1;
+	size_t seed = 1;
+	std::string maps;
+	std::string output = "bench_round.json";
+	std::string baseline;
+	bool writeBaseline = false;
+	double threshold = 0.1;
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		if (arg == "--write-baseline")
+		{
+			writeBaseline = true;
+			continue;
+		}
+		if (i + 1 >= argc)
+		{
+			throw std::runtime_error("Usage: bench_round [--brains 6]"
+				" [--ai-games 2] [--rounds 1] [--seed 1] [--maps a,b]"
+				" [--output bench_round.json] [--baseline file"
+				" [--threshold 0.1] [--write-baseline]]");
+		}
+		std::string value = argv[++i];
+		if (arg == "--brains") numBrains = std::stoul(value);
+		else if (arg == "--ai-games") numAIGames = std::stoul(value);
+		else if (arg == "--rounds") numRounds = std::stoul(value);
+		else if (arg == "--seed") seed = std::stoul(value);
+		else if (arg == "--maps") maps = value;
+		else if (arg == "--output") output = value;
+		else if (arg == "--baseline") baseline = value;
+		else if (arg == "--threshold") threshold = std::stod(value);
+		else throw std::runtime_error("Unknown argument " + arg);
+	}
+	if (writeBaseline && baseline.empty())
+	{
+		throw std::runtime_error("--write-baseline requires --baseline");
+	}
+
+	// The tournament is fixed apart from the settings that determine how
+	// fast it can be played.
+	Settings settings = Setting::readSettings("settings.json");
+	settings.numRounds = numRounds;
+	settings.numPools = 1;
+	settings.brainsPerPool = numBrains;
+	settings.numAIGames = numAIGames;
+	settings.saveBrains = false;
+	settings.timing = false;
+	settings.verbose = false;
+	settings.recordingChance = 0.0f;
+	// Everything else a training session might have turned on.
+	settings.coordinatorPort = 0;
+	settings.localWorkers = 0;
+	settings.islands = false;
+	settings.affinity = false;
+	settings.autotune = false;
+	settings.metricsPort = 0;
+	settings.profile = false;
+	settings.captureChance = 0.0f;
+	settings.logFolder = "bench_round_logs";
+	if (maps.empty()) settings.mapNames = allMaps();
+	else
+	{
+		std::stringstream stream(maps);
+		std::string name;
+		settings.mapNames.clear();
+		while (std::getline(stream, name, ','))
+		{
+			settings.mapNames.push_back(name);
+		}
+	}
+	if (settings.mapNames.empty())
+	{
+		throw std::runtime_error("No maps found in the maps folder");
+	}
+
+	Writer writer;
+	writer.install();
+	Library library;
+	library.load();
+	library.install();
+	LogInstaller("bench_round", 20, settings.aftermathLoglevel).install();
+
+	// The brains are initialized with torch's generator, the baseline AIs
+	// use rand() and the map order and mutations use default-seeded engines.
+	torch::manual_seed(seed);
+	srand(seed);
+
+	Counters::Snapshot before = Counters::snapshot();
+	Benchmark::Stopwatch stopwatch;
+	{
+		NewtBrainTrainer trainer(settings, Library::nameCurrentBible());
+		trainer.train();
+	}
+	double seconds = stopwatch.elapsed() / 1e6;
+	Counters::Snapshot counts = Counters::snapshot() - before;
+	for (const std::string& entry : listFolder(settings.logFolder))
+	{
+		std::remove((settings.logFolder + "/" + entry).c_str());
+	}
+	std::remove(settings.logFolder.c_str());
+
+	Json::Value json = Json::objectValue;
+	json["seed"] = Json::UInt64(seed);
+	json["brains"] = Json::UInt64(numBrains);
+	json["ai_games"] = Json::UInt64(numAIGames);
+	json["rounds"] = Json::UInt64(numRounds);
+	json["maps"] = Json::arrayValue;
+	for (const std::string& name : settings.mapNames) json["maps"].append(name);
+	json["cuda"] = settings.cuda && torch::cuda::is_available();
+	json["torch_threads"] = torch::get_num_threads();
+	json["seconds"] = seconds;
+	for (size_t i = 0; i < Counters::NUM_COUNTS; i++)
+	{
+		Counters::Count count = Counters::Count(i);
+		json[Counters::name(count)] = Json::UInt64(counts.count(count));
+	}
+	uint64_t evaluations = counts.count(Counters::Count::EVALUATIONS);
+	json["games_per_second"] =
+		counts.count(Counters::Count::GAMES) / seconds;
+	json["decisions_per_second"] =
+		counts.count(Counters::Count::DECISIONS) / seconds;
+	json["evaluations_per_second"] = evaluations / seconds;
+	json["mean_batch_size"] = (evaluations > 0)
+		? double(counts.count(Counters::Count::EVALUATED_BOARDS))
+			/ evaluations
+		: 0.0;
+	json["phase_seconds"] = Json::objectValue;
+	for (size_t i = 0; i < Counters::NUM_PHASES; i++)
+	{
+		Counters::Phase phase = Counters::Phase(i);
+		json["phase_seconds"][Counters::name(phase)] = counts.seconds(phase);
+	}
+	Benchmark::writeJson(json, output);
+
+	if (baseline.empty()) return 0;
+	if (writeBaseline)
+	{
+		Benchmark::writeJson(json, baseline);
+		return 0;
+	}
+	bool pass = compare(json, readJson(baseline), threshold);
+	std::cout << (pass ? "PASS" : "FAIL") << std::endl;
+	return pass ? 0 : 1;
+}
+
+int main(int argc, char* argv[])
+{
+	try
+	{
+		return run(argc, argv);
+	}
+	catch (const std::exception& e)
+	{
+		std::cerr << "Exception: " << e.what() << std::endl;
+		return 1;
+	}
+}
@@ -0,0 +1,173 @@
+/**
+ * Part of Epicinium NeuralNewt
+ * developed by A Bunch of Hacks.
+ *
+ * Copyright (c) 2020 A Bunch of Hacks
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * [authors:]
+ * Daan Mulder (daan@abunchofhacks.coop)
+ */
+
+
+#include "benchmark.hpp"
+
+#include <atomic>
+#include <new>
+#include <cstdlib>
+#include <algorithm>
+#include <numeric>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#ifdef __linux__
+#include <dlfcn.h>
+#endif
+
+#include "libs/jsoncpp/json.h"
+
+
+static std::atomic<uint64_t> _allocations(0);
+
+void* operator new(size_t size)
+{
+	_allocations.fetch_add(1, std::memory_order_relaxed);
+	void* ptr = std::malloc(size == 0 ? 1 : size);
+	if (ptr == nullptr) throw std::bad_alloc();
+	return ptr;
+}
+
+void* operator new[](size_t size)
+{
+	return operator new(size);
+}
+
+void operator delete(void* ptr) noexcept
+{
+	std::free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept
+{
+	std::free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept
+{
+	std::free(ptr);
+}
+
+void operator delete[](void* ptr, size_t) noexcept
+{
+	std::free(ptr);
+}
+
+#ifdef __linux__
+// The CPU allocator of libtorch does not use operator new but allocates its
+// tensors with posix_memalign, which is intercepted here to count them too.
+extern "C" int posix_memalign(void** ptr, size_t alignment, size_t size)
+{
+	using Function = int (*)(void**, size_t, size_t);
+	static Function original = (Function) dlsym(RTLD_NEXT, "posix_memalign");
+	_allocations.fetch_add(1, std::memory_order_relaxed);
+	return original(ptr, alignment, size);
+}
+#endif
+
+uint64_t Benchmark::allocations()
+{
+	return _allocations.load(std::memory_order_relaxed);
+}
+
+double Benchmark::Stopwatch::elapsed() const
+{
+	auto end = std::chrono::steady_clock::now();
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(end - _start)
+		.count() / 1000.0;
+}
+
+static double percentile(const std::vector<double>& sorted, double p)
+{
+	size_t i = std::min(sorted.size() - 1, size_t(p * sorted.size()));
+	return sorted[i];
+}
+
+Json::Value Benchmark::summarize(std::vector<double> microseconds,
+	size_t itemsPerCall, uint64_t allocations)
+{
+	Json::Value json = Json::objectValue;
+	if (microseconds.empty()) return json;
+	std::sort(microseconds.begin(), microseconds.end());
+	double total = std::accumulate(microseconds.begin(), microseconds.end(),
+		0.0);
+	json["calls"] = Json::UInt64(microseconds.size());
+	json["mean_ms"] = total / microseconds.size() / 1000.0;
+	json["p50_ms"] = percentile(microseconds, 0.50) / 1000.0;
+	json["p90_ms"] = percentile(microseconds, 0.90) / 1000.0;
+	json["p99_ms"] = percentile(microseconds, 0.99) / 1000.0;
+	json["max_ms"] = microseconds.back() / 1000.0;
+	json["items_per_second"] = (total > 0.0)
+		? microseconds.size() * itemsPerCall / (total / 1e6) : 0.0;
+	json["allocations_per_call"] =
+		double(allocations) / microseconds.size();
+	return json;
+}
+
+std::vector<size_t> Benchmark::parseList(const std::string& list)
+{
+	std::vector<size_t> result;
+	std::stringstream stream(list);
+	std::string item;
+	while (std::getline(stream, item, ','))
+	{
+		try
+		{
+			result.push_back(std::stoul(item));
+		}
+		catch (...)
+		{
+			throw std::runtime_error("Cannot parse \"" + item + "\" in list \""
+				+ list + "\"");
+		}
+		if (result.back() == 0)
+		{
+			throw std::runtime_error("Zero is not allowed in list \"" + list
+				+ "\"");
+		}
+	}
+	if (result.empty())
+	{
+		throw std::runtime_error("List \"" + list + "\" is empty");
+	}
+	return result;
+}
+
+void Benchmark::writeJson(const Json::Value& json,
+	const std::string& filename)
+{
+	std::string text = json.toStyledString();
+	if (filename.empty())
+	{
+		std::cout << text;
+		return;
+	}
+	std::ofstream file(filename);
+	if (!file.is_open())
+	{
+		throw std::runtime_error("Cannot open " + filename + " for writing");
+	}
+	file << text;
+	std::cout << "Results written to " << filename << std::endl;
+}
@@ -0,0 +1,66 @@
+/**
+ * Part of Epicinium NeuralNewt
+ * developed by A Bunch of Hacks.
+ *
+ * Copyright (c) 2020 A Bunch of Hacks
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * [authors:]
+ * Daan Mulder (daan@abunchofhacks.coop)
+ */
+
+
+#pragma once
+
+#include <vector>
+#include <string>
+#include <chrono>
+#include <cstdint>
+
+#include "libs/jsoncpp/json-forwards.h"
+
+
+// Helpers shared by the benchmark targets. Linking benchmark.cpp replaces the
+// global operator new and, on Linux, posix_memalign, so that allocations can
+// be counted.
+namespace Benchmark
+{
+	// The number of calls to operator new since the program started, plus on
+	// Linux those to posix_memalign, which libtorch uses for CPU tensors.
+	// Memory on the GPU is not counted.
+	uint64_t allocations();
+
+	class Stopwatch
+	{
+	private:
+		std::chrono::steady_clock::time_point _start;
+
+	public:
+		Stopwatch() : _start(std::chrono::steady_clock::now()) {}
+
+		// Microseconds since construction.
+		double elapsed() const;
+	};
+
+	// Summarizes the durations of calls that each handled itemsPerCall items
+	// as mean and percentile latencies in milliseconds, items per second and
+	// allocations per call.
+	Json::Value summarize(std::vector<double> microseconds,
+		size_t itemsPerCall, uint64_t allocations);
+
+	// Parses a comma-separated list of positive numbers, such as "16,32,48".
+	std::vector<size_t> parseList(const std::string& list);
+
+	void writeJson(const Json::Value& json, const std::string& filename);
+}
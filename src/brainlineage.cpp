@@ -0,0 +1,134 @@
+/**
+ * Part of Epicinium NeuralNewt
+ * developed by A Bunch of Hacks.
+ *
+ * Copyright (c) 2020 A Bunch of Hacks
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * [authors:]
+ * Daan Mulder (daan@abunchofhacks.coop)
+ */
+
+#include "brainlineage.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+
+std::vector<BrainLineage::Entry> BrainLineage::_entries;
+uint32_t BrainLineage::_nextId = 0;
+std::mutex BrainLineage::_mutex;
+
+const BrainLineage::Entry* BrainLineage::find(uint32_t id)
+{
+	auto it = std::lower_bound(_entries.begin(), _entries.end(), id,
+		[](const Entry& entry, uint32_t x) { return entry.id < x; });
+	if (it == _entries.end() || it->id != id) return nullptr;
+	return &(*it);
+}
+
+uint32_t BrainLineage::add(Kind kind, size_t round,
+	const std::string& shortName, uint32_t parent1, uint32_t parent2)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	Entry entry;
+	entry.id = _nextId++;
+	entry.round = round;
+	entry.parent1 = parent1;
+	entry.parent2 = parent2;
+	entry.kind = kind;
+	entry.alive = true;
+	std::memset(entry.tag, 0, sizeof(entry.tag));
+	std::memcpy(entry.tag, shortName.data(),
+		std::min(shortName.size(), sizeof(entry.tag)));
+	_entries.push_back(entry);
+	return entry.id;
+}
+
+void BrainLineage::release(uint32_t id)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	Entry* entry = const_cast<Entry*>(find(id));
+	if (entry != nullptr) entry->alive = false;
+}
+
+std::string BrainLineage::describe(uint32_t id)
+{
+	const Entry* entry = find(id);
+	if (entry == nullptr) return "#" + std::to_string(id);
+	std::string tag(entry->tag, strnlen(entry->tag, sizeof(entry->tag)));
+	switch (entry->kind)
+	{
+		case Kind::SEED:
+		case Kind::RESTORED:
+		{
+			return tag;
+		}
+		case Kind::MUTATION:
+		{
+			return "m" + std::to_string(entry->round) + "("
+				+ describe(entry->parent1) + ")";
+		}
+		case Kind::CROSSOVER:
+		{
+			return "c" + std::to_string(entry->round) + "("
+				+ describe(entry->parent1) + ","
+				+ describe(entry->parent2) + ")";
+		}
+	}
+	return tag;
+}
+
+std::string BrainLineage::longName(uint32_t id)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	return describe(id);
+}
+
+size_t BrainLineage::prune(size_t maxDepth)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	std::vector<size_t> depth(_entries.size(), size_t(-1));
+	// Parents always have a lower id than their children, so walking
+	// backwards visits every child before its parents.
+	for (size_t i = _entries.size(); i-- > 0; )
+	{
+		if (_entries[i].alive) depth[i] = 0;
+		if (depth[i] >= maxDepth) continue;
+		for (uint32_t parent : {_entries[i].parent1, _entries[i].parent2})
+		{
+			if (parent == NONE) continue;
+			const Entry* entry = find(parent);
+			if (entry == nullptr) continue;
+			size_t j = entry - _entries.data();
+			depth[j] = std::min(depth[j], depth[i] + 1);
+		}
+	}
+
+	size_t j = 0;
+	for (size_t i = 0; i < _entries.size(); i++)
+	{
+		if (depth[i] <= maxDepth) _entries[j++] = _entries[i];
+	}
+	size_t removed = _entries.size() - j;
+	_entries.resize(j);
+	_entries.shrink_to_fit();
+	return removed;
+}
+
+size_t BrainLineage::size()
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	return _entries.size();
+}
@@ -0,0 +1,83 @@
+/**
+ * Part of Epicinium NeuralNewt
+ * developed by A Bunch of Hacks.
+ *
+ * Copyright (c) 2020 A Bunch of Hacks
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * [authors:]
+ * Daan Mulder (daan@abunchofhacks.coop)
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <cstdint>
+
+
+// Keeps track of the ancestry of all brains as a flat table of edges between
+// interned integer ids, so that brain names do not have to keep their parents
+// alive. Entries of brains that have died can be pruned once they are no
+// longer needed to describe the lineage of living brains.
+class BrainLineage
+{
+public:
+	static const uint32_t NONE = uint32_t(-1);
+
+	enum class Kind : uint8_t
+	{
+		SEED,
+		MUTATION,
+		CROSSOVER,
+		RESTORED,
+	};
+
+private:
+	struct Entry
+	{
+		uint32_t id;
+		uint32_t round;
+		uint32_t parent1;
+		uint32_t parent2;
+		Kind kind;
+		bool alive;
+		char tag[8];
+	};
+
+	// Sorted by id, because ids are handed out in increasing order.
+	static std::vector<Entry> _entries;
+	static uint32_t _nextId;
+	static std::mutex _mutex;
+
+	static const Entry* find(uint32_t id);
+	static std::string describe(uint32_t id);
+
+public:
+	static uint32_t add(Kind kind, size_t round, const std::string& shortName,
+		uint32_t parent1 = NONE, uint32_t parent2 = NONE);
+	static void release(uint32_t id);
+
+	// Reconstructs the full genealogy of a brain, such as "c3(m2(s0),s1)".
+	// Pruned ancestors are shown by their id, e.g. "#123". The result grows
+	// exponentially with the number of crossovers in the lineage.
+	static std::string longName(uint32_t id);
+
+	// Removes every entry that is not within maxDepth generations of a living
+	// brain. Returns the number of removed entries.
+	static size_t prune(size_t maxDepth);
+
+	static size_t size();
+};
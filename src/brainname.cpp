@@ -22,20 +22,20 @@
 
 #include "brainname.hpp"
 
-#include <cassert>
-
 #include "libs/openssl/sha.h"
 
 
-static const size_t MEDIUM_NAME_DEPTH = 3;
-
-BrainName::BrainName(const std::string& mediumName,
-		const std::string& shortName, size_t round) :
-	_mediumName(mediumName),
+BrainName::BrainName(const std::string& shortName, size_t round) :
+	_id(BrainLineage::NONE),
 	_shortName(shortName),
 	_round(round)
 {}
 
+BrainName::~BrainName()
+{
+	BrainLineage::release(_id);
+}
+
 std::string sha256(const std::string& data)
 {
 	uint8_t digest[SHA256_DIGEST_LENGTH];
@@ -56,107 +56,48 @@ std::string sha256(const std::string& data)
 }
 
 SeedBrainName::SeedBrainName(size_t n) :
-	BrainName("s" + std::to_string(n), _mediumName, 0)
-{}
-
-std::string SeedBrainName::shortenedName(size_t) const
+	BrainName("s" + std::to_string(n), 0)
 {
-	return shortName();
-}
-
-std::string SeedBrainName::longName() const
-{
-	return shortName();
-}
-
-std::string muBrainNameShortenedName(size_t depth,
-	const std::string& parentShort, size_t round)
-{
-	assert(depth > 0);
-	return "m" + std::to_string(round) + "(" + parentShort + ")";
-}
-
-std::string muBrainNameLongName(const std::string& parentLong, size_t round)
-{
-	return "m" + std::to_string(round) + "(" + parentLong + ")";
+	_shortenedNames.fill(_shortName);
+	_id = BrainLineage::add(BrainLineage::Kind::SEED, _round, _shortName);
 }
 
 MuBrainName::MuBrainName(const BrainNamePtr& parent, size_t round) :
 	BrainName(
-		muBrainNameShortenedName(MEDIUM_NAME_DEPTH,
-			parent->shortenedName(MEDIUM_NAME_DEPTH - 1), round),
 		sha256("m" + std::to_string(round) + "(" + parent->shortName() + ")"),
-		round
-	),
-	_parent(parent)
-{}
-
-std::string MuBrainName::shortenedName(size_t depth) const
-{
-	if (depth == 0) return shortName().substr(0, 8);
-	return muBrainNameShortenedName(depth, _parent->shortenedName(depth - 1),
-		_round);
-}
-
-std::string MuBrainName::longName() const
+		round)
 {
-	return muBrainNameLongName(_parent->longName(), _round);
-}
-
-std::string coBrainNameShortenedName(size_t depth,
-	const std::string& parent1Short, const std::string& parent2Short,
-	size_t round)
-{
-	assert(depth > 0);
-	return "c" + std::to_string(round) + "(" + parent1Short + "," + parent2Short
-		+ ")";
-}
-
-std::string coBrainNameLongName(const std::string& parent1Long,
-	const std::string& parent2Long, size_t round)
-{
-	return "c" + std::to_string(round) + "(" + parent1Long + "," + parent2Long
-		+ ")";
+	_shortenedNames[0] = _shortName.substr(0, 8);
+	for (size_t depth = 1; depth <= MEDIUM_NAME_DEPTH; depth++)
+	{
+		_shortenedNames[depth] = "m" + std::to_string(round) + "("
+			+ parent->shortenedName(depth - 1) + ")";
+	}
+	_id = BrainLineage::add(BrainLineage::Kind::MUTATION, _round, _shortName,
+		parent->id());
 }
 
 CoBrainName::CoBrainName(const BrainNamePtr& parent1,
 		const BrainNamePtr& parent2, size_t round):
 	BrainName(
-		coBrainNameShortenedName(MEDIUM_NAME_DEPTH,
-			parent1->shortenedName(MEDIUM_NAME_DEPTH - 1),
-			parent2->shortenedName(MEDIUM_NAME_DEPTH - 1), round),
 		sha256("c" + std::to_string(round) + "(" + parent1->shortName() + ","
 			+ parent2->shortName() + ")"),
-		round
-	),
-	_parent1(parent1),
-	_parent2(parent2)
-{}
-
-std::string CoBrainName::shortenedName(size_t depth) const
+		round)
 {
-	if (depth == 0) return shortName().substr(0, 8);
-	return coBrainNameShortenedName(depth, _parent1->shortenedName(depth - 1),
-		_parent2->shortenedName(depth - 1), _round);
-}
-
-std::string CoBrainName::longName() const
-{
-	return coBrainNameLongName(_parent1->longName(), _parent2->longName(),
-		_round);
+	_shortenedNames[0] = _shortName.substr(0, 8);
+	for (size_t depth = 1; depth <= MEDIUM_NAME_DEPTH; depth++)
+	{
+		_shortenedNames[depth] = "c" + std::to_string(round) + "("
+			+ parent1->shortenedName(depth - 1) + ","
+			+ parent2->shortenedName(depth - 1) + ")";
+	}
+	_id = BrainLineage::add(BrainLineage::Kind::CROSSOVER, _round, _shortName,
+		parent1->id(), parent2->id());
 }
 
 RestoredBrainName::RestoredBrainName(const std::string& name, size_t round) :
-	BrainName(name.substr(0, 8), name, round)
-{}
-
-std::string RestoredBrainName::shortenedName(size_t depth) const
-{
-	if (depth < MEDIUM_NAME_DEPTH) return shortName().substr(0, 8);
-	return mediumName();
-}
-
-std::string RestoredBrainName::longName() const
+	BrainName(name, round)
 {
-	return mediumName();
+	_shortenedNames.fill(_shortName.substr(0, 8));
+	_id = BrainLineage::add(BrainLineage::Kind::RESTORED, _round, _shortName);
 }
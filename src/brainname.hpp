@@ -24,6 +24,9 @@
 
 #include <memory>
 #include <string>
+#include <array>
+
+#include "brainlineage.hpp"
 
 class BrainName;
 class BrainNamePtr : public std::shared_ptr<BrainName>
@@ -32,11 +35,18 @@ class BrainNamePtr : public std::shared_ptr<BrainName>
 };
 
 
+// Names do not refer to their parents; the ancestry is recorded in the
+// BrainLineage instead. Every name is computed once, when the brain is born.
 class BrainName
 {
+public:
+	static const size_t MEDIUM_NAME_DEPTH = 3;
+
 private:
-	std::string _mediumName;
+	uint32_t _id;
 	std::string _shortName;
+	// The name shortened to each depth, where the last one is the medium name.
+	std::array<std::string, MEDIUM_NAME_DEPTH + 1> _shortenedNames;
 	size_t _round;
 
 	friend class SeedBrainName;
@@ -44,66 +54,45 @@ private:
 	friend class CoBrainName;
 	friend class RestoredBrainName;
 
-	BrainName(const std::string& mediumName, const std::string& shortName,
-		size_t round);
-	virtual ~BrainName() = default;
-
-	virtual std::string shortenedName(size_t depth) const = 0;
+	BrainName(const std::string& shortName, size_t round);
+	virtual ~BrainName();
 
-	virtual std::string longName() const = 0;
+	const std::string& shortenedName(size_t depth) const
+	{
+		return _shortenedNames[depth];
+	}
 
 public:
-	std::string mediumName() const { return _mediumName; }
+	uint32_t id() const { return _id; }
+	std::string mediumName() const
+	{
+		return _shortenedNames[MEDIUM_NAME_DEPTH];
+	}
 	std::string shortName() const { return _shortName; }
+	std::string longName() const { return BrainLineage::longName(_id); }
 };
 
 class SeedBrainName : public BrainName
 {
 public:
 	SeedBrainName(size_t n);
-
-private:
-	std::string shortenedName(size_t depth) const override;
-
-	std::string longName() const override;
 };
 
 class MuBrainName : public BrainName
 {
-private:
-	BrainNamePtr _parent;
-
 public:
 	MuBrainName(const BrainNamePtr& parent, size_t round);
-
-private:
-	std::string shortenedName(size_t depth) const override;
-
-	std::string longName() const override;
 };
 
 class CoBrainName : public BrainName
 {
-private:
-	BrainNamePtr _parent1, _parent2;
-
 public:
 	CoBrainName(const BrainNamePtr& parent1, const BrainNamePtr& parent2,
 		size_t round);
-
-private:
-	std::string shortenedName(size_t depth) const override;
-
-	std::string longName() const override;
 };
 
 class RestoredBrainName : public BrainName
 {
 public:
 	RestoredBrainName(const std::string& name, size_t round);
-
-private:
-	std::string shortenedName(size_t depth) const override;
-
-	std::string longName() const override;
 };
@@ -0,0 +1,175 @@
+/**
+ * Part of Epicinium NeuralNewt
+ * developed by A Bunch of Hacks.
+ *
+ * Copyright (c) 2020 A Bunch of Hacks
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * [authors:]
+ * Daan Mulder (daan@abunchofhacks.coop)
+ */
+
+#include "checkpointwriter.hpp"
+
+#include <iostream>
+#include <chrono>
+#include <algorithm>
+
+#include "atomicfile.hpp"
+#include "folders.hpp"
+#include "counters.hpp"
+#include "profiler.hpp"
+#include "nnet/neuralnewtbrain.hpp"
+#include "nnet/brainstore.hpp"
+
+
+CheckpointWriter::CheckpointWriter(size_t capacity,
+		const std::string& storeFolder, bool timing) :
+	_capacity(std::max(capacity, size_t(1))),
+	_store(storeFolder.empty() ? nullptr : new BrainStore(storeFolder)),
+	_timing(timing),
+	_busy(false),
+	_stopping(false),
+	_thread(&CheckpointWriter::run, this)
+{}
+
+CheckpointWriter::~CheckpointWriter()
+{
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_stopping = true;
+	}
+	_changed.notify_all();
+	_thread.join();
+}
+
+void CheckpointWriter::run()
+{
+	Profiler::nameThread("checkpoint writer");
+	std::unique_lock<std::mutex> lock(_mutex);
+	while (true)
+	{
+		_changed.wait(lock, [this]() {
+			return _stopping || !_queue.empty();
+		});
+		// Finish writing everything that has been queued before stopping.
+		if (_queue.empty()) return;
+
+		Job job = std::move(_queue.front());
+		_queue.pop_front();
+		_busy = true;
+		lock.unlock();
+		_changed.notify_all();
+
+		std::exception_ptr error;
+		try
+		{
+			write(job);
+		}
+		catch (...)
+		{
+			error = std::current_exception();
+		}
+
+		lock.lock();
+		_busy = false;
+		if (error && !_error) _error = error;
+		_changed.notify_all();
+	}
+}
+
+void CheckpointWriter::write(const Job& job)
+{
+	Profiler::Scope scope("writeCheckpoint");
+	std::chrono::high_resolution_clock::time_point start;
+	if (_timing) start = std::chrono::high_resolution_clock::now();
+
+	std::string round = "round" + std::to_string(job.round);
+	makeFolder(job.folder);
+	std::string names;
+	size_t written = 0;
+	if (_store)
+	{
+		// Brains that survive a round unchanged, or that were already stored
+		// by another session, are not written again.
+		for (const auto& brain : job.brains)
+		{
+			bool isNew = false;
+			std::string hash = brain->store(*_store, isNew);
+			if (isNew) written++;
+			names += brain->shortName() + " " + BrainStore::PREFIX + hash
+				+ "\n";
+		}
+	}
+	else
+	{
+		NeuralNewtBrain::savePack(job.folder, round + ".pack", job.brains);
+		written = job.brains.size();
+		for (const auto& brain : job.brains)
+		{
+			names += brain->shortName() + "\n";
+		}
+	}
+
+	// The list of names is written last, so that a round is only resumable
+	// once all of its weights are on disk.
+	AtomicFile brainList(job.folder + "/" + round + ".txt");
+	brainList.write(names);
+	brainList.commit();
+	Counters::add(Counters::Count::STORED_BRAINS, job.brains.size());
+	Counters::add(Counters::Count::WRITTEN_BRAINS, written);
+
+	if (_timing)
+	{
+		auto end = std::chrono::high_resolution_clock::now();
+		float d =
+			std::chrono::duration_cast<std::chrono::microseconds>(end - start)
+			.count() / 1000.0f;
+		std::cout << "Writing " << round << " took " << d << "ms ("
+			<< (d / job.brains.size()) << "ms per brain, " << written << " of "
+			<< job.brains.size() << " brains written)" << std::endl;
+	}
+}
+
+void CheckpointWriter::rethrow()
+{
+	if (_error)
+	{
+		std::exception_ptr error = _error;
+		_error = nullptr;
+		std::rethrow_exception(error);
+	}
+}
+
+void CheckpointWriter::push(const std::string& folder, size_t round,
+	const std::vector<std::shared_ptr<NeuralNewtBrain>>& brains)
+{
+	std::unique_lock<std::mutex> lock(_mutex);
+	_changed.wait(lock, [this]() {
+		return _error || _queue.size() < _capacity;
+	});
+	rethrow();
+	_queue.push_back({folder, round, brains});
+	lock.unlock();
+	_changed.notify_all();
+}
+
+void CheckpointWriter::flush()
+{
+	std::unique_lock<std::mutex> lock(_mutex);
+	_changed.wait(lock, [this]() {
+		return _error || (_queue.empty() && !_busy);
+	});
+	rethrow();
+}
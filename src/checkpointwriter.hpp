@@ -0,0 +1,86 @@
+/**
+ * Part of Epicinium NeuralNewt
+ * developed by A Bunch of Hacks.
+ *
+ * Copyright (c) 2020 A Bunch of Hacks
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * [authors:]
+ * Daan Mulder (daan@abunchofhacks.coop)
+ */
+
+#pragma once
+
+#include <deque>
+#include <vector>
+#include <memory>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+
+class NeuralNewtBrain;
+class BrainStore;
+
+
+// Saves rounds of brains on a background thread, so that the next round can
+// be played while the previous one is being written to disk. Brains are never
+// altered after evolution, so holding on to the pointers is enough to keep a
+// consistent snapshot of the population.
+class CheckpointWriter
+{
+private:
+	struct Job
+	{
+		std::string folder;
+		size_t round;
+		std::vector<std::shared_ptr<NeuralNewtBrain>> brains;
+	};
+
+	size_t _capacity;
+	std::unique_ptr<BrainStore> _store;
+	bool _timing;
+	std::deque<Job> _queue;
+	bool _busy;
+	bool _stopping;
+	std::exception_ptr _error;
+	std::mutex _mutex;
+	std::condition_variable _changed;
+	std::thread _thread;
+
+public:
+	// If storeFolder is empty, each round is written as a single brain pack.
+	// Otherwise brains are put in the shared BrainStore in that folder.
+	CheckpointWriter(size_t capacity, const std::string& storeFolder,
+		bool timing);
+	CheckpointWriter(const CheckpointWriter&) = delete;
+	CheckpointWriter(CheckpointWriter&&) = delete;
+	CheckpointWriter& operator=(const CheckpointWriter&) = delete;
+	CheckpointWriter& operator=(CheckpointWriter&&) = delete;
+	~CheckpointWriter();
+
+private:
+	void run();
+	void write(const Job& job);
+	void rethrow();
+
+public:
+	// Blocks while the queue is full.
+	void push(const std::string& folder, size_t round,
+		const std::vector<std::shared_ptr<NeuralNewtBrain>>& brains);
+
+	// Blocks until every queued round has been written.
+	void flush();
+};
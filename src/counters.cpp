@@ -0,0 +1,133 @@
+/**
+ * Part of Epicinium NeuralNewt
+ * developed by A Bunch of Hacks.
+ *
+ * Copyright (c) 2020 A Bunch of Hacks
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * [authors:]
+ * Daan Mulder (daan@abunchofhacks.coop)
+ */
+
+
+#include "counters.hpp"
+
+
+std::array<std::atomic<uint64_t>, Counters::NUM_COUNTS> Counters::_counts = {};
+std::array<std::atomic<uint64_t>, Counters::NUM_PHASES>
+	Counters::_nanoseconds = {};
+std::array<std::atomic<uint64_t>, Counters::NUM_BATCH_SIZES>
+	Counters::_batchSizes = {};
+
+Counters::Timer::~Timer()
+{
+	auto end = std::chrono::steady_clock::now();
+	addTime(_phase, std::chrono::duration_cast<std::chrono::nanoseconds>(
+		end - _start).count());
+}
+
+Counters::Snapshot Counters::Snapshot::operator-(const Snapshot& other) const
+{
+	Snapshot result;
+	for (size_t i = 0; i < NUM_COUNTS; i++)
+	{
+		result.counts[i] = counts[i] - other.counts[i];
+	}
+	for (size_t i = 0; i < NUM_PHASES; i++)
+	{
+		result.nanoseconds[i] = nanoseconds[i] - other.nanoseconds[i];
+	}
+	for (size_t i = 0; i < NUM_BATCH_SIZES; i++)
+	{
+		result.batchSizes[i] = batchSizes[i] - other.batchSizes[i];
+	}
+	return result;
+}
+
+void Counters::add(const Snapshot& snapshot)
+{
+	for (size_t i = 0; i < NUM_COUNTS; i++)
+	{
+		_counts[i].fetch_add(snapshot.counts[i], std::memory_order_relaxed);
+	}
+	for (size_t i = 0; i < NUM_PHASES; i++)
+	{
+		_nanoseconds[i].fetch_add(snapshot.nanoseconds[i],
+			std::memory_order_relaxed);
+	}
+	for (size_t i = 0; i < NUM_BATCH_SIZES; i++)
+	{
+		_batchSizes[i].fetch_add(snapshot.batchSizes[i],
+			std::memory_order_relaxed);
+	}
+}
+
+Counters::Snapshot Counters::snapshot()
+{
+	Snapshot result;
+	for (size_t i = 0; i < NUM_COUNTS; i++)
+	{
+		result.counts[i] = _counts[i].load(std::memory_order_relaxed);
+	}
+	for (size_t i = 0; i < NUM_PHASES; i++)
+	{
+		result.nanoseconds[i] =
+			_nanoseconds[i].load(std::memory_order_relaxed);
+	}
+	for (size_t i = 0; i < NUM_BATCH_SIZES; i++)
+	{
+		result.batchSizes[i] = _batchSizes[i].load(std::memory_order_relaxed);
+	}
+	return result;
+}
+
+const char* Counters::name(Count count)
+{
+	switch (count)
+	{
+		case Count::GAMES: return "games";
+		case Count::STARTED_GAMES: return "started_games";
+		case Count::TURNS: return "turns";
+		case Count::RECORDINGS: return "recordings";
+		case Count::DECISIONS: return "decisions";
+		case Count::EVALUATIONS: return "evaluations";
+		case Count::EVALUATED_BOARDS: return "evaluated_boards";
+		case Count::STORED_BRAINS: return "stored_brains";
+		case Count::WRITTEN_BRAINS: return "written_brains";
+	}
+	return "";
+}
+
+const char* Counters::name(Phase phase)
+{
+	switch (phase)
+	{
+		case Phase::SETUP: return "setup";
+		case Phase::AUTOMATON: return "automaton";
+		case Phase::AI: return "ai";
+		case Phase::ENCODE: return "encode";
+		case Phase::INFERENCE: return "inference";
+		case Phase::EVOLVE: return "evolve";
+		case Phase::SAVE: return "save";
+	}
+	return "";
+}
+
+std::string Counters::batchSizeName(size_t bucket)
+{
+	size_t low = size_t(1) << bucket;
+	if (bucket + 1 == NUM_BATCH_SIZES) return std::to_string(low) + "+";
+	else if (low == 1) return "1";
+	return std::to_string(low) + "-" + std::to_string(2 * low - 1);
+}
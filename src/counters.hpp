@@ -0,0 +1,140 @@
+/**
+ * Part of Epicinium NeuralNewt
+ * developed by A Bunch of Hacks.
+ *
+ * Copyright (c) 2020 A Bunch of Hacks
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * [authors:]
+ * Daan Mulder (daan@abunchofhacks.coop)
+ */
+
+
+#pragma once
+
+#include <array>
+#include <string>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+
+// Process-wide event counts and time spent per phase of a round. They are
+// cheap enough to always be collected. Counts only ever increase, so to
+// measure something, take a snapshot before and after and subtract.
+class Counters
+{
+public:
+	enum class Count : uint8_t
+	{
+		GAMES,
+		STARTED_GAMES,
+		TURNS,
+		RECORDINGS,
+		DECISIONS,
+		EVALUATIONS,
+		EVALUATED_BOARDS,
+		STORED_BRAINS,
+		WRITTEN_BRAINS,
+	};
+	static const size_t NUM_COUNTS = ((size_t) Count::WRITTEN_BRAINS) + 1;
+
+	// AI includes the time spent in ENCODE and INFERENCE.
+	enum class Phase : uint8_t
+	{
+		SETUP,
+		AUTOMATON,
+		AI,
+		ENCODE,
+		INFERENCE,
+		EVOLVE,
+		SAVE,
+	};
+	static const size_t NUM_PHASES = ((size_t) Phase::SAVE) + 1;
+
+	// Evaluations are counted per power of two of their batch size, so that
+	// bucket i holds batches of 2^i up to 2^(i+1) - 1 boards. The last bucket
+	// also holds all larger batches.
+	static const size_t NUM_BATCH_SIZES = 8;
+
+	struct Snapshot
+	{
+		std::array<uint64_t, NUM_COUNTS> counts;
+		std::array<uint64_t, NUM_PHASES> nanoseconds;
+		std::array<uint64_t, NUM_BATCH_SIZES> batchSizes;
+
+		uint64_t count(Count count) const { return counts[(size_t) count]; }
+		double seconds(Phase phase) const
+			{ return nanoseconds[(size_t) phase] / 1e9; }
+
+		Snapshot operator-(const Snapshot& other) const;
+	};
+
+	// Adds the time from construction to destruction to a phase.
+	class Timer
+	{
+	private:
+		Phase _phase;
+		std::chrono::steady_clock::time_point _start;
+
+	public:
+		explicit Timer(Phase phase) :
+			_phase(phase),
+			_start(std::chrono::steady_clock::now())
+		{}
+		Timer(const Timer&) = delete;
+		Timer(Timer&&) = delete;
+		Timer& operator=(const Timer&) = delete;
+		Timer& operator=(Timer&&) = delete;
+		~Timer();
+	};
+
+private:
+	static std::array<std::atomic<uint64_t>, NUM_COUNTS> _counts;
+	static std::array<std::atomic<uint64_t>, NUM_PHASES> _nanoseconds;
+	static std::array<std::atomic<uint64_t>, NUM_BATCH_SIZES> _batchSizes;
+
+public:
+	static void add(Count count, uint64_t n = 1)
+	{
+		_counts[(size_t) count].fetch_add(n, std::memory_order_relaxed);
+	}
+
+	static void addTime(Phase phase, uint64_t nanoseconds)
+	{
+		_nanoseconds[(size_t) phase].fetch_add(nanoseconds,
+			std::memory_order_relaxed);
+	}
+
+	static void addBatch(size_t size)
+	{
+		size_t bucket = 0;
+		while (size > 1 && bucket + 1 < NUM_BATCH_SIZES)
+		{
+			size >>= 1;
+			bucket++;
+		}
+		_batchSizes[bucket].fetch_add(1, std::memory_order_relaxed);
+	}
+
+	// Adds what was counted elsewhere, such as in a worker process.
+	static void add(const Snapshot& snapshot);
+
+	static Snapshot snapshot();
+
+	static const char* name(Count count);
+	static const char* name(Phase phase);
+	// Such as "4-7", or "128+" for the last bucket.
+	static std::string batchSizeName(size_t bucket);
+};
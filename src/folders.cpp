@@ -0,0 +1,76 @@
+/**
+ * Part of Epicinium NeuralNewt
+ * developed by A Bunch of Hacks.
+ *
+ * Copyright (c) 2020 A Bunch of Hacks
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * [authors:]
+ * Daan Mulder (daan@abunchofhacks.coop)
+ */
+
+#include "folders.hpp"
+
+#ifdef _MSC_VER
+#include <direct.h>
+#include <windows.h>
+#else
+#include <sys/stat.h>
+#include <dirent.h>
+#endif
+
+
+bool pathExists(const std::string& path)
+{
+	struct stat buffer;
+	return stat(path.c_str(), &buffer) == 0;
+}
+
+bool makeFolder(const std::string& folder)
+{
+	if (pathExists(folder)) return false;
+	return mkdir(
+		folder.c_str()
+#ifdef __unix__
+		, S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH
+#endif
+	) == 0;
+}
+
+std::vector<std::string> listFolder(const std::string& folder)
+{
+	std::vector<std::string> entries;
+#ifdef _MSC_VER
+	WIN32_FIND_DATAA data;
+	HANDLE handle = FindFirstFileA((folder + "/*").c_str(), &data);
+	if (handle == INVALID_HANDLE_VALUE) return entries;
+	do
+	{
+		std::string name = data.cFileName;
+		if (name != "." && name != "..") entries.push_back(name);
+	}
+	while (FindNextFileA(handle, &data));
+	FindClose(handle);
+#else
+	DIR* dir = opendir(folder.c_str());
+	if (dir == nullptr) return entries;
+	while (struct dirent* entry = readdir(dir))
+	{
+		std::string name = entry->d_name;
+		if (name != "." && name != "..") entries.push_back(name);
+	}
+	closedir(dir);
+#endif
+	return entries;
+}
@@ -31,6 +31,10 @@
 #include <random>
 
 #include "setting.hpp"
+#include "counters.hpp"
+#include "profiler.hpp"
+#include "logger.hpp"
+#include "recordingwriter.hpp"
 #include "nnet/neuralnewtbrain.hpp"
 
 
@@ -87,6 +91,8 @@ void GameDirector<Ts...>::updateAIGame(const struct AIGame<T>& game,
 	size_t i = game.idx;
 	int score = game.first ? game.results.ai1score : game.results.ai2score;
 	round.aiScores[index<T, Ts...>::value][i] += score;
+	round.aiNames[index<T, Ts...>::value] =
+		game.first ? game.results.ai2name : game.results.ai1name;
 	round.totalScores[i] += score;
 	if (game.results.draw) round.draws[i]++;
 	else if ((game.first && game.results.ai1defeated)
@@ -97,16 +103,17 @@ void GameDirector<Ts...>::updateAIGame(const struct AIGame<T>& game,
 
 template <class ...Ts>
 GameDirector<Ts...>::GameDirector(
-		std::unordered_map<std::string, Setting>& settings,
+		const Settings& settings,
 		const std::string& rulesetname,
 		const std::vector<std::shared_ptr<NeuralNewtBrain>>& brains) :
 	_settings(settings),
 	_rulesetname(rulesetname),
 	_brains(brains)
 {
-	brainsPerPool = _settings["brains_per_pool"];
-	bDis = std::bernoulli_distribution(_settings["recording_chance"]);
-	uDis = std::uniform_int_distribution<size_t>(0, _settings["map_names"].size() - 1);
+	brainsPerPool = _settings.brainsPerPool;
+	bDis = std::bernoulli_distribution(_settings.recordingChance);
+	uDis = std::uniform_int_distribution<size_t>(0,
+		_settings.mapNames.size() - 1);
 }
 
 template <class ...Ts>
@@ -128,7 +135,9 @@ void GameDirector<Ts...>::turn(std::unique_ptr<Game>& game)
 			{
 				if (automaton->active())
 				{
+					Profiler::Scope scope("act");
 					ChangeSet cset = automaton->act();
+				if (game->recording) *game->recording << cset << "\n";
 					ai1->receiveChanges(cset.get(ai1->player()));
 					ai2->receiveChanges(cset.get(ai2->player()));
 				}
@@ -156,7 +165,9 @@ void GameDirector<Ts...>::turn(std::unique_ptr<Game>& game)
 					break;
 				}
 
+				Profiler::Scope scope("hibernate");
 				ChangeSet cset = automaton->hibernate();
+				if (game->recording) *game->recording << cset << "\n";
 				ai1->receiveChanges(cset.get(ai1->player()));
 				ai2->receiveChanges(cset.get(ai2->player()));
 				phase = Phase::PLANNING;
@@ -172,7 +183,9 @@ void GameDirector<Ts...>::turn(std::unique_ptr<Game>& game)
 					game->planning = true;
 					return;
 				}
+				Profiler::Scope scope("awake");
 				ChangeSet cset = automaton->awake();
+				if (game->recording) *game->recording << cset << "\n";
 				ai1->receiveChanges(cset.get(ai1->player()));
 				ai2->receiveChanges(cset.get(ai2->player()));
 				phase = Phase::STAGING;
@@ -182,15 +195,29 @@ void GameDirector<Ts...>::turn(std::unique_ptr<Game>& game)
 
 			case Phase::STAGING:
 			{
-				automaton->receive(ai1->player(), ai1->orders());
-				automaton->receive(ai2->player(), ai2->orders());
+				Profiler::Scope scope("staging");
+				auto orders1 = ai1->orders();
+				auto orders2 = ai2->orders();
+				if (game->recording)
+				{
+					auto& recording = *game->recording;
+					recording << ::stringify(ai1->player()) << ":";
+					for (const auto& order : orders1) recording << " " << order;
+					recording << "\n" << ::stringify(ai2->player()) << ":";
+					for (const auto& order : orders2) recording << " " << order;
+					recording << "\n";
+				}
+				automaton->receive(ai1->player(), orders1);
+				automaton->receive(ai2->player(), orders2);
 
 				ChangeSet cset = automaton->prepare();
+				if (game->recording) *game->recording << cset << "\n";
 				ai1->receiveChanges(cset.get(ai1->player()));
 				ai2->receiveChanges(cset.get(ai2->player()));
 
 				phase = Phase::ACTION;
 				game->turns++;
+				Counters::add(Counters::Count::TURNS);
 			}
 			break;
 
@@ -209,6 +236,49 @@ void GameDirector<Ts...>::turn(std::unique_ptr<Game>& game)
 	results.draw = draw;
 	results.turns = game->turns;
 	game->done = true;
+
+	GameLog::Record& record = game->record;
+	record.firstScore = results.ai1score;
+	record.secondScore = results.ai2score;
+	record.turns = results.turns;
+	typedef GameLog::Outcome Outcome;
+	if (draw) record.outcome = Outcome::DRAW;
+	else if (results.ai1defeated) record.outcome = Outcome::SECOND_WON;
+	else if (results.ai2defeated) record.outcome = Outcome::FIRST_WON;
+	else record.outcome = Outcome::UNDECIDED;
+	record.milliseconds =
+		std::chrono::duration_cast<std::chrono::milliseconds>(
+			std::chrono::steady_clock::now() - game->start).count();
+
+	finishRecording(*game);
+}
+
+// A recording is kept in memory while the game is played: a line with the
+// metadata as JSON, followed by a line for every change set and for the
+// orders of each player, in the order in which the automaton handled them.
+// The finished recording is written by a background thread.
+template <class ...Ts>
+void GameDirector<Ts...>::startRecording(Game& game, Json::Value& metadata,
+	const std::string& mapname)
+{
+	if (!bDis(gen)) return;
+	Profiler::Scope scope("startRecording");
+	Counters::add(Counters::Count::RECORDINGS);
+	metadata["map"] = mapname;
+	metadata["ruleset"] = _rulesetname;
+	Json::StreamWriterBuilder builder;
+	builder["indentation"] = "";
+	game.recording.reset(new std::ostringstream());
+	game.recordingName = RecordingWriter::newName();
+	*game.recording << Json::writeString(builder, metadata) << "\n";
+}
+
+template <class ...Ts>
+void GameDirector<Ts...>::finishRecording(Game& game)
+{
+	if (!game.recording) return;
+	RecordingWriter::write(game.recordingName, game.recording->str());
+	game.recording.reset();
 }
 
 template <class ...Ts>
@@ -238,6 +308,9 @@ std::shared_ptr<AICommander> GameDirector<Ts...>::makeNNCommander(
 template <class ...Ts>
 void GameDirector<Ts...>::setupPopGame(std::unique_ptr<PopGame>& game)
 {
+	Counters::Timer timer(Counters::Phase::SETUP);
+	Profiler::Scope scope("setupPopGame");
+	Counters::add(Counters::Count::STARTED_GAMES);
 	Json::Value metadata = Json::objectValue;
 	metadata["online"] = false;
 	metadata["planningtime"] = 0;
@@ -247,13 +320,18 @@ void GameDirector<Ts...>::setupPopGame(std::unique_ptr<PopGame>& game)
 	game->ai2 = makeNNCommander(_brains[game->idx2], 1, metadata["bots"]);
 	game->results.ai1name = _brains[game->idx1]->mediumName();
 	game->results.ai2name = _brains[game->idx2]->mediumName();
+	game->record.first = _brains[game->idx1]->id();
+	game->record.second = _brains[game->idx2]->id();
+	game->record.opponent = 0;
 
 	static std::vector<Player> players = getPlayers(2);
-	static std::vector<std::string> mapnames = _settings["map_names"];
-	std::string mapname = mapnames[uDis(gen)];
+	size_t map = uDis(gen);
+	std::string mapname = _settings.mapNames[map];
+	game->record.map = map;
+	game->start = std::chrono::steady_clock::now();
 	game->automaton.reset(new Automaton(players, _rulesetname));
 	game->automaton->load(mapname, false);
-	if (bDis(gen)) game->automaton->startRecording(metadata);
+	startRecording(*game, metadata, mapname);
 	game->phase = Phase::GROWTH;
 	game->turns = 0;
 }
@@ -285,6 +363,9 @@ template <class ...Ts>
 template <class T>
 void GameDirector<Ts...>::setupAIGame(std::unique_ptr<AIGame<T>>& game)
 {
+	Counters::Timer timer(Counters::Phase::SETUP);
+	Profiler::Scope scope("setupAIGame");
+	Counters::add(Counters::Count::STARTED_GAMES);
 	Json::Value metadata = Json::objectValue;
 	metadata["online"] = false;
 	metadata["planningtime"] = 0;
@@ -296,6 +377,8 @@ void GameDirector<Ts...>::setupAIGame(std::unique_ptr<AIGame<T>>& game)
 		game->ai2 = makeCommander<T>(1, metadata["bots"]);
 		game->results.ai1name = _brains[game->idx]->mediumName();
 		game->results.ai2name = game->ai2->ainame();
+		game->record.first = _brains[game->idx]->id();
+		game->record.second = GameLog::NONE;
 	}
 	else
 	{
@@ -303,14 +386,19 @@ void GameDirector<Ts...>::setupAIGame(std::unique_ptr<AIGame<T>>& game)
 		game->ai2 = makeNNCommander(_brains[game->idx], 1, metadata["bots"]);
 		game->results.ai1name = game->ai1->ainame();
 		game->results.ai2name = _brains[game->idx]->mediumName();
+		game->record.first = GameLog::NONE;
+		game->record.second = _brains[game->idx]->id();
 	}
+	game->record.opponent = 1 + index<T, Ts...>::value;
 
 	static std::vector<Player> players = getPlayers(2);
-	static std::vector<std::string> mapnames = _settings["map_names"];
-	std::string mapname = mapnames[uDis(gen)];
+	size_t map = uDis(gen);
+	std::string mapname = _settings.mapNames[map];
+	game->record.map = map;
+	game->start = std::chrono::steady_clock::now();
 	game->automaton.reset(new Automaton(players, _rulesetname));
 	game->automaton->load(mapname, false);
-	if (bDis(gen)) game->automaton->startRecording(metadata);
+	startRecording(*game, metadata, mapname);
 	game->phase = Phase::GROWTH;
 	game->turns = 0;
 }
@@ -358,16 +446,23 @@ typename GameDirector<Ts...>::RoundResults GameDirector<Ts...>::play()
 		for (auto gamePtr = _games.begin(); gamePtr != _games.end(); /**/)
 		{
 			auto& game = *gamePtr;
-			turn(game);
+			{
+				Counters::Timer timer(Counters::Phase::AUTOMATON);
+				turn(game);
+			}
 			if (game->done)
 			{
+				Counters::add(Counters::Count::GAMES);
 				const GameResults& gameResults = game->results;
 				game->update(results);
-				if (_settings["verbose"]) std::cout << gameResults;
+				results.games.push_back(game->record);
+				if (_settings.verbose) Logger::write(gameResults);
 				gamePtr = _games.erase(gamePtr);
 			}
 			else
 			{
+				Counters::Timer timer(Counters::Phase::AI);
+				Profiler::Scope scope("preprocess");
 				game->ai1finished = false;
 				game->ai2finished = false;
 				game->ai1->preprocess();
@@ -377,24 +472,29 @@ typename GameDirector<Ts...>::RoundResults GameDirector<Ts...>::play()
 		}
 		if (_games.empty()) break;
 
+		Counters::Timer timer(Counters::Phase::AI);
 		bool allFinished = false;
 		while (!allFinished)
 		{
 			allFinished = true;
-			for (auto& game : _games)
 			{
-				if (!game->ai1finished)
-				{
-					game->ai1->process();
-					allFinished = false;
-				}
-				if (!game->ai2finished)
+				Profiler::Scope scope("process");
+				for (auto& game : _games)
 				{
-					game->ai2->process();
-					allFinished = false;
+					if (!game->ai1finished)
+					{
+						game->ai1->process();
+						allFinished = false;
+					}
+					if (!game->ai2finished)
+					{
+						game->ai2->process();
+						allFinished = false;
+					}
 				}
 			}
 
+			Profiler::Scope scope("postprocess");
 			for (auto& game : _games)
 			{
 				auto& ai1finished = game->ai1finished;
@@ -25,11 +25,16 @@
 #include <unordered_map>
 #include <vector>
 #include <memory>
+#include <array>
+#include <chrono>
+#include <sstream>
 
 #include "libs/aftermath/automaton.hpp"
 #include "libs/jsoncpp/json-forwards.h"
 
-class Setting;
+#include "gamelog.hpp"
+
+struct Settings;
 class NeuralNewtBrain;
 class AICommander;
 
@@ -65,7 +70,7 @@ private:
 		os << (results.draw ? "Drawn in " : "Decided in ") << results.turns
 			<< " turns: " << results.ai1name << " (" << results.ai1score << ")"
 			<< ", " << results.ai2name << " (" << results.ai2score << ")"
-			<< std::endl;
+			<< "\n";
 		return os;
 	}
 public:
@@ -78,6 +83,31 @@ public:
 		std::vector<int> wins;
 		std::vector<int> draws;
 		std::vector<int> losses;
+		// Every game in the order in which they finished.
+		std::vector<GameLog::Record> games;
+		std::array<std::string, sizeof...(Ts)> aiNames;
+
+		// Adds the results of games played elsewhere by the same brains.
+		void merge(const RoundResults& other)
+		{
+			for (size_t i = 0; i < names.size(); i++)
+			{
+				popScores[i] += other.popScores[i];
+				for (size_t j = 0; j < aiScores.size(); j++)
+				{
+					aiScores[j][i] += other.aiScores[j][i];
+				}
+				totalScores[i] += other.totalScores[i];
+				wins[i] += other.wins[i];
+				draws[i] += other.draws[i];
+				losses[i] += other.losses[i];
+			}
+			games.insert(games.end(), other.games.begin(), other.games.end());
+			for (size_t j = 0; j < aiNames.size(); j++)
+			{
+				if (aiNames[j].empty()) aiNames[j] = other.aiNames[j];
+			}
+		}
 	};
 	friend std::ostream& operator<<(std::ostream& os,
 		const struct GameDirector::RoundResults& results)
@@ -155,6 +185,11 @@ private:
 		bool ai2finished = false;
 		bool done = false;
 		GameResults results;
+		GameLog::Record record;
+		std::chrono::steady_clock::time_point start;
+		// Only set for games that are recorded.
+		std::unique_ptr<std::ostringstream> recording;
+		std::string recordingName;
 		virtual void update(RoundResults& round) const = 0;
 	};
 	struct PopGame : public Game
@@ -174,13 +209,13 @@ private:
 
 	static size_t brainsPerPool;
 
-	std::unordered_map<std::string, Setting>& _settings;
+	const Settings& _settings;
 	std::string _rulesetname;
 	const std::vector<std::shared_ptr<NeuralNewtBrain>>& _brains;
 	std::vector<std::unique_ptr<Game>> _games;
 
 public:
-	GameDirector(std::unordered_map<std::string, Setting>& settings,
+	GameDirector(const Settings& settings,
 		const std::string& rulesetname,
 		const std::vector<std::shared_ptr<NeuralNewtBrain>>& brains);
 
@@ -190,6 +225,9 @@ private:
 		RoundResults& round);
 
 	void turn(std::unique_ptr<Game>& game);
+	void startRecording(Game& game, Json::Value& metadata,
+		const std::string& mapname);
+	void finishRecording(Game& game);
 	std::shared_ptr<AICommander> makeNNCommander(
 		const std::shared_ptr<NeuralNewtBrain>& brain, size_t i,
 		Json::Value& metadata);
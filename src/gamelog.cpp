@@ -0,0 +1,206 @@
+/**
+ * Part of Epicinium NeuralNewt
+ * developed by A Bunch of Hacks.
+ *
+ * Copyright (c) 2020 A Bunch of Hacks
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * [authors:]
+ * Daan Mulder (daan@abunchofhacks.coop)
+ */
+
+
+#include "gamelog.hpp"
+
+#include <cstring>
+#include <stdexcept>
+
+#include "mappedfile.hpp"
+#include "atomicfile.hpp"
+
+
+static const char LOG_MAGIC[8] = {'N', 'N', 'G', 'A', 'M', 'E', 'S', '\0'};
+static const uint32_t LOG_VERSION = 1;
+static const size_t ALIGNMENT = 8;
+
+// The width in bytes of each column, in the order of the fields of Record.
+static const size_t WIDTHS[] = {4, 4, 4, 4, 4, 2, 2, 1, 1};
+static const size_t NUM_COLUMNS = sizeof(WIDTHS) / sizeof(WIDTHS[0]);
+
+static size_t columnOffset(size_t column, size_t numGames)
+{
+	size_t offset = 0;
+	for (size_t c = 0; c < column; c++)
+	{
+		offset += WIDTHS[c] * numGames;
+	}
+	return offset;
+}
+
+template <typename T, typename F>
+static void writeColumn(AtomicFile& file,
+	const std::vector<GameLog::Record>& games, F field)
+{
+	std::vector<T> values;
+	values.reserve(games.size());
+	for (const auto& game : games)
+	{
+		values.push_back(field(game));
+	}
+	file.write(values.data(), values.size() * sizeof(T));
+}
+
+void GameLog::save(const std::string& filepath, uint64_t session,
+	uint32_t round, const std::vector<std::string>& mapNames,
+	const std::vector<std::string>& opponentNames,
+	const std::vector<uint32_t>& brainIds,
+	const std::vector<std::string>& brainNames,
+	const std::vector<Record>& games)
+{
+	if (brainIds.size() != brainNames.size())
+	{
+		throw std::runtime_error("Number of brain names does not match number"
+			" of brains while writing " + filepath);
+	}
+	std::string names;
+	for (const auto& name : mapNames) names += name + '\0';
+	for (const auto& name : opponentNames) names += name + '\0';
+	for (const auto& name : brainNames) names += name + '\0';
+	size_t idsSize = brainIds.size() * sizeof(uint32_t);
+
+	Header header;
+	std::memset(&header, 0, sizeof(Header));
+	std::memcpy(header.magic, LOG_MAGIC, sizeof(LOG_MAGIC));
+	header.version = LOG_VERSION;
+	header.round = round;
+	header.session = session;
+	header.numGames = games.size();
+	header.numMaps = mapNames.size();
+	header.numOpponents = opponentNames.size();
+	header.numBrains = brainIds.size();
+	size_t position = sizeof(Header) + idsSize + names.size();
+	header.dataOffset = (position + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+
+	AtomicFile file(filepath);
+	static const char zeroes[ALIGNMENT] = {0};
+	file.write(&header, sizeof(Header));
+	file.write(brainIds.data(), idsSize);
+	file.write(names);
+	file.write(zeroes, header.dataOffset - position);
+
+	typedef const Record& R;
+	writeColumn<uint32_t>(file, games, [](R r) { return r.first; });
+	writeColumn<uint32_t>(file, games, [](R r) { return r.second; });
+	writeColumn<int32_t>(file, games, [](R r) { return r.firstScore; });
+	writeColumn<int32_t>(file, games, [](R r) { return r.secondScore; });
+	writeColumn<uint32_t>(file, games, [](R r) { return r.milliseconds; });
+	writeColumn<uint16_t>(file, games, [](R r) { return r.map; });
+	writeColumn<uint16_t>(file, games, [](R r) { return r.turns; });
+	writeColumn<uint8_t>(file, games, [](R r) { return r.opponent; });
+	writeColumn<Outcome>(file, games, [](R r) { return r.outcome; });
+
+	file.commit();
+}
+
+GameLog::GameLog(const std::string& filepath) :
+	_file(std::make_shared<MappedFile>(filepath))
+{
+	const char* data = _file->data();
+	size_t size = _file->size();
+	if (size < sizeof(Header)
+		|| std::memcmp(data, LOG_MAGIC, sizeof(LOG_MAGIC)) != 0)
+	{
+		throw std::runtime_error("File " + filepath + " is not a game log");
+	}
+	_header = (const Header*) data;
+	if (_header->version != LOG_VERSION)
+	{
+		throw std::runtime_error("Game log " + filepath + " has unsupported"
+			" version " + std::to_string(_header->version));
+	}
+	uint64_t idsEnd = sizeof(Header)
+		+ uint64_t(_header->numBrains) * sizeof(uint32_t);
+	if (_header->dataOffset % ALIGNMENT != 0
+		|| _header->dataOffset > size
+		|| idsEnd > _header->dataOffset
+		|| _header->numGames > (size - _header->dataOffset)
+		|| _header->dataOffset
+			+ columnOffset(NUM_COLUMNS, _header->numGames) > size)
+	{
+		throw std::runtime_error("Game log " + filepath + " is truncated");
+	}
+
+	_brainIds = (const uint32_t*) (data + sizeof(Header));
+	const char* name = data + idsEnd;
+	const char* end = data + _header->dataOffset;
+	size_t numNames = uint64_t(_header->numMaps) + _header->numOpponents
+		+ _header->numBrains;
+	for (size_t i = 0; i < numNames; i++)
+	{
+		size_t length = strnlen(name, end - name);
+		if (name + length == end)
+		{
+			throw std::runtime_error("Game log " + filepath + " has invalid"
+				" names");
+		}
+		_names.emplace_back(name, length);
+		name += length + 1;
+	}
+}
+
+std::string GameLog::opponentName(size_t o) const
+{
+	if (o == 0) return "NeuralNewt";
+	return _names[_header->numMaps + o - 1];
+}
+
+const char* GameLog::column(size_t c) const
+{
+	return _file->data() + _header->dataOffset
+		+ columnOffset(c, _header->numGames);
+}
+
+const uint32_t* GameLog::first() const
+	{ return (const uint32_t*) column(0); }
+const uint32_t* GameLog::second() const
+	{ return (const uint32_t*) column(1); }
+const int32_t* GameLog::firstScore() const
+	{ return (const int32_t*) column(2); }
+const int32_t* GameLog::secondScore() const
+	{ return (const int32_t*) column(3); }
+const uint32_t* GameLog::milliseconds() const
+	{ return (const uint32_t*) column(4); }
+const uint16_t* GameLog::map() const
+	{ return (const uint16_t*) column(5); }
+const uint16_t* GameLog::turns() const
+	{ return (const uint16_t*) column(6); }
+const uint8_t* GameLog::opponent() const
+	{ return (const uint8_t*) column(7); }
+const GameLog::Outcome* GameLog::outcome() const
+	{ return (const Outcome*) column(8); }
+
+GameLog::Record GameLog::get(size_t i) const
+{
+	Record record;
+	record.first = first()[i];
+	record.second = second()[i];
+	record.firstScore = firstScore()[i];
+	record.secondScore = secondScore()[i];
+	record.milliseconds = milliseconds()[i];
+	record.map = map()[i];
+	record.turns = turns()[i];
+	record.opponent = opponent()[i];
+	record.outcome = outcome()[i];
+	return record;
+}
@@ -0,0 +1,137 @@
+/**
+ * Part of Epicinium NeuralNewt
+ * developed by A Bunch of Hacks.
+ *
+ * Copyright (c) 2020 A Bunch of Hacks
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * [authors:]
+ * Daan Mulder (daan@abunchofhacks.coop)
+ */
+
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstdint>
+
+class MappedFile;
+
+
+// The games of a round, stored column by column so that a statistic over
+// millions of games only has to read the columns it needs:
+//
+//   Header
+//   the lineage ids of the numBrains brains that played
+//   numMaps + numOpponents + numBrains names, each terminated by a NUL
+//   (padding)
+//   one column of numGames values for each field of Record, starting at
+//   dataOffset, in the order of the fields of Record
+//
+// The columns are ordered from wide to narrow, so each of them is aligned.
+class GameLog
+{
+public:
+	static const uint32_t NONE = uint32_t(-1);
+
+	enum class Outcome : uint8_t
+	{
+		DRAW,
+		FIRST_WON,
+		SECOND_WON,
+		UNDECIDED,
+	};
+
+	struct Record
+	{
+		// The lineage ids of the brains playing first and second, or NONE for
+		// a baseline AI.
+		uint32_t first;
+		uint32_t second;
+		int32_t firstScore;
+		int32_t secondScore;
+		// The wall time from setting up the game until it was done, which
+		// includes the time spent on other games that were played alongside.
+		uint32_t milliseconds;
+		uint16_t map;
+		uint16_t turns;
+		// 0 for a game between two brains, otherwise 1 plus the index of the
+		// baseline AI that was played against.
+		uint8_t opponent;
+		Outcome outcome;
+	};
+
+	struct Header
+	{
+		char magic[8];
+		uint32_t version;
+		uint32_t round;
+		uint64_t session;
+		uint64_t numGames;
+		uint32_t numMaps;
+		uint32_t numOpponents;
+		uint32_t numBrains;
+		uint32_t reserved;
+		uint64_t dataOffset;
+	};
+
+	// The opponent names are those of the baseline AIs, in order. Because
+	// lineage ids are only unique within a single run, the short name of
+	// every brain is stored as well.
+	static void save(const std::string& filepath, uint64_t session,
+		uint32_t round, const std::vector<std::string>& mapNames,
+		const std::vector<std::string>& opponentNames,
+		const std::vector<uint32_t>& brainIds,
+		const std::vector<std::string>& brainNames,
+		const std::vector<Record>& games);
+
+private:
+	std::shared_ptr<MappedFile> _file;
+	const Header* _header;
+	const uint32_t* _brainIds;
+	std::vector<std::string> _names;
+
+	const char* column(size_t offset) const;
+
+public:
+	explicit GameLog(const std::string& filepath);
+
+	size_t size() const { return _header->numGames; }
+	uint64_t session() const { return _header->session; }
+	uint32_t round() const { return _header->round; }
+
+	size_t numMaps() const { return _header->numMaps; }
+	const std::string& mapName(size_t m) const { return _names[m]; }
+	// Opponent 0 is "NeuralNewt".
+	size_t numOpponents() const { return _header->numOpponents + 1; }
+	std::string opponentName(size_t o) const;
+	size_t numBrains() const { return _header->numBrains; }
+	uint32_t brainId(size_t b) const { return _brainIds[b]; }
+	const std::string& brainName(size_t b) const
+		{ return _names[numMaps() + _header->numOpponents + b]; }
+
+	const uint32_t* first() const;
+	const uint32_t* second() const;
+	const int32_t* firstScore() const;
+	const int32_t* secondScore() const;
+	const uint32_t* milliseconds() const;
+	const uint16_t* map() const;
+	const uint16_t* turns() const;
+	const uint8_t* opponent() const;
+	const Outcome* outcome() const;
+
+	Record get(size_t i) const;
+};
@@ -0,0 +1,202 @@
+/**
+ * Part of Epicinium NeuralNewt
+ * developed by A Bunch of Hacks.
+ *
+ * Copyright (c) 2020 A Bunch of Hacks
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * [authors:]
+ * Daan Mulder (daan@abunchofhacks.coop)
+ */
+
+
+#include "islands.hpp"
+
+#include <torch/torch.h>
+#include <iostream>
+#include <algorithm>
+#include <stdexcept>
+#include <cstdlib>
+#include <cstdio>
+#ifndef _WIN32
+#include <unistd.h>
+#include <signal.h>
+#include <sys/wait.h>
+#endif
+#ifdef __linux__
+#include <sys/prctl.h>
+#endif
+
+#include "setting.hpp"
+#include "folders.hpp"
+#include "affinity.hpp"
+#include "logger.hpp"
+#include "brainname.hpp"
+#include "newtbraintrainer.hpp"
+#include "nnet/neuralnewtbrain.hpp"
+#include "nnet/brainpack.hpp"
+
+
+Island::Island(size_t index, size_t count, std::time_t startTime,
+		const std::string& folder) :
+	_index(index),
+	_count(count),
+	_startTime(startTime),
+	_folder(folder),
+	_lastImport(0)
+{}
+
+static std::string packName(size_t island, size_t round)
+{
+	return "island" + std::to_string(island) + "-round"
+		+ std::to_string(round) + ".pack";
+}
+
+void Island::migrate(const Settings& settings, size_t round,
+	std::vector<std::shared_ptr<NeuralNewtBrain>>& brains, size_t keep)
+{
+	size_t size = std::min(settings.migrationSize, keep);
+	if (size == 0 || _count < 2) return;
+
+	std::vector<std::shared_ptr<NeuralNewtBrain>> best(brains.begin(),
+		brains.begin() + size);
+	// Round numbers start at 1, so that 0 means nothing was imported yet.
+	NeuralNewtBrain::savePack(_folder, packName(_index, round + 1), best);
+
+	// Islands do not wait for each other: whatever the previous island wrote
+	// most recently is taken in, if it has not been taken in before.
+	size_t from = (_index + _count - 1) % _count;
+	size_t newest = _lastImport;
+	std::string prefix = "island" + std::to_string(from) + "-round";
+	for (const std::string& entry : listFolder(_folder))
+	{
+		if (entry.compare(0, prefix.size(), prefix) != 0) continue;
+		size_t r = std::strtoul(entry.c_str() + prefix.size(), nullptr, 10);
+		if (r > newest && entry == packName(from, r)) newest = r;
+	}
+	if (newest == _lastImport) return;
+	_lastImport = newest;
+
+	BrainPack pack(_folder + "/" + packName(from, newest));
+	size_t count = std::min(size, pack.size());
+	for (size_t i = 0; i < count; i++)
+	{
+		auto& brain = brains[keep - count + i];
+		brain = std::make_shared<NeuralNewtBrain>(settings,
+			std::make_shared<RestoredBrainName>(pack.name(i), round));
+		brain->restore(pack, i);
+	}
+	Logger::write("island " + std::to_string(_index) + " took in "
+		+ std::to_string(count) + " brains of island " + std::to_string(from)
+		+ " from round " + std::to_string(newest - 1) + "\n");
+
+	// The next island only ever takes in the newest pack of this island, so
+	// the older ones can go now that the exchange has gone through.
+	std::string own = "island" + std::to_string(_index) + "-round";
+	for (const std::string& entry : listFolder(_folder))
+	{
+		if (entry.compare(0, own.size(), own) != 0) continue;
+		size_t r = std::strtoul(entry.c_str() + own.size(), nullptr, 10);
+		if (r < round + 1 && entry == packName(_index, r))
+		{
+			std::remove((_folder + "/" + entry).c_str());
+		}
+	}
+}
+
+void runIslands(const Settings& settings, const std::string& rulesetname)
+{
+#ifdef _WIN32
+	(void) settings;
+	(void) rulesetname;
+	throw std::runtime_error("Islands are not supported on Windows");
+#else
+	std::time_t startTime = std::time(nullptr);
+	std::string folder = "brains/" + std::to_string(startTime)
+		+ "-migration";
+	makeFolder("brains");
+	makeFolder(folder);
+
+	size_t count = settings.numPools;
+	std::vector<Placement> placements;
+	if (settings.affinity)
+	{
+		placements = planPlacements(currentTopology(), count);
+		for (size_t i = 0; i < count; i++)
+		{
+			std::cout << "Island " << i << " is placed on "
+				<< describePlacement(placements[i]) << std::endl;
+		}
+	}
+	std::vector<pid_t> children;
+	std::cout.flush();
+	std::cerr.flush();
+	for (size_t i = 0; i < count; i++)
+	{
+		pid_t pid = fork();
+		if (pid < 0) throw std::runtime_error("Cannot fork island");
+		if (pid > 0)
+		{
+			children.push_back(pid);
+			continue;
+		}
+
+#ifdef __linux__
+		// An island should not outlive the process that started it.
+		prctl(PR_SET_PDEATHSIG, SIGTERM);
+#endif
+		// Local workers of the island divide its cores among themselves.
+		if (settings.affinity) pinPlacement(placements[i]);
+		// Otherwise every island would start with the same brains.
+		torch::manual_seed(startTime + i);
+		srand(startTime + i);
+
+		Settings islandSettings = settings;
+		islandSettings.numPools = 1;
+		if (settings.metricsPort > 0) islandSettings.metricsPort += i;
+		int status = 0;
+		try
+		{
+			NewtBrainTrainer trainer(islandSettings, rulesetname,
+				std::unique_ptr<Island>(new Island(i, count, startTime,
+					folder)));
+			trainer.train();
+		}
+		catch (const std::exception& e)
+		{
+			std::cerr << "ERROR: island " << i << ": " << e.what()
+				<< std::endl;
+			status = 1;
+		}
+		std::cout.flush();
+		std::cerr.flush();
+		_exit(status);
+	}
+	std::cout << "Started " << count << " islands, exchanging brains"
+		" through " << folder << std::endl;
+
+	size_t failed = 0;
+	for (pid_t pid : children)
+	{
+		int status = 0;
+		waitpid(pid, &status, 0);
+		if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) failed++;
+	}
+	if (failed > 0)
+	{
+		throw std::runtime_error(std::to_string(failed) + " of "
+			+ std::to_string(count) + " islands failed");
+	}
+#endif
+}
@@ -0,0 +1,63 @@
+/**
+ * Part of Epicinium NeuralNewt
+ * developed by A Bunch of Hacks.
+ *
+ * Copyright (c) 2020 A Bunch of Hacks
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * [authors:]
+ * Daan Mulder (daan@abunchofhacks.coop)
+ */
+
+
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <string>
+#include <ctime>
+
+struct Settings;
+class NeuralNewtBrain;
+
+
+// One of several trainers that each evolve a single pool in a separate
+// process, with a tournament of its own. Every so many rounds, each island
+// writes its best brains to a shared folder and takes in the newest best
+// brains of the previous island, so that good brains travel around the ring.
+class Island
+{
+private:
+	size_t _index;
+	size_t _count;
+	std::time_t _startTime;
+	std::string _folder;
+	size_t _lastImport;
+
+public:
+	Island(size_t index, size_t count, std::time_t startTime,
+		const std::string& folder);
+
+	size_t index() const { return _index; }
+	std::time_t startTime() const { return _startTime; }
+
+	// Expects the brains to be sorted best first. The immigrants replace the
+	// worst brains that survive evolution, those right before keep, so that
+	// they take part in the next tournament.
+	void migrate(const Settings& settings, size_t round,
+		std::vector<std::shared_ptr<NeuralNewtBrain>>& brains, size_t keep);
+};
+
+// Forks an island for each pool and waits until all of them are done.
+void runIslands(const Settings& settings, const std::string& rulesetname);
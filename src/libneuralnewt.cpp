@@ -26,11 +26,15 @@
 #include "libs/aftermath/player.hpp"
 #include "libs/aftermath/difficulty.hpp"
 
-#include <torch/torch.h>
+#include <chrono>
+#include <algorithm>
 
 #include "setting.hpp"
-#include "nnet/module.hpp"
+#include "nnet/network.hpp"
 #include "nnet/neuralnewtbrain.hpp"
+#include "nnet/brainregistry.hpp"
+#include "nnet/inferencebroker.hpp"
+#include "nnet/servedbrain.hpp"
 
 #ifdef _MSC_VER
 #define EXPORT __declspec(dllexport)
@@ -39,12 +43,40 @@
 #endif
 
 
-static std::unordered_map<std::string, Setting> _settings = {
-	{"timing", false},
-	{"cuda", false},
-	{"num_channels", 48}
-};
-static std::shared_ptr<Module> _module;
+static Settings makeSettings()
+{
+	Settings settings;
+	settings.timing = false;
+	settings.cuda = false;
+	settings.numChannels = 48;
+	settings.brainMemoryBudget = 512;
+	return settings;
+}
+
+static Settings _settings = makeSettings();
+static std::unique_ptr<BrainRegistry> _registry;
+static std::unique_ptr<InferenceBroker> _broker;
+static float _setupTime = -1.0f;
+static float _warmupTime = -1.0f;
+
+static float millisecondsSince(std::chrono::steady_clock::time_point start)
+{
+	auto end = std::chrono::steady_clock::now();
+	return std::chrono::duration_cast<std::chrono::microseconds>(end - start)
+		.count() / 1000.0f;
+}
+
+// Runs synthetic batches of the smallest and the largest size, so that the
+// first real decision does not pay for allocating buffers and selecting
+// kernels.
+static void warmUp(const Network& network)
+{
+	size_t count = _settings.maxBatchSize;
+	std::vector<int8_t> input(count * NeuralNewtBrain::INPUT_SIZE, 0);
+	std::vector<float> output(count * NewtBrain::Output::SIZE);
+	network.evaluate(input.data(), 1, output.data());
+	network.evaluate(input.data(), count, output.data());
+}
 
 extern "C"
 {
@@ -53,15 +85,35 @@ extern "C"
 		const char* player, const char* difficulty,
 		const char* rulesetname, char character);
 	EXPORT void deallocate(AINeuralNewt* ptr);
+	EXPORT size_t input_size();
+	EXPORT size_t output_size();
+	EXPORT void evaluate_many(const int8_t* input, size_t count,
+		float* output);
+	EXPORT void startup_stats(float* setupTime, float* warmupTime,
+		float* firstDecisionTime);
+	EXPORT bool swap_brain(const char* difficulty, const char* rulesetname,
+		const char* filepath);
+	EXPORT void set_batching(size_t maxBatchSize, size_t maxBatchWait);
+	EXPORT void set_decision_deadline(size_t milliseconds);
+	EXPORT void deadline_stats(uint64_t* turns, uint64_t* fallbacks,
+		uint64_t* late);
 
 	void setup(int argc, const char* const argv[])
 	{
+		auto start = std::chrono::steady_clock::now();
 		AILibrary::setup("libneuralnewt", argc, argv);
-		_module = std::make_shared<Module>(_settings);
-		auto name = std::make_shared<RestoredBrainName>("default", 0);
-		auto brain = std::make_shared<NeuralNewtBrain>(_module, _settings,
-			name);
-		brain->load("ai", "default.brain");
+		_registry.reset(new BrainRegistry(_settings, "ai",
+			_settings.brainMemoryBudget * 1024 * 1024));
+		// Other brains are loaded when they are first needed, but the default
+		// brain is loaded and warmed up right away.
+		std::shared_ptr<const Network> network = _registry->get("", "");
+		_broker.reset(new InferenceBroker(_settings.maxBatchSize,
+			_settings.maxBatchWait));
+
+		auto warmupStart = std::chrono::steady_clock::now();
+		warmUp(*network);
+		_warmupTime = millisecondsSince(warmupStart);
+		_setupTime = millisecondsSince(start);
 	}
 
 	AINeuralNewt* allocate(
@@ -72,9 +124,8 @@ extern "C"
 		//LOGD << "Allocating " << difficulty << " " << player << ""
 		//	" AINeuralNewt named '" << character << "'"
 		//	" with ruleset " << rulesetname;
-		auto name = std::make_shared<RestoredBrainName>("default", 0);
-		auto brain = std::make_shared<NeuralNewtBrain>(_module, _settings,
-			name);
+		auto brain = std::make_shared<ServedBrain>(
+			_registry->get(difficulty, rulesetname), *_broker);
 		return new AINeuralNewt(parsePlayer(player),
 			parseDifficulty(difficulty), rulesetname, character, brain);
 	}
@@ -83,4 +134,87 @@ extern "C"
 	{
 		delete ptr;
 	}
+
+	size_t input_size()
+	{
+		return NeuralNewtBrain::INPUT_SIZE;
+	}
+
+	size_t output_size()
+	{
+		return NewtBrain::Output::SIZE;
+	}
+
+	// Evaluates count board states encoded as by NeuralNewtBrain::encode, each
+	// of input_size() bytes, with the default brain and writes
+	// count * output_size() floats. Calls from different threads are batched
+	// together with the allocated AIs.
+	void evaluate_many(const int8_t* input, size_t count, float* output)
+	{
+		std::shared_ptr<const Network> network = _registry->get("", "");
+		_broker->addRequester();
+		try
+		{
+			_broker->evaluate(*network, input, count, output);
+		}
+		catch (...)
+		{
+			_broker->removeRequester();
+			throw;
+		}
+		_broker->removeRequester();
+	}
+
+	// Reports in milliseconds how long setup() took, how much of that was
+	// spent warming up, and how long the first decision after setup took.
+	// Values that have not been measured yet are negative.
+	void startup_stats(float* setupTime, float* warmupTime,
+		float* firstDecisionTime)
+	{
+		*setupTime = _setupTime;
+		*warmupTime = _warmupTime;
+		*firstDecisionTime = _broker ? _broker->firstLatency() : -1.0f;
+	}
+
+	// Replaces the brain used by newly allocated AIs with the given
+	// difficulty and ruleset (or any ruleset, if rulesetname is empty)
+	// without restarting. Returns false if the brain could not be loaded.
+	bool swap_brain(const char* difficulty, const char* rulesetname,
+		const char* filepath)
+	{
+		try
+		{
+			_registry->swap(difficulty, rulesetname, filepath);
+			return true;
+		}
+		catch (const std::exception&)
+		{
+			return false;
+		}
+	}
+
+	// Sets how many board states are evaluated in one batch at most, and how
+	// many microseconds the first request of a batch waits for more to
+	// arrive (64 and 1000 by default). Called before setup(), this also
+	// determines the batch size used for warming up.
+	void set_batching(size_t maxBatchSize, size_t maxBatchWait)
+	{
+		_settings.maxBatchSize = std::max(maxBatchSize, size_t(1));
+		_settings.maxBatchWait = maxBatchWait;
+		if (_broker) _broker->configure(maxBatchSize, maxBatchWait);
+	}
+
+	// Sets how many milliseconds an AI may take to evaluate its turn before
+	// it falls back to the output of its previous turn. 0 disables this.
+	void set_decision_deadline(size_t milliseconds)
+	{
+		ServedBrain::setDeadline(milliseconds);
+	}
+
+	void deadline_stats(uint64_t* turns, uint64_t* fallbacks, uint64_t* late)
+	{
+		*turns = ServedBrain::turns();
+		*fallbacks = ServedBrain::fallbacks();
+		*late = ServedBrain::late();
+	}
 }
@@ -0,0 +1,200 @@
+/**
+ * Part of Epicinium NeuralNewt
+ * developed by A Bunch of Hacks.
+ *
+ * Copyright (c) 2020 A Bunch of Hacks
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * [authors:]
+ * Daan Mulder (daan@abunchofhacks.coop)
+ */
+
+
+#include "logger.hpp"
+
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <fstream>
+#include <iostream>
+#include <cstdio>
+#include <stdexcept>
+
+#include "folders.hpp"
+
+
+// Threads hand over their text once it exceeds this size.
+static const size_t CHUNK_SIZE = 16 * 1024;
+
+namespace
+{
+	struct Chunk
+	{
+		std::string text;
+		Chunk* next;
+	};
+
+	struct ThreadBuffer
+	{
+		std::string text;
+
+		~ThreadBuffer();
+	};
+}
+
+static std::atomic<bool> _running(false);
+// A lock-free stack of chunks that have been handed over, newest first.
+static std::atomic<Chunk*> _pending(nullptr);
+static std::thread _thread;
+static std::mutex _mutex;
+static std::condition_variable _stopped;
+static bool _stopping = false;
+
+static std::string _folder;
+static std::string _name;
+static size_t _maxFileBytes = 0;
+static size_t _maxOldFiles = 0;
+static std::ofstream _file;
+static size_t _fileBytes = 0;
+
+static thread_local ThreadBuffer _buffer;
+
+static void handOver(std::string& text)
+{
+	if (text.empty()) return;
+	Chunk* chunk = new Chunk{std::move(text), nullptr};
+	text.clear();
+	text.reserve(CHUNK_SIZE);
+	chunk->next = _pending.load(std::memory_order_relaxed);
+	while (!_pending.compare_exchange_weak(chunk->next, chunk,
+		std::memory_order_release, std::memory_order_relaxed))
+	{}
+}
+
+ThreadBuffer::~ThreadBuffer()
+{
+	if (_running) handOver(text);
+}
+
+static std::string filename(size_t i)
+{
+	if (i == 0) return _folder + "/" + _name + ".log";
+	return _folder + "/" + _name + "." + std::to_string(i) + ".log";
+}
+
+static void rotate()
+{
+	_file.close();
+	std::remove(filename(_maxOldFiles).c_str());
+	for (size_t i = _maxOldFiles; i > 0; i--)
+	{
+		std::rename(filename(i - 1).c_str(), filename(i).c_str());
+	}
+	_file.open(filename(0), std::ios::trunc);
+	_fileBytes = 0;
+}
+
+// Writes the chunks in the order in which they were handed over.
+static void writePending()
+{
+	Chunk* chunk = _pending.exchange(nullptr, std::memory_order_acquire);
+	Chunk* reversed = nullptr;
+	while (chunk != nullptr)
+	{
+		Chunk* next = chunk->next;
+		chunk->next = reversed;
+		reversed = chunk;
+		chunk = next;
+	}
+	while (reversed != nullptr)
+	{
+		if (_fileBytes >= _maxFileBytes) rotate();
+		_file << reversed->text;
+		_fileBytes += reversed->text.size();
+		Chunk* next = reversed->next;
+		delete reversed;
+		reversed = next;
+	}
+	_file.flush();
+}
+
+static void run()
+{
+	std::unique_lock<std::mutex> lock(_mutex);
+	while (!_stopping)
+	{
+		_stopped.wait_for(lock, std::chrono::milliseconds(500));
+		writePending();
+	}
+}
+
+void Logger::start(const std::string& folder, const std::string& name,
+	size_t maxFileBytes, size_t maxOldFiles)
+{
+	if (_running) throw std::runtime_error("Logger already started");
+
+	makeFolder(folder);
+	_folder = folder;
+	_name = name;
+	_maxFileBytes = maxFileBytes;
+	_maxOldFiles = maxOldFiles;
+	_file.open(filename(0), std::ios::app);
+	if (!_file.is_open())
+	{
+		throw std::runtime_error("Cannot open log file " + filename(0));
+	}
+	_file.seekp(0, std::ios::end);
+	_fileBytes = _file.tellp();
+
+	_stopping = false;
+	_running = true;
+	_thread = std::thread(run);
+}
+
+void Logger::stop()
+{
+	if (!_running) return;
+	handOver(_buffer.text);
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_stopping = true;
+	}
+	_stopped.notify_all();
+	_thread.join();
+	_running = false;
+	writePending();
+	_file.close();
+}
+
+void Logger::write(const std::string& text)
+{
+	if (!_running)
+	{
+		std::cout << text;
+		return;
+	}
+	_buffer.text += text;
+	if (_buffer.text.size() >= CHUNK_SIZE) handOver(_buffer.text);
+}
+
+void Logger::flush()
+{
+	if (!_running)
+	{
+		std::cout.flush();
+		return;
+	}
+	handOver(_buffer.text);
+}
@@ -0,0 +1,66 @@
+/**
+ * Part of Epicinium NeuralNewt
+ * developed by A Bunch of Hacks.
+ *
+ * Copyright (c) 2020 A Bunch of Hacks
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * [authors:]
+ * Daan Mulder (daan@abunchofhacks.coop)
+ */
+
+
+#pragma once
+
+#include <string>
+#include <sstream>
+
+
+// Writes text to rotating log files from a background thread. Each thread
+// collects its text in a buffer of its own and hands it over in large chunks
+// without taking a lock, so logging does not slow down the game loop.
+//
+// Text that a thread has not handed over yet is only written once the thread
+// calls flush() or exits, or when it calls stop().
+class Logger
+{
+public:
+	static const size_t MAX_FILE_BYTES = 64 * 1024 * 1024;
+	static const size_t MAX_OLD_FILES = 4;
+
+	// Starts writing to folder/name.log. Once that file exceeds maxFileBytes,
+	// it is renamed to folder/name.1.log and a new file is started, keeping
+	// at most maxOldFiles old files.
+	static void start(const std::string& folder, const std::string& name,
+		size_t maxFileBytes = MAX_FILE_BYTES,
+		size_t maxOldFiles = MAX_OLD_FILES);
+
+	// Writes all remaining text of the calling thread and of threads that
+	// have exited, then stops the background thread.
+	static void stop();
+
+	// Before start() and after stop(), text is written to std::cout instead.
+	static void write(const std::string& text);
+
+	template <typename T>
+	static void write(const T& value)
+	{
+		std::ostringstream os;
+		os << value;
+		write(os.str());
+	}
+
+	// Hands the text of the calling thread over to the background thread.
+	static void flush();
+};
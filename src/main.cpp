@@ -24,6 +24,8 @@
 #include <iostream>
 #include <unordered_map>
 #include <chrono>
+#include <random>
+#include <cmath>
 #ifdef _MSC_VER
 #include <direct.h>
 #else
@@ -37,10 +39,16 @@
 
 #include "setting.hpp"
 #include "newtbraintrainer.hpp"
+#include "sharding.hpp"
+#include "islands.hpp"
+#include "autotuner.hpp"
+#include "nnet/brainstore.hpp"
+#include "nnet/neuralnewtbrain.hpp"
+#include "nnet/brainpack.hpp"
+#include "nnet/litenetwork.hpp"
 
 
-static std::unordered_map<std::string, Setting> settings =
-	Setting::readSettings("settings.json");
+static Settings settings = Setting::readSettings("settings.json");
 
 static uint64_t currentMilliseconds()
 {
@@ -48,15 +56,125 @@ static uint64_t currentMilliseconds()
 	return std::chrono::duration_cast<std::chrono::milliseconds>(now).count();
 }
 
+// Removes brains from the shared store that are no longer referenced by any
+// round of any session in the brains directory.
+static void collectGarbage(bool dryRun)
+{
+	std::string storeFolder = settings.brainStore;
+	if (storeFolder.empty()) storeFolder = "brains/store";
+	BrainStore store(storeFolder);
+	size_t freedBytes = 0;
+	// Brains written in the last hour might belong to a running session that
+	// has not written its round list yet.
+	size_t count = store.collectGarbage("brains", 3600, dryRun, freedBytes);
+	std::cout << (dryRun ? "Would remove " : "Removed ") << count
+		<< " unreferenced brains from " << storeFolder << ", freeing "
+		<< (freedBytes / 1048576.0f) << " MiB" << std::endl;
+}
+
+static std::pair<std::string, std::string> splitPath(const std::string& path)
+{
+	size_t slash = path.find_last_of("/\\");
+	if (slash == std::string::npos) return {".", path};
+	return {path.substr(0, slash), path.substr(slash + 1)};
+}
+
+// Returns the largest difference between the outputs of two networks for a
+// batch of random board states.
+static float compareNetworks(const Network& network1, const Network& network2)
+{
+	static const size_t COUNT = 16;
+	std::default_random_engine gen(currentMilliseconds());
+	std::uniform_int_distribution<int> dis(0, 10);
+	std::vector<int8_t> input(COUNT * network1.inputSize());
+	for (int8_t& value : input) value = dis(gen);
+	std::vector<float> output1(COUNT * network1.outputSize());
+	std::vector<float> output2(COUNT * network2.outputSize());
+	network1.evaluate(input.data(), COUNT, output1.data());
+	network2.evaluate(input.data(), COUNT, output2.data());
+	float difference = 0.0f;
+	for (size_t i = 0; i < output1.size(); i++)
+	{
+		difference = std::max(difference,
+			std::fabs(output1[i] - output2[i]));
+	}
+	return difference;
+}
+
+// Converts a brain saved by an older version, or a brain like
+// ai/default.brain, to a pack with float weights that can be memory mapped
+// and evaluated without libtorch.
+static void convert(const std::string& from, const std::string& to)
+{
+	Settings cpuSettings = settings;
+	cpuSettings.cuda = false;
+	auto source = splitPath(from);
+	auto target = splitPath(to);
+	auto name = std::make_shared<RestoredBrainName>("converted", 0);
+	auto brain = std::make_shared<NeuralNewtBrain>(cpuSettings, name);
+	brain->load(source.first, source.second);
+	NeuralNewtBrain::savePack(target.first, target.second, {brain});
+
+	LiteNetwork lite(std::make_shared<const BrainPack>(to), 0);
+	float difference = compareNetworks(*brain->network(), lite);
+	if (difference > 1e-3f)
+	{
+		throw std::runtime_error("Output of " + to + " without libtorch"
+			" differs by " + std::to_string(difference));
+	}
+	std::cout << "Converted " << from << " to " << to << " (outputs without"
+		" libtorch differ by at most " << difference << ")" << std::endl;
+}
+
 void run(int argc, char* argv[])
 {
+	if (argc >= 2 && std::string(argv[1]) == "--convert")
+	{
+		if (argc != 4)
+		{
+			throw std::runtime_error("Usage: main --convert [brain] [pack]");
+		}
+		convert(argv[2], argv[3]);
+		return;
+	}
+
+	if (argc >= 2 && std::string(argv[1]) == "--gc")
+	{
+		if (argc > 3 || (argc == 3 && std::string(argv[2]) != "--dry-run"))
+		{
+			throw std::runtime_error("Usage: main --gc [--dry-run]");
+		}
+		collectGarbage(argc == 3);
+		return;
+	}
+
 	Writer writer;
 	writer.install();
 	Library library;
 	library.load();
 	library.install();
 
-	LogInstaller("main", 20, settings["aftermath_loglevel"]).install();
+	LogInstaller("main", 20, settings.aftermathLoglevel).install();
+
+	// Plays shards of the rounds of a trainer elsewhere, see coordinator_port.
+	if (argc >= 2 && std::string(argv[1]) == "--worker")
+	{
+		std::string address = (argc == 3) ? argv[2] : "";
+		size_t colon = address.rfind(':');
+		if (argc != 3 || colon == std::string::npos || colon == 0)
+		{
+			throw std::runtime_error("Usage: main --worker [host]:[port]");
+		}
+		unsigned long port = std::stoul(address.substr(colon + 1));
+		if (port == 0 || port > 65535)
+		{
+			throw std::runtime_error("Invalid port in " + address);
+		}
+		srand(currentMilliseconds());
+		runShardWorker(settings, Library::nameCurrentBible(),
+			address.substr(0, colon), port);
+		return;
+	}
 
 	if (argc == 2)
 	{
@@ -113,7 +231,29 @@ void run(int argc, char* argv[])
 
 	srand(currentMilliseconds());
 
-	NewtBrainTrainer trainer(settings, Library::nameCurrentBible());
+	if (settings.islands)
+	{
+		if (!session.empty())
+		{
+			throw std::runtime_error("Islands cannot be resumed together; to"
+				" resume a single island, set \"islands\" to false");
+		}
+		if (settings.autotune)
+		{
+			std::cerr << "WARNING: autotune is not supported with islands"
+				<< std::endl;
+		}
+		runIslands(settings, Library::nameCurrentBible());
+		return;
+	}
+
+	Settings trainerSettings = settings;
+	if (settings.autotune)
+	{
+		trainerSettings = autotune(settings, Library::nameCurrentBible());
+	}
+
+	NewtBrainTrainer trainer(trainerSettings, Library::nameCurrentBible());
 	if (!session.empty()) trainer.resume(session, round, initEvolve);
 	trainer.train();
 }
@@ -0,0 +1,110 @@
+/**
+ * Part of Epicinium NeuralNewt
+ * developed by A Bunch of Hacks.
+ *
+ * Copyright (c) 2020 A Bunch of Hacks
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * [authors:]
+ * Daan Mulder (daan@abunchofhacks.coop)
+ */
+
+#include "mappedfile.hpp"
+
+#include <stdexcept>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+
+#ifdef _WIN32
+MappedFile::MappedFile(const std::string& filename) :
+	_data(nullptr),
+	_size(0),
+	_file(INVALID_HANDLE_VALUE),
+	_mapping(nullptr)
+{
+	_file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ,
+		nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (_file == INVALID_HANDLE_VALUE)
+	{
+		throw std::runtime_error("Cannot open file " + filename);
+	}
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(_file, &size))
+	{
+		CloseHandle(_file);
+		throw std::runtime_error("Cannot determine size of file " + filename);
+	}
+	_size = size.QuadPart;
+	if (_size == 0) return;
+	_mapping = CreateFileMappingA(_file, nullptr, PAGE_READONLY, 0, 0,
+		nullptr);
+	if (_mapping != nullptr)
+	{
+		_data = (const char*) MapViewOfFile(_mapping, FILE_MAP_READ, 0, 0, 0);
+	}
+	if (_data == nullptr)
+	{
+		if (_mapping != nullptr) CloseHandle(_mapping);
+		CloseHandle(_file);
+		throw std::runtime_error("Cannot map file " + filename);
+	}
+}
+
+MappedFile::~MappedFile()
+{
+	if (_data != nullptr) UnmapViewOfFile(_data);
+	if (_mapping != nullptr) CloseHandle(_mapping);
+	if (_file != INVALID_HANDLE_VALUE) CloseHandle(_file);
+}
+#else
+MappedFile::MappedFile(const std::string& filename) :
+	_data(nullptr),
+	_size(0),
+	_fd(-1)
+{
+	_fd = open(filename.c_str(), O_RDONLY);
+	if (_fd < 0)
+	{
+		throw std::runtime_error("Cannot open file " + filename);
+	}
+	struct stat buffer;
+	if (fstat(_fd, &buffer) != 0)
+	{
+		close(_fd);
+		throw std::runtime_error("Cannot determine size of file " + filename);
+	}
+	_size = buffer.st_size;
+	if (_size == 0) return;
+	void* data = mmap(nullptr, _size, PROT_READ, MAP_SHARED, _fd, 0);
+	if (data == MAP_FAILED)
+	{
+		close(_fd);
+		throw std::runtime_error("Cannot map file " + filename);
+	}
+	_data = (const char*) data;
+}
+
+MappedFile::~MappedFile()
+{
+	if (_data != nullptr) munmap((void*) _data, _size);
+	if (_fd >= 0) close(_fd);
+}
+#endif
@@ -0,0 +1,70 @@
+/**
+ * Part of Epicinium NeuralNewt
+ * developed by A Bunch of Hacks.
+ *
+ * Copyright (c) 2020 A Bunch of Hacks
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * [authors:]
+ * Daan Mulder (daan@abunchofhacks.coop)
+ */
+
+
+#include "memoryusage.hpp"
+
+#include <string>
+#include <fstream>
+
+
+// Reads a field such as "VmRSS:    1234 kB" from /proc/self/status.
+static size_t statusBytes(const std::string& field)
+{
+#ifdef __linux__
+	std::ifstream file("/proc/self/status");
+	std::string line;
+	while (std::getline(file, line))
+	{
+		if (line.compare(0, field.size(), field) == 0
+			&& line.size() > field.size() && line[field.size()] == ':')
+		{
+			return std::stoull(line.substr(field.size() + 1)) * 1024;
+		}
+	}
+#else
+	(void) field;
+#endif
+	return 0;
+}
+
+size_t residentBytes()
+{
+	return statusBytes("VmRSS");
+}
+
+size_t peakResidentBytes()
+{
+	return statusBytes("VmHWM");
+}
+
+bool resetPeakResident()
+{
+#ifdef __linux__
+	std::ofstream file("/proc/self/clear_refs");
+	file << "5";
+	file.flush();
+	return bool(file);
+#else
+	return false;
+#endif
+}
@@ -0,0 +1,37 @@
+/**
+ * Part of Epicinium NeuralNewt
+ * developed by A Bunch of Hacks.
+ *
+ * Copyright (c) 2020 A Bunch of Hacks
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * [authors:]
+ * Daan Mulder (daan@abunchofhacks.coop)
+ */
+
+
+#pragma once
+
+#include <cstddef>
+
+
+// The current and the peak resident set size of the process in bytes, or 0
+// where this cannot be determined (only Linux is supported).
+size_t residentBytes();
+size_t peakResidentBytes();
+
+// Resets the peak resident set size to the current size. Returns false if the
+// kernel does not allow this, in which case the peak is the peak since the
+// process started.
+bool resetPeakResident();
@@ -0,0 +1,221 @@
+/**
+ * Part of Epicinium NeuralNewt
+ * developed by A Bunch of Hacks.
+ *
+ * Copyright (c) 2020 A Bunch of Hacks
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * [authors:]
+ * Daan Mulder (daan@abunchofhacks.coop)
+ */
+
+
+#include "metricsserver.hpp"
+
+#include <sstream>
+#include <cstring>
+#include <stdexcept>
+#include <iostream>
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <poll.h>
+#include <unistd.h>
+#endif
+
+#include "memoryusage.hpp"
+
+
+#ifdef _WIN32
+MetricsServer::MetricsServer(uint16_t /**/) :
+	_socket(-1)
+{
+	throw std::runtime_error("The metrics server is not supported on Windows");
+}
+
+MetricsServer::~MetricsServer() = default;
+
+void MetricsServer::run() {}
+void MetricsServer::serve(int /**/) {}
+#else
+MetricsServer::MetricsServer(uint16_t port) :
+	_socket(-1),
+	_stopping(false),
+	_round(0),
+	_lastScrape(std::chrono::steady_clock::now()),
+	_lastCounts(Counters::snapshot())
+{
+	_socket = socket(AF_INET, SOCK_STREAM, 0);
+	if (_socket < 0)
+	{
+		throw std::runtime_error("Cannot create metrics socket");
+	}
+	int reuse = 1;
+	setsockopt(_socket, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+	// Only listen on the loopback interface, the metrics are not meant to be
+	// exposed to the network.
+	sockaddr_in address;
+	std::memset(&address, 0, sizeof(address));
+	address.sin_family = AF_INET;
+	address.sin_port = htons(port);
+	address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (bind(_socket, (const sockaddr*) &address, sizeof(address)) != 0
+		|| listen(_socket, 4) != 0)
+	{
+		close(_socket);
+		throw std::runtime_error("Cannot listen for metrics on port "
+			+ std::to_string(port));
+	}
+
+	_thread = std::thread(&MetricsServer::run, this);
+	std::cout << "Serving metrics on http://127.0.0.1:" << port
+		<< "/metrics" << std::endl;
+}
+
+MetricsServer::~MetricsServer()
+{
+	_stopping = true;
+	_thread.join();
+	close(_socket);
+}
+
+void MetricsServer::run()
+{
+	while (!_stopping)
+	{
+		// Wake up regularly to check whether the server is stopping.
+		pollfd listening = {_socket, POLLIN, 0};
+		if (poll(&listening, 1, 200) <= 0) continue;
+
+		int client = accept(_socket, nullptr, nullptr);
+		if (client < 0) continue;
+		timeval timeout = {1, 0};
+		setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+		setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+		serve(client);
+		close(client);
+	}
+}
+
+void MetricsServer::serve(int client)
+{
+	// Every request gets the metrics, so only the end of the headers matters.
+	std::string request;
+	char buffer[1024];
+	while (request.find("\r\n\r\n") == std::string::npos
+		&& request.size() < 8192)
+	{
+		ssize_t received = recv(client, buffer, sizeof(buffer), 0);
+		if (received <= 0) return;
+		request.append(buffer, received);
+	}
+
+	std::string body = scrape();
+	std::string response = "HTTP/1.1 200 OK\r\n"
+		"Content-Type: text/plain; version=0.0.4\r\n"
+		"Content-Length: " + std::to_string(body.size()) + "\r\n"
+		"Connection: close\r\n"
+		"\r\n" + body;
+	size_t sent = 0;
+	while (sent < response.size())
+	{
+		ssize_t n = send(client, response.data() + sent,
+			response.size() - sent, MSG_NOSIGNAL);
+		if (n <= 0) return;
+		sent += n;
+	}
+}
+#endif
+
+static void metric(std::ostream& os, const char* name, const char* type,
+	const char* help)
+{
+	os << "# HELP neuralnewt_" << name << " " << help << "\n"
+		<< "# TYPE neuralnewt_" << name << " " << type << "\n";
+}
+
+std::string MetricsServer::scrape()
+{
+	typedef Counters::Count Count;
+	auto now = std::chrono::steady_clock::now();
+	Counters::Snapshot counts = Counters::snapshot();
+	Counters::Snapshot recent = counts - _lastCounts;
+	double seconds = std::chrono::duration_cast<std::chrono::microseconds>(
+		now - _lastScrape).count() / 1e6;
+	_lastScrape = now;
+	_lastCounts = counts;
+
+	std::ostringstream os;
+	metric(os, "round", "gauge", "The round that is being played.");
+	os << "neuralnewt_round " << _round.load(std::memory_order_relaxed)
+		<< "\n";
+
+	metric(os, "games_in_flight", "gauge",
+		"Games that have been set up but are not done yet.");
+	os << "neuralnewt_games_in_flight "
+		<< (counts.count(Count::STARTED_GAMES) - counts.count(Count::GAMES))
+		<< "\n";
+
+	for (size_t i = 0; i < Counters::NUM_COUNTS; i++)
+	{
+		Count count = Count(i);
+		std::string name = std::string(Counters::name(count)) + "_total";
+		metric(os, name.c_str(), "counter", "Total since the process started.");
+		os << "neuralnewt_" << name << " " << counts.count(count) << "\n";
+	}
+
+	double games = recent.count(Count::GAMES);
+	double evaluations = recent.count(Count::EVALUATIONS);
+	double boards = recent.count(Count::EVALUATED_BOARDS);
+	metric(os, "games_per_second", "gauge",
+		"Games finished per second since the previous scrape.");
+	os << "neuralnewt_games_per_second "
+		<< ((seconds > 0) ? games / seconds : 0.0) << "\n";
+	metric(os, "evaluations_per_second", "gauge",
+		"Network evaluations per second since the previous scrape.");
+	os << "neuralnewt_evaluations_per_second "
+		<< ((seconds > 0) ? evaluations / seconds : 0.0) << "\n";
+	metric(os, "mean_batch_size", "gauge",
+		"Boards per network evaluation since the previous scrape.");
+	os << "neuralnewt_mean_batch_size "
+		<< ((evaluations > 0) ? boards / evaluations : 0.0) << "\n";
+
+	metric(os, "batches_total", "counter",
+		"Network evaluations per range of batch sizes.");
+	for (size_t i = 0; i < Counters::NUM_BATCH_SIZES; i++)
+	{
+		os << "neuralnewt_batches_total{size=\""
+			<< Counters::batchSizeName(i) << "\"} " << counts.batchSizes[i]
+			<< "\n";
+	}
+
+	metric(os, "phase_seconds_total", "counter",
+		"Time spent in each phase, summed over all threads.");
+	for (size_t i = 0; i < Counters::NUM_PHASES; i++)
+	{
+		Counters::Phase phase = Counters::Phase(i);
+		os << "neuralnewt_phase_seconds_total{phase=\""
+			<< Counters::name(phase) << "\"} " << counts.seconds(phase)
+			<< "\n";
+	}
+
+	metric(os, "resident_bytes", "gauge", "Resident set size.");
+	os << "neuralnewt_resident_bytes " << residentBytes() << "\n";
+	metric(os, "peak_resident_bytes", "gauge",
+		"Peak resident set size during the current round.");
+	os << "neuralnewt_peak_resident_bytes " << peakResidentBytes() << "\n";
+	return os.str();
+}
@@ -0,0 +1,63 @@
+/**
+ * Part of Epicinium NeuralNewt
+ * developed by A Bunch of Hacks.
+ *
+ * Copyright (c) 2020 A Bunch of Hacks
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * [authors:]
+ * Daan Mulder (daan@abunchofhacks.coop)
+ */
+
+
+#pragma once
+
+#include <string>
+#include <thread>
+#include <atomic>
+#include <chrono>
+
+#include "counters.hpp"
+
+
+// Serves the counters as Prometheus text on http://127.0.0.1:<port>/metrics
+// from a background thread. The counters are read with relaxed atomic loads,
+// so scraping never blocks the threads that are playing games. Rates and the
+// mean batch size are taken over the time since the previous scrape.
+class MetricsServer
+{
+private:
+	int _socket;
+	std::atomic<bool> _stopping;
+	std::atomic<uint64_t> _round;
+	std::chrono::steady_clock::time_point _lastScrape;
+	Counters::Snapshot _lastCounts;
+	std::thread _thread;
+
+public:
+	explicit MetricsServer(uint16_t port);
+	MetricsServer(const MetricsServer&) = delete;
+	MetricsServer(MetricsServer&&) = delete;
+	MetricsServer& operator=(const MetricsServer&) = delete;
+	MetricsServer& operator=(MetricsServer&&) = delete;
+	~MetricsServer();
+
+	void setRound(size_t round)
+		{ _round.store(round, std::memory_order_relaxed); }
+
+private:
+	void run();
+	void serve(int client);
+	std::string scrape();
+};
@@ -26,56 +26,135 @@
 #include "libs/aftermath/aiquickquack.hpp"
 #include "libs/aftermath/airampantrhino.hpp"
 
+#include "libs/jsoncpp/json.h"
+
 #include <torch/torch.h>
+#include <fstream>
+#include <iostream>
+#ifdef _MSC_VER
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
 
 #include "setting.hpp"
+#include "counters.hpp"
+#include "profiler.hpp"
+#include "logger.hpp"
+#include "recordingwriter.hpp"
+#include "folders.hpp"
+#include "memoryusage.hpp"
+#include "affinity.hpp"
+#include "brainlineage.hpp"
 #include "nnet/neuralnewtbrain.hpp"
+#include "nnet/brainpack.hpp"
+#include "nnet/brainstore.hpp"
+#include "nnet/inferencecapture.hpp"
+#include "checkpointwriter.hpp"
+#include "metricsserver.hpp"
+#include "sharding.hpp"
+#include "islands.hpp"
 
 
-NewtBrainTrainer::NewtBrainTrainer(
-		std::unordered_map<std::string, Setting>& settings,
+NewtBrainTrainer::NewtBrainTrainer(const Settings& settings,
 		const std::string& rulesetname) :
+	NewtBrainTrainer(settings, rulesetname, nullptr)
+{}
+
+NewtBrainTrainer::NewtBrainTrainer(const Settings& settings,
+		const std::string& rulesetname, std::unique_ptr<Island> island) :
 	_settings(settings),
 	_rulesetname(rulesetname),
-	_startTime(std::time(nullptr)),
-	_round(0)
+	_startTime(island ? island->startTime() : std::time(nullptr)),
+	_session(std::to_string(_startTime) + (island
+		? "-island" + std::to_string(island->index()) : "")),
+	_round(0),
+	_island(std::move(island))
 {
-	if (settings.count("torch_threads"))
-		torch::set_num_threads(settings["torch_threads"]);
-	if (settings["cuda"] && !torch::cuda::is_available())
+	// Local workers are forked before libtorch starts any threads.
+	if (_settings.coordinatorPort > 0 || _settings.localWorkers > 0)
+	{
+		_coordinator.reset(new ShardCoordinator(_settings, _rulesetname,
+			"brains/" + _session));
+	}
+
+	if (_settings.torchThreads > 0)
+		torch::set_num_threads(_settings.torchThreads);
+	if (_settings.cuda && !torch::cuda::is_available())
 	{
-		settings["cuda"] = false;
+		_settings.cuda = false;
 	}
-	if (settings["cuda"]) std::cout << "YAAY CUDA!" << std::endl;
+	if (_settings.cuda) std::cout << "YAAY CUDA!" << std::endl;
 	else std::cout << "aww no CUDA" << std::endl;
+
+	// Verbose output goes to logs/, so that printing the result of every game
+	// does not slow down the rounds.
+	if (_settings.verbose)
+	{
+		Logger::start(_settings.logFolder, "games-" + _session);
+	}
+
+	if (_settings.captureChance > 0)
+	{
+		makeFolder(_settings.logFolder);
+		InferenceCapture::start(_settings.logFolder + "/inputs-" + _session
+			+ ".capture", NeuralNewtBrain::INPUT_SIZE,
+			_settings.captureChance);
+	}
+
+	if (_settings.recordingChance > 0)
+	{
+		RecordingWriter::start("recordings");
+	}
+
+	if (_settings.metricsPort > 0)
+	{
+		_metricsServer.reset(new MetricsServer(_settings.metricsPort));
+	}
+
+	if (_settings.profile)
+	{
+		Profiler::enable(true);
+		Profiler::nameThread("main");
+	}
+
+	if (_settings.saveBrains)
+	{
+		_checkpointWriter.reset(new CheckpointWriter(
+			_settings.checkpointQueueSize, _settings.brainStore,
+			_settings.timing));
+	}
+}
+
+NewtBrainTrainer::~NewtBrainTrainer()
+{
+	try
+	{
+		InferenceCapture::stop();
+	}
+	catch (const std::exception& e)
+	{
+		std::cerr << e.what() << std::endl;
+	}
+	RecordingWriter::stop();
+	Logger::stop();
 }
 
 Director::RoundResults NewtBrainTrainer::playRound()
 {
+	Profiler::Scope scope("playRound");
 	std::chrono::high_resolution_clock::time_point start;
-	static bool timing = _settings["timing"];
+	bool timing = _settings.timing;
 	size_t count = 0;
 	if (timing) start = std::chrono::high_resolution_clock::now();
 
-	Director director(_settings, _rulesetname, _brains);
-	// Round robin (TODO do we want something else?)
-	for (size_t i = 0; i < _brains.size(); i++)
-	{
-		for (size_t j = i + 1; j < _brains.size(); j++)
-		{
-			if ((i + j) % 2 == 0) director.addPopGame(i, j);
-			else director.addPopGame(j, i);
-			if (timing) count++;
-		}
-		for (size_t j = 0; j < size_t(_settings["num_AI_games"]); j++)
-		{
-			director.addAIGame<AIHungryHippo>(i, j % 2 == 0);
-			director.addAIGame<AIQuickQuack>(i, j % 2 == 0);
-			director.addAIGame<AIRampantRhino>(i, j % 2 == 0);
-			if (timing) count += 3;
-		}
-	}
-	Director::RoundResults results = director.play();
+	std::vector<GameSpec> games = listGames(_brains.size(),
+		_settings.numAIGames);
+	count = games.size();
+
+	Director::RoundResults results = _coordinator
+		? _coordinator->play(_round, _brains, games)
+		: playGames(_settings, _rulesetname, _brains, games);
 
 	if (timing)
 	{
@@ -90,33 +169,91 @@ Director::RoundResults NewtBrainTrainer::playRound()
 	return results;
 }
 
+std::vector<GameSpec> NewtBrainTrainer::listGames(size_t numBrains,
+	size_t numAIGames)
+{
+	std::vector<GameSpec> games;
+	// Round robin (TODO do we want something else?)
+	for (uint32_t i = 0; i < numBrains; i++)
+	{
+		for (uint32_t j = i + 1; j < numBrains; j++)
+		{
+			if ((i + j) % 2 == 0) games.push_back({0, 0, 0, i, j});
+			else games.push_back({0, 0, 0, j, i});
+		}
+		for (size_t j = 0; j < numAIGames; j++)
+		{
+			for (uint8_t opponent = 1; opponent <= 3; opponent++)
+			{
+				games.push_back({opponent, j % 2 == 0, 0, i, 0});
+			}
+		}
+	}
+	return games;
+}
+
+Director::RoundResults NewtBrainTrainer::playGames(const Settings& settings,
+	const std::string& rulesetname,
+	const std::vector<std::shared_ptr<NeuralNewtBrain>>& brains,
+	const std::vector<GameSpec>& games)
+{
+	Director director(settings, rulesetname, brains);
+	for (const GameSpec& game : games)
+	{
+		switch (game.opponent)
+		{
+			case 0:
+			{
+				director.addPopGame(game.brain, game.other);
+			}
+			break;
+			case 1:
+			{
+				director.addAIGame<AIHungryHippo>(game.brain, game.first);
+			}
+			break;
+			case 2:
+			{
+				director.addAIGame<AIQuickQuack>(game.brain, game.first);
+			}
+			break;
+			case 3:
+			{
+				director.addAIGame<AIRampantRhino>(game.brain, game.first);
+			}
+			break;
+			default:
+			{
+				throw std::runtime_error("Unknown opponent "
+					+ std::to_string(game.opponent));
+			}
+		}
+	}
+	return director.play();
+}
+
 void NewtBrainTrainer::saveBrains()
 {
-	if (!_settings["save_brains"]) return;
+	if (!_settings.saveBrains) return;
+	Counters::Timer timer(Counters::Phase::SAVE);
+	Profiler::Scope scope("saveBrains");
 
-	static bool timing = _settings["timing"];
+	bool timing = _settings.timing;
 	std::chrono::high_resolution_clock::time_point start;
 	size_t count = 0;
 	if (timing) start = std::chrono::high_resolution_clock::now();
 
-	std::string folder = "brains/" + std::to_string(_startTime);
-	std::ofstream brainList;
-	bool first = true;
+	std::string folder = "brains/" + _session;
 
 	for (auto& brain : _brains)
 	{
-		std::cout << "saving brain " << brain->mediumName() << " as "
-			<< brain->shortName() << std::endl;
-		bool saved = brain->save(folder, brain->shortName() + ".pth.tar");
-		if (timing && saved) count++;
-		if (first)
-		{
-			brainList.open(folder + "/round" + std::to_string(_round) + ".txt",
-				std::ofstream::trunc);
-			first = false;
-		}
-		brainList << brain->shortName() << std::endl;
+		Logger::write("saving brain " + brain->mediumName() + " as "
+			+ brain->shortName() + "\n");
+		if (timing) count++;
 	}
+	// The weights are written on a background thread while the next round is
+	// being played. This only blocks if earlier rounds are still queued.
+	_checkpointWriter->push(folder, _round, _brains);
 
 	if (timing)
 	{
@@ -124,9 +261,118 @@ void NewtBrainTrainer::saveBrains()
 		float d =
 			std::chrono::duration_cast<std::chrono::microseconds>(end - start)
 			.count() / 1000.0f;
-		std::cout << "Saving brains took " << d << "ms (" << (d / count)
-			<< "ms per brain)" << std::endl;
+		std::cout << "Queueing brains for saving took " << d << "ms ("
+			<< (d / count) << "ms per brain)" << std::endl;
+	}
+}
+
+void NewtBrainTrainer::writeGameLog(const Director::RoundResults& results)
+{
+	makeFolder(_settings.logFolder);
+	std::string filename = _settings.logFolder + "/games-" + _session
+		+ "-round" + std::to_string(_round) + ".games";
+	std::vector<std::string> opponentNames(results.aiNames.begin(),
+		results.aiNames.end());
+	std::vector<uint32_t> brainIds;
+	std::vector<std::string> brainNames;
+	for (const auto& brain : _brains)
+	{
+		brainIds.push_back(brain->id());
+		brainNames.push_back(brain->shortName());
 	}
+	GameLog::save(filename, _startTime, _round, _settings.mapNames,
+		opponentNames, brainIds, brainNames, results.games);
+}
+
+// Appends one line of JSON with the metrics of the round that just ended to
+// logs/metrics-<start time>.jsonl. Checkpoints are written in the background,
+// so the stored and written brains are mostly those of the previous round.
+void NewtBrainTrainer::writeMetrics(const Counters::Snapshot& counts,
+	double seconds)
+{
+	typedef Counters::Count Count;
+	Json::Value json = Json::objectValue;
+	json["session"] = Json::Int64(_startTime);
+	if (_island) json["island"] = Json::UInt64(_island->index());
+	json["round"] = Json::UInt64(_round - 1);
+	json["time"] = Json::Int64(std::time(nullptr));
+	json["seconds"] = seconds;
+	for (size_t i = 0; i < Counters::NUM_COUNTS; i++)
+	{
+		Count count = Count(i);
+		json[Counters::name(count)] = Json::UInt64(counts.count(count));
+	}
+	uint64_t games = counts.count(Count::GAMES);
+	uint64_t evaluations = counts.count(Count::EVALUATIONS);
+	uint64_t stored = counts.count(Count::STORED_BRAINS);
+	json["games_per_second"] = (seconds > 0) ? games / seconds : 0.0;
+	json["turns_per_game"] = (games > 0)
+		? double(counts.count(Count::TURNS)) / games : 0.0;
+	json["mean_batch_size"] = (evaluations > 0)
+		? double(counts.count(Count::EVALUATED_BOARDS)) / evaluations : 0.0;
+	json["batch_sizes"] = Json::objectValue;
+	for (size_t i = 0; i < Counters::NUM_BATCH_SIZES; i++)
+	{
+		json["batch_sizes"][Counters::batchSizeName(i)] =
+			Json::UInt64(counts.batchSizes[i]);
+	}
+	if (stored > 0)
+	{
+		json["store_hit_rate"] =
+			1.0 - double(counts.count(Count::WRITTEN_BRAINS)) / stored;
+	}
+	json["phase_seconds"] = Json::objectValue;
+	for (size_t i = 0; i < Counters::NUM_PHASES; i++)
+	{
+		Counters::Phase phase = Counters::Phase(i);
+		json["phase_seconds"][Counters::name(phase)] = counts.seconds(phase);
+	}
+	size_t parameters = 0;
+	for (const auto& brain : _brains)
+	{
+		parameters += brain->numParameters();
+	}
+	json["rss_mb"] = residentBytes() / 1048576.0;
+	json["peak_rss_mb"] = peakResidentBytes() / 1048576.0;
+	json["parameter_mb"] = parameters * sizeof(float) / 1048576.0;
+	json["lineage_entries"] = Json::UInt64(BrainLineage::size());
+	if (_settings.affinity)
+	{
+		Json::Value placement(Json::arrayValue);
+		for (const Placement& node : currentTopology())
+		{
+			placement.append(describePlacement(node));
+		}
+		json["placement"] = placement;
+	}
+
+	makeFolder(_settings.logFolder);
+	std::string filename = _settings.logFolder + "/metrics-" + _session
+		+ ".jsonl";
+	std::ofstream file(filename, std::ios::app);
+	Json::FastWriter writer;
+	file << writer.write(json);
+	if (!file)
+	{
+		std::cerr << "WARNING: cannot write metrics to " << filename
+			<< std::endl;
+	}
+}
+
+// Writes everything profiled during the round that just ended, including the
+// checkpoints written in the background since the previous round.
+void NewtBrainTrainer::writeTrace()
+{
+	makeFolder(_settings.logFolder);
+	std::string filename = _settings.logFolder + "/trace-" + _session
+		+ "-round" + std::to_string(_round - 1) + ".json";
+	size_t dropped = Profiler::writeTrace(filename);
+	if (dropped > 0)
+	{
+		std::cerr << "WARNING: profiler dropped " << dropped << " events"
+			" while tracing round " << (_round - 1) << std::endl;
+	}
+	if (_settings.timing) std::cout << "Wrote " << filename << std::endl;
 }
 
 // Sorts the brains based on a round's resuts so the best-performing are first.
@@ -135,13 +381,14 @@ void NewtBrainTrainer::saveBrains()
 Director::RoundResults NewtBrainTrainer::sortBrains(
 	const Director::RoundResults& results)
 {
-	static bool timing = _settings["timing"];
+	Profiler::Scope scope("sortBrains");
+	bool timing = _settings.timing;
 	std::chrono::high_resolution_clock::time_point start;
 	if (timing) start = std::chrono::high_resolution_clock::now();
 
 	Director::RoundResults sortedResults;
-	static size_t numPools = _settings["num_pools"];
-	static size_t brainsPerPool = _settings["brains_per_pool"];
+	size_t numPools = _settings.numPools;
+	size_t brainsPerPool = _settings.brainsPerPool;
 	for (size_t i = 0; i < numPools; i++)
 	{
 		std::vector<size_t> permutation(brainsPerPool);
@@ -203,20 +450,22 @@ Director::RoundResults NewtBrainTrainer::sortBrains(
 
 void NewtBrainTrainer::evolveBrains()
 {
-	static bool timing = _settings["timing"];
+	Counters::Timer timer(Counters::Phase::EVOLVE);
+	Profiler::Scope scope("evolveBrains");
+	bool timing = _settings.timing;
 	std::chrono::high_resolution_clock::time_point start;
 	size_t coCount = 0;
 	size_t muCount = 0;
 	if (timing) start = std::chrono::high_resolution_clock::now();
 
-	static float deviationFactor = _settings["mutation_deviation_factor"];
-	static float selectionChance =
-		std::min(float(_settings["mutation_selection_chance"]), 1.0f);
+	float deviationFactor = _settings.mutationDeviationFactor;
+	float selectionChance =
+		std::min(_settings.mutationSelectionChance, 1.0f);
 
-	static size_t numPools = _settings["num_pools"];
-	static size_t brainsPerPool = _settings["brains_per_pool"];
-	static size_t numParents = brainsPerPool / 5;
-	static size_t numKeep = numParents * 2;
+	size_t numPools = _settings.numPools;
+	size_t brainsPerPool = _settings.brainsPerPool;
+	size_t numParents = brainsPerPool / 5;
+	size_t numKeep = numParents * 2;
 
 	for (size_t i = 0; i < numPools; i++)
 	{
@@ -270,45 +519,83 @@ void NewtBrainTrainer::evolveBrains()
 void NewtBrainTrainer::resume(std::string session, size_t round,
 	bool initEvolve)
 {
-	bool timing = _settings["timing"];
+	Profiler::Scope scope("resume");
+	bool timing = _settings.timing;
 	std::chrono::high_resolution_clock::time_point start;
 	if (timing) start = std::chrono::high_resolution_clock::now();
 
 	_round = round;
 	std::string folder = "brains/" + session;
 	std::string filename = folder + "/round" + std::to_string(_round) + ".txt";
+	std::string packname = folder + "/round" + std::to_string(_round)
+		+ ".pack";
+	size_t maxBrains = _settings.numPools * _settings.brainsPerPool;
 
-	std::ifstream file(filename);
-	if (!file) throw std::runtime_error("Error while resuming: file "
-		+ filename + " cannot be opened");
-	std::string line;
 	size_t i = 0;
-	while (std::getline(file, line))
+	struct stat buffer;
+	if (stat(packname.c_str(), &buffer) == 0)
 	{
-		std::string name, filename;
-		// If the line contains a space, everything before is the brain name and
-		// after is the filename. If not, assume the entire line is both.
-		size_t delimiter = line.find(' ');
-		if (delimiter != std::string::npos)
+		// The packed checkpoint is mapped into memory and copied directly
+		// into the modules, without going through the torch archives.
+		filename = packname;
+		BrainPack pack(packname);
+		if (pack.size() > maxBrains)
 		{
-			name = line.substr(0, delimiter);
-			filename = line.substr(delimiter + 1);
+			throw std::runtime_error("Number of brains in " + filename
+				+ " exceeds number of brains in settings, I cannot handle"
+				  " that");
 		}
-		else
+		for (i = 0; i < pack.size(); i++)
 		{
-			name = filename = line;
+			_brains.push_back(std::make_shared<NeuralNewtBrain>(_settings,
+				std::make_shared<RestoredBrainName>(pack.name(i), _round)));
+			_brains.back()->restore(pack, i);
 		}
-
-		_brains.push_back(std::make_shared<NeuralNewtBrain>(_settings,
-			std::make_shared<RestoredBrainName>(name, _round)));
-		_brains.back()->load(folder, filename + ".pth.tar");
-		i++;
-		if (i > size_t(_settings["num_pools"])
-			* size_t(_settings["brains_per_pool"]))
+	}
+	else
+	{
+		// Brains are either in the shared store, or, for sessions from before
+		// packed checkpoints, in a separate torch archive for each brain.
+		BrainStore store(_settings.brainStore.empty()
+			? "brains/store" : _settings.brainStore);
+		std::ifstream file(filename);
+		if (!file) throw std::runtime_error("Error while resuming: file "
+			+ filename + " cannot be opened");
+		std::string line;
+		while (std::getline(file, line))
 		{
-			throw std::runtime_error("Number of brains in " + filename
-				+ " exceeds number of brains in settings, I cannot handle"
-				  " that");
+			std::string name, filename;
+			// If the line contains a space, everything before is the brain
+			// name and after is the filename. If not, assume the entire line
+			// is both.
+			size_t delimiter = line.find(' ');
+			if (delimiter != std::string::npos)
+			{
+				name = line.substr(0, delimiter);
+				filename = line.substr(delimiter + 1);
+			}
+			else
+			{
+				name = filename = line;
+			}
+
+			_brains.push_back(std::make_shared<NeuralNewtBrain>(_settings,
+				std::make_shared<RestoredBrainName>(name, _round)));
+			if (filename.compare(0, BrainStore::PREFIX.size(),
+					BrainStore::PREFIX) == 0)
+			{
+				BrainPack pack = store.get(
+					filename.substr(BrainStore::PREFIX.size()));
+				_brains.back()->restore(pack, 0);
+			}
+			else _brains.back()->load(folder, filename + ".pth.tar");
+			i++;
+			if (i > maxBrains)
+			{
+				throw std::runtime_error("Number of brains in " + filename
+					+ " exceeds number of brains in settings, I cannot handle"
+					  " that");
+			}
 		}
 	}
 	if (timing)
@@ -320,8 +607,7 @@ void NewtBrainTrainer::resume(std::string session, size_t round,
 		std::cout << "Resuming brains took " << d << "ms (" << (d / i)
 			<< "ms per brain)" << std::endl;
 	}
-	if (i < size_t(_settings["num_pools"])
-		* size_t(_settings["brains_per_pool"]))
+	if (i < maxBrains)
 	{
 		std::cerr << "WARNING: number of brains in " << filename
 			<< " less than number of brains in settings, this may cause"
@@ -338,20 +624,23 @@ void NewtBrainTrainer::resume(std::string session, size_t round,
 void NewtBrainTrainer::train()
 {
 	std::chrono::high_resolution_clock::time_point start;
-	static bool timing = _settings["timing"];
+	bool timing = _settings.timing;
 	if (timing) start = std::chrono::high_resolution_clock::now();
 
-	static size_t numRounds = _settings["num_rounds"];
-	static size_t numPools = _settings["num_pools"];
-	static size_t brainsPerPool = _settings["brains_per_pool"];
-	static bool verbose = _settings["verbose"];
+	size_t numRounds = _settings.numRounds;
+	size_t numPools = _settings.numPools;
+	size_t brainsPerPool = _settings.brainsPerPool;
+	bool verbose = _settings.verbose;
+	size_t lineageDepth = _settings.lineageDepth;
 
 	if (_brains.size() == 0)
 	{
+		// Seeds are numbered across islands, so that their names differ.
+		size_t first = _island ? _island->index() * brainsPerPool : 0;
 		for (size_t i = 0; i < numPools * brainsPerPool; i++)
 		{
 			_brains.push_back(std::make_shared<NeuralNewtBrain>(_settings,
-				std::make_shared<SeedBrainName>(i)));
+				std::make_shared<SeedBrainName>(first + i)));
 		}
 	}
 
@@ -368,12 +657,52 @@ void NewtBrainTrainer::train()
 
 	while (_round < numRounds)
 	{
-		if (verbose) std::cout << "ROUND " << _round << std::endl;
+		Counters::Snapshot before = Counters::snapshot();
+		auto roundStart = std::chrono::steady_clock::now();
+		resetPeakResident();
+		if (_metricsServer) _metricsServer->setRound(_round);
+
+		if (verbose) Logger::write("ROUND " + std::to_string(_round) + "\n");
 		Director::RoundResults results = playRound();
+		writeGameLog(results);
 		Director::RoundResults sortedResults = sortBrains(results);
-		if (verbose) std::cout << sortedResults << std::endl;
+		if (verbose) Logger::write(sortedResults);
+		if (_island && _settings.migrationInterval > 0
+			&& (_round + 1) % _settings.migrationInterval == 0)
+		{
+			_island->migrate(_settings, _round, _brains,
+				brainsPerPool / 5 * 2);
+		}
 		evolveBrains();
+		// Without pruning, the lineage of every brain that ever lived is kept.
+		if (lineageDepth > 0)
+		{
+			size_t pruned = BrainLineage::prune(lineageDepth);
+			if (timing)
+			{
+				std::cout << "Pruned " << pruned << " lineage entries, "
+					<< BrainLineage::size() << " left" << std::endl;
+			}
+		}
 		_round++;
 		saveBrains();
+
+		auto roundEnd = std::chrono::steady_clock::now();
+		Counters::Snapshot counts = Counters::snapshot() - before;
+		double seconds = std::chrono::duration_cast<std::chrono::microseconds>(
+			roundEnd - roundStart).count() / 1e6;
+		writeMetrics(counts, seconds);
+		Logger::flush();
+		if (_settings.consoleSummary)
+		{
+			uint64_t games = counts.count(Counters::Count::GAMES);
+			std::cout << "Round " << (_round - 1) << ": " << games
+				<< " games, " << (games > 0
+					? counts.count(Counters::Count::TURNS) / games : 0)
+				<< " turns per game, " << seconds << "s" << std::endl;
+		}
+		if (_settings.profile) writeTrace();
 	}
+
+	if (_checkpointWriter) _checkpointWriter->flush();
 }
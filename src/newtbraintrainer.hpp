@@ -28,36 +28,79 @@
 #include <ctime>
 
 #include "gamedirector.hpp"
+#include "setting.hpp"
+#include "counters.hpp"
 
-class Setting;
 class NeuralNewtBrain;
+class CheckpointWriter;
+class MetricsServer;
+class ShardCoordinator;
+class Island;
 class AIHungryHippo;
 class AIQuickQuack;
 class AIRampantRhino;
 
 typedef GameDirector<AIHungryHippo, AIQuickQuack, AIRampantRhino> Director;
 
+// A game of a round, so that the games of a round can be split into shards
+// and played elsewhere.
+struct GameSpec
+{
+	// 0 for a game between two brains, otherwise 1 plus the index of the
+	// baseline AI in Director.
+	uint8_t opponent;
+	// Whether the brain plays first against the baseline AI.
+	uint8_t first;
+	uint16_t reserved;
+	uint32_t brain;
+	// The brain playing second in a game between two brains.
+	uint32_t other;
+};
+
 
 class NewtBrainTrainer
 {
 private:
-	std::unordered_map<std::string, Setting>& _settings;
+	Settings _settings;
 	std::string _rulesetname;
 	std::time_t _startTime;
+	// The start time, followed by the island if there is one.
+	std::string _session;
 	std::vector<std::shared_ptr<NeuralNewtBrain>> _brains;
 	size_t _round;
+	std::unique_ptr<CheckpointWriter> _checkpointWriter;
+	std::unique_ptr<MetricsServer> _metricsServer;
+	std::unique_ptr<ShardCoordinator> _coordinator;
+	std::unique_ptr<Island> _island;
 
 public:
-	NewtBrainTrainer(std::unordered_map<std::string, Setting>& settings,
-		const std::string& rulesetname);
+	NewtBrainTrainer(const Settings& settings, const std::string& rulesetname);
+	NewtBrainTrainer(const Settings& settings, const std::string& rulesetname,
+		std::unique_ptr<Island> island);
+	NewtBrainTrainer(const NewtBrainTrainer&) = delete;
+	NewtBrainTrainer(NewtBrainTrainer&&) = delete;
+	NewtBrainTrainer& operator=(const NewtBrainTrainer&) = delete;
+	NewtBrainTrainer& operator=(NewtBrainTrainer&&) = delete;
+	~NewtBrainTrainer();
 
 private:
 	Director::RoundResults playRound();
 	void evolveBrains();
 	void saveBrains();
+	void writeTrace();
+	void writeGameLog(const Director::RoundResults& results);
+	void writeMetrics(const Counters::Snapshot& counts, double seconds);
 	Director::RoundResults sortBrains(const Director::RoundResults& results);
 
 public:
+	// The games of a round.
+	static std::vector<GameSpec> listGames(size_t numBrains,
+		size_t numAIGames);
+	static Director::RoundResults playGames(const Settings& settings,
+		const std::string& rulesetname,
+		const std::vector<std::shared_ptr<NeuralNewtBrain>>& brains,
+		const std::vector<GameSpec>& games);
+
 	void resume(std::string session, size_t round, bool initEvolve);
 	void train();
 };
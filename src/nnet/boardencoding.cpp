@@ -0,0 +1,409 @@
+/**
+ * Part of Epicinium NeuralNewt
+ * developed by A Bunch of Hacks.
+ *
+ * Copyright (c) 2020 A Bunch of Hacks
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * [authors:]
+ * Daan Mulder (daan@abunchofhacks.coop)
+ * Sander in 't Veld (sander@abunchofhacks.coop)
+ */
+
+#include "neuralnewtbrain.hpp"
+
+#include "libs/aftermath/aicommander.hpp"
+#include "libs/aftermath/position.hpp"
+#include "libs/aftermath/board.hpp"
+#include "libs/aftermath/tiletype.hpp"
+#include "libs/aftermath/unittype.hpp"
+#include "libs/aftermath/cell.hpp"
+
+
+enum BoardPlane : uint8_t
+{
+	P_TILETYPE,
+	P_TILEOWNER,
+	P_TILESTACKS,
+	P_TILEPOWER,
+	P_GROUNDTYPE,
+	P_GROUNDOWNER,
+	P_GROUNDSTACKS,
+	P_AIRTYPE,
+	P_AIROWNER,
+	P_AIRSTACKS,
+	P_HUMIDITY,
+	P_CHAOS,
+	P_GAS,
+	P_SNOW,
+	P_FROSTBITE,
+	P_FIRESTORM,
+	P_BONEDROUGHT,
+	P_DEATH,
+	P_VISION,
+};
+
+static constexpr size_t NUM_BOARDPLANES = ((size_t) P_VISION) + 1;
+
+static constexpr size_t PLANESIZE = Position::MAX_ROWS * Position::MAX_COLS;
+
+static constexpr int plix(BoardPlane plane, size_t offset)
+{
+	return ((int) plane) * PLANESIZE + offset;
+}
+
+#ifdef ORDERSENCODED
+static constexpr size_t OLDORDERSCAP = 10;
+static constexpr size_t NEWORDERSCAP = 5;
+static constexpr size_t NUM_ORDERS = OLDORDERSCAP + NEWORDERSCAP;
+static constexpr size_t PLANES_PER_ORDER = 4;
+static constexpr size_t NUM_ORDERPLANES = NUM_ORDERS * PLANES_PER_ORDER;
+#else
+static constexpr size_t NUM_ORDERPLANES = 2;
+#endif
+
+static constexpr size_t NUM_MONEYPLANES = 10;
+static constexpr size_t NUM_TIMEPLANES = 3;
+
+const size_t NeuralNewtBrain::NUM_PLANES = NUM_BOARDPLANES
+	+ NUM_ORDERPLANES + NUM_MONEYPLANES + NUM_TIMEPLANES;
+
+const size_t NeuralNewtBrain::INPUT_SIZE = NeuralNewtBrain::NUM_PLANES
+	* PLANESIZE;
+
+#ifdef ORDERSENCODED
+static inline void encodeOrder(const Board& board,
+	std::vector<int8_t>& data, size_t offset,
+	const Order& order)
+{
+	DEBUG_ASSERT(offset + PLANESIZE <= data.size());
+	std::fill(data.begin() + offset, data.begin() + offset + PLANESIZE, 0);
+	if (order.type != Order::Type::NONE)
+	{
+		Position pos = order.subject.position;
+		size_t i = pos.row * Position::MAX_COLS + pos.col;
+		data[offset + i] = (int8_t) order.subject.type;
+	}
+	offset += PLANESIZE;
+
+	DEBUG_ASSERT(offset + PLANESIZE <= data.size());
+	switch (order.type)
+	{
+		case Order::Type::NONE:
+		{
+			// Fill with a positive value to differentiate from not giving
+			// an order, because (int8_t) Order::Type::NONE == 0.
+			std::fill(data.begin() + offset, data.begin() + offset + PLANESIZE,
+				(int8_t) Order::TYPE_SIZE);
+		}
+		break;
+		case Order::Type::MOVE:
+		{
+			std::fill(data.begin() + offset, data.begin() + offset + PLANESIZE,
+				0);
+			Cell current = board.cell(order.subject.position);
+			for (const Move& move : order.moves)
+			{
+				current = current + move;
+				// Convert to pos and then back to index, because the "stride"
+				// should be MAX_COLS and not board._width.
+				Position pos = current.pos();
+				size_t i = pos.row * Position::MAX_COLS + pos.col;
+				data[offset + i] = (int8_t) order.type;
+			}
+		}
+		break;
+		case Order::Type::GUARD:
+		case Order::Type::FOCUS:
+		case Order::Type::LOCKDOWN:
+		case Order::Type::SHELL:
+		case Order::Type::BOMBARD:
+		case Order::Type::EXPAND:
+		case Order::Type::PRODUCE:
+		{
+			std::fill(data.begin() + offset, data.begin() + offset + PLANESIZE,
+				0);
+			Position pos = order.target.position;
+			size_t i = pos.row * Position::MAX_COLS + pos.col;
+			data[offset + i] = (int8_t) order.type;
+		}
+		break;
+		case Order::Type::BOMB:
+		case Order::Type::CAPTURE:
+		case Order::Type::SHAPE:
+		case Order::Type::SETTLE:
+		case Order::Type::UPGRADE:
+		case Order::Type::CULTIVATE:
+		case Order::Type::HALT:
+		{
+			std::fill(data.begin() + offset, data.begin() + offset + PLANESIZE,
+				0);
+			Position pos = order.subject.position;
+			size_t i = pos.row * Position::MAX_COLS + pos.col;
+			data[offset + i] = (int8_t) order.type;
+		}
+		break;
+	}
+	offset += PLANESIZE;
+
+	DEBUG_ASSERT(offset + PLANESIZE <= data.size());
+	switch (order.type)
+	{
+		case Order::Type::NONE:
+		case Order::Type::MOVE:
+		case Order::Type::GUARD:
+		case Order::Type::FOCUS:
+		case Order::Type::LOCKDOWN:
+		case Order::Type::SHELL:
+		case Order::Type::BOMBARD:
+		case Order::Type::BOMB:
+		case Order::Type::CAPTURE:
+		case Order::Type::PRODUCE:
+		case Order::Type::HALT:
+		{
+			std::fill(data.begin() + offset, data.begin() + offset + PLANESIZE,
+				0);
+		}
+		break;
+		case Order::Type::EXPAND:
+		{
+			std::fill(data.begin() + offset, data.begin() + offset + PLANESIZE,
+				0);
+			Position pos = order.target.position;
+			size_t i = pos.row * Position::MAX_COLS + pos.col;
+			data[offset + i] = (int8_t) order.tiletype;
+		}
+		break;
+		case Order::Type::SHAPE:
+		case Order::Type::SETTLE:
+		case Order::Type::UPGRADE:
+		{
+			std::fill(data.begin() + offset, data.begin() + offset + PLANESIZE,
+				0);
+			Position pos = order.subject.position;
+			size_t i = pos.row * Position::MAX_COLS + pos.col;
+			data[offset + i] = (int8_t) order.tiletype;
+		}
+		break;
+		case Order::Type::CULTIVATE:
+		{
+			std::fill(data.begin() + offset, data.begin() + offset + PLANESIZE,
+				0);
+			Cell center = board.cell(order.subject.position);
+			for (Cell other : board.area(center, 1, 2))
+			{
+				// Convert to pos and then back to index, because the "stride"
+				// should be MAX_COLS and not ai._board._width.
+				Position pos = other.pos();
+				size_t i = pos.row * Position::MAX_COLS + pos.col;
+				data[offset + i] = (int8_t) order.tiletype;
+			}
+		}
+		break;
+	}
+	offset += PLANESIZE;
+
+	DEBUG_ASSERT(offset + PLANESIZE <= data.size());
+	switch (order.type)
+	{
+		case Order::Type::NONE:
+		case Order::Type::MOVE:
+		case Order::Type::GUARD:
+		case Order::Type::FOCUS:
+		case Order::Type::LOCKDOWN:
+		case Order::Type::SHELL:
+		case Order::Type::BOMBARD:
+		case Order::Type::BOMB:
+		case Order::Type::CAPTURE:
+		case Order::Type::EXPAND:
+		case Order::Type::SHAPE:
+		case Order::Type::SETTLE:
+		case Order::Type::UPGRADE:
+		case Order::Type::CULTIVATE:
+		case Order::Type::HALT:
+		{
+			std::fill(data.begin() + offset, data.begin() + offset + PLANESIZE,
+				0);
+		}
+		break;
+		case Order::Type::PRODUCE:
+		{
+			std::fill(data.begin() + offset, data.begin() + offset + PLANESIZE,
+				0);
+			Position pos = order.target.position;
+			size_t i = pos.row * Position::MAX_COLS + pos.col;
+			data[offset + i] = (int8_t) order.unittype;
+		}
+		break;
+	}
+	offset += PLANESIZE;
+}
+#endif
+
+std::vector<int8_t> NeuralNewtBrain::encode(const AICommander& ai)
+{
+	DEBUG_ASSERT(TILETYPE_SIZE < 128);
+	DEBUG_ASSERT(UNITTYPE_SIZE < 128);
+	DEBUG_ASSERT(PLAYER_SIZE < 128);
+
+	std::vector<int8_t> data(NUM_PLANES * PLANESIZE);
+
+	for (Cell index : ai._board)
+	{
+		Position pos = index.pos();
+		DEBUG_ASSERT(pos.row >= 0 && pos.row <= Position::MAX_ROWS);
+		DEBUG_ASSERT(pos.col >= 0 && pos.col <= Position::MAX_COLS);
+		size_t i = pos.row * Position::MAX_COLS + pos.col;
+
+		const TileToken& tile = ai._board.tile(index);
+		data[plix(P_TILETYPE, i)] = (int8_t) tile.type;
+		data[plix(P_TILEOWNER, i)] = (int8_t) ((tile.owner == ai._player)
+			? Player::SELF : tile.owner);
+		data[plix(P_TILESTACKS, i)] = tile.stacks;
+		data[plix(P_TILEPOWER, i)] = tile.power;
+
+		const UnitToken& ground = ai._board.ground(index);
+		data[plix(P_GROUNDTYPE, i)] = (int8_t) ground.type;
+		data[plix(P_GROUNDOWNER, i)] = (int8_t) ((ground.owner == ai._player)
+			? Player::SELF : ground.owner);
+		data[plix(P_GROUNDSTACKS, i)] = ground.stacks;
+
+		const UnitToken& air = ai._board.air(index);
+		data[plix(P_AIRTYPE, i)] = (int8_t) air.type;
+		data[plix(P_AIROWNER, i)] = (int8_t) ((air.owner == ai._player)
+			? Player::SELF : air.owner);
+		data[plix(P_AIRSTACKS, i)] = air.stacks;
+
+		DEBUG_ASSERT(ai._board.bypass(index).type == UnitType::NONE);
+
+		DEBUG_ASSERT(ai._board.temperature(index) == 0);
+		data[plix(P_HUMIDITY, i)] = ai._board.humidity(index);
+		data[plix(P_CHAOS, i)] = ai._board.chaos(index);
+		data[plix(P_GAS, i)] = ai._board.gas(index);
+		DEBUG_ASSERT(ai._board.radiation(index) == 0);
+
+		data[plix(P_SNOW, i)] = ai._board.snow(index);
+		data[plix(P_FROSTBITE, i)] = ai._board.frostbite(index);
+		data[plix(P_FIRESTORM, i)] = ai._board.firestorm(index);
+		data[plix(P_BONEDROUGHT, i)] = ai._board.bonedrought(index);
+		data[plix(P_DEATH, i)] = ai._board.death(index);
+
+		data[plix(P_VISION, i)] = ai._board.current(index);
+	}
+
+	size_t i = NUM_BOARDPLANES * PLANESIZE;
+
+#ifdef ORDERSENCODED
+	// The cap on old orders is not enforced by the Automaton, and it is not
+	// an error if this occurs in release. But we think this will not occur in
+	// real games, so we use a debug assertion to confirm that suspicion.
+	DEBUG_ASSERT(ai._unfinishedOrders.size() <= OLDORDERSCAP);
+	// The cap on new orders is relatively save because we will not change
+	// Bible::newOrderLimit() before release; it is not an error if this
+	// occurs in release as we will simply ignore further orders.
+	DEBUG_ASSERT(ai._newOrders.size() <= NEWORDERSCAP);
+
+	int ordernum = 0 - ((int) OLDORDERSCAP);
+
+	if (ai._unfinishedOrders.size() < OLDORDERSCAP)
+	{
+		size_t n = OLDORDERSCAP - ai._unfinishedOrders.size();
+		size_t len = n * PLANES_PER_ORDER * PLANESIZE;
+		std::fill(data.begin() + i, data.begin() + i + len, 0);
+		i += len;
+		ordernum += n;
+	}
+
+	for (const Order& order : ai._unfinishedOrders)
+	{
+		encodeOrder(ai._board, data, i, order);
+		i += PLANES_PER_ORDER * PLANESIZE;
+		ordernum += 1;
+		if (ordernum >= 0) break;
+	}
+
+	DEBUG_ASSERT(ordernum == 0);
+
+	for (const Order& order : ai._newOrders)
+	{
+		encodeOrder(ai._board, data, i, order);
+		i += PLANES_PER_ORDER * PLANESIZE;
+		ordernum += 1;
+		if ((size_t) ordernum >= NEWORDERSCAP) break;
+	}
+
+	if ((size_t) ordernum < NEWORDERSCAP)
+	{
+		size_t n = NEWORDERSCAP - ordernum;
+		size_t len = n * PLANES_PER_ORDER * PLANESIZE;
+		std::fill(data.begin() + i, data.begin() + i + len, 0);
+		i += len;
+		ordernum += n;
+	}
+
+	DEBUG_ASSERT(ordernum == NEWORDERSCAP);
+#else
+	// For now we only store the number of old and new orders.
+	// The cap on old orders is not enforced by the Automaton, and it is not
+	// an error if this occurs in release. But we think this will not occur in
+	// real games, so we use a debug assertion to confirm that suspicion.
+	DEBUG_ASSERT(ai._unfinishedOrders.size() < 128);
+	DEBUG_ASSERT(i + PLANESIZE <= data.size());
+	std::fill(data.begin() + i, data.begin() + i + PLANESIZE,
+		(int8_t) std::min(ai._unfinishedOrders.size(), (size_t) 127));
+	i += PLANESIZE;
+	DEBUG_ASSERT(ai._newOrders.size() < 128);
+	DEBUG_ASSERT(i + PLANESIZE <= data.size());
+	std::fill(data.begin() + i, data.begin() + i + PLANESIZE,
+		(int8_t) std::min(ai._newOrders.size(), (size_t) 127));
+	i += PLANESIZE;
+#endif
+
+	// It is probably best to store the money continuously, so we have it spill
+	// over into "buckets". So 100 is stored as (100, 0, 0, ...), 101 is stored
+	// as (100, 1, 0, ...) and e.g. 274 is stored as (100, 100, 74, 0, ...).
+	DEBUG_ASSERT(ai._money >= 0);
+	for (int offset = 0; offset < 1000; offset += 100)
+	{
+		DEBUG_ASSERT(i + PLANESIZE <= data.size());
+		std::fill(data.begin() + i, data.begin() + i + PLANESIZE,
+			(int8_t) std::min(std::max(0, ai._money - offset), 100));
+		i += PLANESIZE;
+	}
+
+	// Everything past year 100 is "extreme lategame" anyway.
+	DEBUG_ASSERT(ai._year >= 0);
+	DEBUG_ASSERT(i + PLANESIZE <= data.size());
+	std::fill(data.begin() + i, data.begin() + i + PLANESIZE,
+		(int8_t) std::min(std::max(0, ai._year), 100));
+	i += PLANESIZE;
+
+	DEBUG_ASSERT(SEASON_SIZE < 128);
+	DEBUG_ASSERT(i + PLANESIZE <= data.size());
+	std::fill(data.begin() + i, data.begin() + i + PLANESIZE,
+		(int8_t) ai._season);
+	i += PLANESIZE;
+
+	DEBUG_ASSERT(DAYTIME_SIZE < 128);
+	DEBUG_ASSERT(i + PLANESIZE <= data.size());
+	std::fill(data.begin() + i, data.begin() + i + PLANESIZE,
+		(int8_t) ai._daytime);
+	i += PLANESIZE;
+
+	// The phase is always PLANNING.
+
+	DEBUG_ASSERT(i == data.size());
+
+	return data;
+}
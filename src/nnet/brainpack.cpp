@@ -0,0 +1,200 @@
+/**
+ * Part of Epicinium NeuralNewt
+ * developed by A Bunch of Hacks.
+ *
+ * Copyright (c) 2020 A Bunch of Hacks
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * [authors:]
+ * Daan Mulder (daan@abunchofhacks.coop)
+ */
+
+#include "brainpack.hpp"
+
+#include <cstring>
+#include <stdexcept>
+
+#include "mappedfile.hpp"
+#include "atomicfile.hpp"
+
+
+static const char PACK_MAGIC[8] = {'N', 'N', 'B', 'P', 'A', 'C', 'K', '\0'};
+static const uint32_t PACK_VERSION = 1;
+
+static uint64_t align(uint64_t offset)
+{
+	return (offset + BrainPack::ALIGNMENT - 1)
+		/ BrainPack::ALIGNMENT * BrainPack::ALIGNMENT;
+}
+
+size_t BrainPack::elementSize(Dtype dtype)
+{
+	switch (dtype)
+	{
+		case Dtype::FLOAT32: return 4;
+		case Dtype::FLOAT16: return 2;
+	}
+	throw std::runtime_error("Unknown brain pack dtype");
+}
+
+void BrainPack::save(const std::string& filepath, Dtype dtype,
+	const std::vector<Tensor>& layout,
+	const std::vector<std::string>& names,
+	const std::vector<std::vector<const void*>>& blocks)
+{
+	if (names.size() != blocks.size())
+	{
+		throw std::runtime_error("Number of names does not match number of"
+			" brains while writing " + filepath);
+	}
+
+	Header header;
+	std::memset(&header, 0, sizeof(Header));
+	std::memcpy(header.magic, PACK_MAGIC, sizeof(PACK_MAGIC));
+	header.version = PACK_VERSION;
+	header.dtype = dtype;
+	header.numTensors = layout.size();
+	header.numBrains = names.size();
+
+	std::vector<TensorEntry> tensors(layout.size());
+	uint64_t offset = 0;
+	for (size_t t = 0; t < layout.size(); t++)
+	{
+		if (layout[t].name.size() > MAX_TENSOR_NAME_LENGTH)
+		{
+			throw std::runtime_error("Tensor name " + layout[t].name
+				+ " is too long to be packed");
+		}
+		std::memset(&tensors[t], 0, sizeof(TensorEntry));
+		std::memcpy(tensors[t].name, layout[t].name.data(),
+			layout[t].name.size());
+		tensors[t].numel = layout[t].numel;
+		tensors[t].offset = offset;
+		offset = align(offset + layout[t].numel * elementSize(dtype));
+	}
+	header.blockSize = offset;
+
+	std::vector<NameEntry> entries(names.size());
+	for (size_t i = 0; i < names.size(); i++)
+	{
+		if (names[i].size() > MAX_NAME_LENGTH)
+		{
+			throw std::runtime_error("Brain name " + names[i]
+				+ " is too long to be packed");
+		}
+		if (blocks[i].size() != layout.size())
+		{
+			throw std::runtime_error("Brain " + names[i] + " does not have"
+				" the expected number of tensors");
+		}
+		std::memset(&entries[i], 0, sizeof(NameEntry));
+		std::memcpy(entries[i].name, names[i].data(), names[i].size());
+	}
+
+	header.dataOffset = align(sizeof(Header)
+		+ tensors.size() * sizeof(TensorEntry)
+		+ entries.size() * sizeof(NameEntry));
+
+	AtomicFile file(filepath);
+
+	static const char zeroes[ALIGNMENT] = {0};
+	file.write(&header, sizeof(Header));
+	file.write(tensors.data(), tensors.size() * sizeof(TensorEntry));
+	file.write(entries.data(), entries.size() * sizeof(NameEntry));
+	uint64_t position = sizeof(Header) + tensors.size() * sizeof(TensorEntry)
+		+ entries.size() * sizeof(NameEntry);
+	file.write(zeroes, header.dataOffset - position);
+
+	for (const auto& block : blocks)
+	{
+		position = 0;
+		for (size_t t = 0; t < layout.size(); t++)
+		{
+			size_t bytes = layout[t].numel * elementSize(dtype);
+			file.write(block[t], bytes);
+			position += bytes;
+			uint64_t next = (t + 1 < layout.size())
+				? tensors[t + 1].offset : header.blockSize;
+			file.write(zeroes, next - position);
+			position = next;
+		}
+	}
+
+	file.commit();
+}
+
+BrainPack::BrainPack(const std::string& filepath) :
+	_file(std::make_shared<MappedFile>(filepath))
+{
+	const char* data = _file->data();
+	size_t size = _file->size();
+	if (size < sizeof(Header)
+		|| std::memcmp(data, PACK_MAGIC, sizeof(PACK_MAGIC)) != 0)
+	{
+		throw std::runtime_error("File " + filepath + " is not a brain pack");
+	}
+	_header = (const Header*) data;
+	if (_header->version != PACK_VERSION)
+	{
+		throw std::runtime_error("Brain pack " + filepath + " has unsupported"
+			" version " + std::to_string(_header->version));
+	}
+	if (_header->dtype != Dtype::FLOAT32 && _header->dtype != Dtype::FLOAT16)
+	{
+		throw std::runtime_error("Brain pack " + filepath + " has unknown"
+			" dtype");
+	}
+	uint64_t indexEnd = sizeof(Header)
+		+ uint64_t(_header->numTensors) * sizeof(TensorEntry)
+		+ uint64_t(_header->numBrains) * sizeof(NameEntry);
+	if (indexEnd > _header->dataOffset
+		|| _header->dataOffset % ALIGNMENT != 0
+		|| _header->dataOffset > size
+		|| (_header->numBrains > 0 && (_header->blockSize == 0
+			|| _header->numBrains
+				> (size - _header->dataOffset) / _header->blockSize)))
+	{
+		throw std::runtime_error("Brain pack " + filepath + " is truncated");
+	}
+	_tensors = (const TensorEntry*) (data + sizeof(Header));
+	_names = (const NameEntry*) (_tensors + _header->numTensors);
+	for (size_t t = 0; t < _header->numTensors; t++)
+	{
+		if (_tensors[t].offset % ALIGNMENT != 0
+			|| _tensors[t].offset + _tensors[t].numel * elementSize(dtype())
+				> _header->blockSize)
+		{
+			throw std::runtime_error("Brain pack " + filepath + " has an"
+				" invalid tensor layout");
+		}
+	}
+}
+
+std::string BrainPack::name(size_t i) const
+{
+	const char* name = _names[i].name;
+	return std::string(name, strnlen(name, MAX_NAME_LENGTH + 1));
+}
+
+std::string BrainPack::tensorName(size_t t) const
+{
+	const char* name = _tensors[t].name;
+	return std::string(name, strnlen(name, MAX_TENSOR_NAME_LENGTH + 1));
+}
+
+const void* BrainPack::data(size_t i, size_t t) const
+{
+	return _file->data() + _header->dataOffset + i * _header->blockSize
+		+ _tensors[t].offset;
+}
@@ -0,0 +1,113 @@
+/**
+ * Part of Epicinium NeuralNewt
+ * developed by A Bunch of Hacks.
+ *
+ * Copyright (c) 2020 A Bunch of Hacks
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * [authors:]
+ * Daan Mulder (daan@abunchofhacks.coop)
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstdint>
+
+class MappedFile;
+
+
+// A packed checkpoint holds the weights of any number of brains with the same
+// architecture in a single file:
+//
+//   Header
+//   TensorEntry[numTensors]    the layout of the parameters of one brain
+//   NameEntry[numBrains]       the name of each brain
+//   (padding)
+//   numBrains blocks of blockSize bytes, starting at dataOffset
+//
+// Every tensor inside a block starts at an ALIGNMENT-aligned offset, so the
+// raw fp32 or fp16 data can be used directly from a memory mapping.
+class BrainPack
+{
+public:
+	static const size_t ALIGNMENT = 64;
+	static const size_t MAX_NAME_LENGTH = 71;
+	static const size_t MAX_TENSOR_NAME_LENGTH = 31;
+
+	enum class Dtype : uint32_t
+	{
+		FLOAT32 = 0,
+		FLOAT16 = 1,
+	};
+
+	struct Header
+	{
+		char magic[8];
+		uint32_t version;
+		Dtype dtype;
+		uint32_t numTensors;
+		uint32_t numBrains;
+		uint64_t blockSize;
+		uint64_t dataOffset;
+	};
+
+	struct TensorEntry
+	{
+		char name[MAX_TENSOR_NAME_LENGTH + 1];
+		uint64_t numel;
+		uint64_t offset;
+	};
+
+	struct NameEntry
+	{
+		char name[MAX_NAME_LENGTH + 1];
+	};
+
+	struct Tensor
+	{
+		std::string name;
+		size_t numel;
+	};
+
+	static size_t elementSize(Dtype dtype);
+
+	// Writes a pack with the given tensor layout, where blocks[i][t] points to
+	// the contiguous data of tensor t of the brain named names[i]. The file
+	// is replaced atomically, so a reader never sees a partial pack.
+	static void save(const std::string& filepath, Dtype dtype,
+		const std::vector<Tensor>& layout,
+		const std::vector<std::string>& names,
+		const std::vector<std::vector<const void*>>& blocks);
+
+private:
+	std::shared_ptr<MappedFile> _file;
+	const Header* _header;
+	const TensorEntry* _tensors;
+	const NameEntry* _names;
+
+public:
+	explicit BrainPack(const std::string& filepath);
+
+	size_t size() const { return _header->numBrains; }
+	Dtype dtype() const { return _header->dtype; }
+	size_t numTensors() const { return _header->numTensors; }
+
+	std::string name(size_t i) const;
+	std::string tensorName(size_t t) const;
+	size_t numel(size_t t) const { return _tensors[t].numel; }
+	const void* data(size_t i, size_t t) const;
+};
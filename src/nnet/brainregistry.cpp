@@ -0,0 +1,234 @@
+/**
+ * Part of Epicinium NeuralNewt
+ * developed by A Bunch of Hacks.
+ *
+ * Copyright (c) 2020 A Bunch of Hacks
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * [authors:]
+ * Daan Mulder (daan@abunchofhacks.coop)
+ */
+
+
+#include "brainregistry.hpp"
+
+#include <vector>
+#include <stdexcept>
+#ifndef NEURALNEWT_LITE
+#include <torch/torch.h>
+#endif
+
+#include "setting.hpp"
+#include "folders.hpp"
+#include "network.hpp"
+#include "brainpack.hpp"
+#ifdef NEURALNEWT_LITE
+#include "litenetwork.hpp"
+#else
+#include "module.hpp"
+#include "neuralnewtbrain.hpp"
+#endif
+
+
+BrainRegistry::BrainRegistry(const Settings& settings,
+		const std::string& folder, size_t budget) :
+	_settings(settings),
+	_folder(folder),
+	_budget(budget),
+	_bytes(0),
+	_clock(0)
+{}
+
+static bool isPack(const std::string& filepath)
+{
+	static const std::string extension = ".pack";
+	return filepath.size() >= extension.size()
+		&& filepath.compare(filepath.size() - extension.size(),
+			extension.size(), extension) == 0;
+}
+
+std::string BrainRegistry::resolve(const std::string& difficulty,
+	const std::string& ruleset) const
+{
+	auto found = _overrides.find(difficulty + "/" + ruleset);
+	if (found != _overrides.end()) return found->second;
+	found = _overrides.find(difficulty + "/");
+	if (found != _overrides.end()) return found->second;
+
+	std::vector<std::string> candidates;
+	if (!difficulty.empty())
+	{
+		if (!ruleset.empty())
+		{
+			candidates.push_back(_folder + "/" + difficulty + "-" + ruleset
+				+ ".pack");
+		}
+		candidates.push_back(_folder + "/" + difficulty + ".pack");
+	}
+	candidates.push_back(_folder + "/default.pack");
+	for (const std::string& candidate : candidates)
+	{
+		if (pathExists(candidate)) return candidate;
+	}
+	return _folder + "/default.brain";
+}
+
+#ifdef NEURALNEWT_LITE
+std::shared_ptr<const Network> BrainRegistry::load(
+	const std::string& filepath, size_t& bytes)
+{
+	if (!isPack(filepath))
+	{
+		throw std::runtime_error("Cannot load " + filepath + " without"
+			" libtorch; convert it to a pack with main --convert");
+	}
+	auto network = std::make_shared<const LiteNetwork>(
+		std::make_shared<const BrainPack>(filepath), 0);
+	bytes = network->parameterBytes();
+	return network;
+}
+#else
+static size_t moduleBytes(const Module& module)
+{
+	size_t bytes = 0;
+	for (const auto& parameter : module.parameters())
+	{
+		bytes += parameter.numel() * parameter.element_size();
+	}
+	return bytes;
+}
+
+std::shared_ptr<const Network> BrainRegistry::load(
+	const std::string& filepath, size_t& bytes)
+{
+	auto module = std::make_shared<Module>(_settings.numChannels);
+	auto name = std::make_shared<RestoredBrainName>("served", 0);
+	NeuralNewtBrain brain(module, _settings, name);
+	if (isPack(filepath))
+	{
+		// The weights stay in the mapping, which is shared with every other
+		// process that serves the same pack.
+		brain.attach(std::make_shared<const BrainPack>(filepath), 0);
+	}
+	else
+	{
+		size_t slash = filepath.find_last_of('/');
+		if (slash == std::string::npos) brain.load(".", filepath);
+		else brain.load(filepath.substr(0, slash), filepath.substr(slash + 1));
+	}
+	bytes = moduleBytes(*module);
+	return module;
+}
+#endif
+
+// Must be called with the lock held.
+const BrainRegistry::Entry& BrainRegistry::acquire(
+	const std::string& filepath)
+{
+	auto found = _entries.find(filepath);
+	if (found == _entries.end())
+	{
+		size_t bytes = 0;
+		std::shared_ptr<const Network> network = load(filepath, bytes);
+		found = _entries.emplace(filepath, Entry{network, bytes, 0}).first;
+		_bytes += bytes;
+	}
+	found->second.lastUsed = ++_clock;
+	return found->second;
+}
+
+// Drops replaced brains that are no longer in use. Must be called with the
+// lock held.
+void BrainRegistry::release()
+{
+	for (auto it = _retired.begin(); it != _retired.end(); /**/)
+	{
+		if (it->network.use_count() > 1)
+		{
+			++it;
+			continue;
+		}
+		_bytes -= it->bytes;
+		it = _retired.erase(it);
+	}
+}
+
+// Must be called with the lock held.
+void BrainRegistry::evict()
+{
+	release();
+	while (_budget > 0 && _bytes > _budget)
+	{
+		// Brains that are still in use would not be freed by dropping them,
+		// and would be loaded a second time when they are needed again.
+		auto victim = _entries.end();
+		for (auto it = _entries.begin(); it != _entries.end(); ++it)
+		{
+			if (it->second.network.use_count() > 1) continue;
+			if (victim == _entries.end()
+				|| it->second.lastUsed < victim->second.lastUsed)
+			{
+				victim = it;
+			}
+		}
+		if (victim == _entries.end()) return;
+		_bytes -= victim->second.bytes;
+		_entries.erase(victim);
+	}
+}
+
+std::shared_ptr<const Network> BrainRegistry::get(
+	const std::string& difficulty, const std::string& ruleset)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	// Keep a reference while evicting, so the brain itself is not dropped.
+	std::shared_ptr<const Network> network =
+		acquire(resolve(difficulty, ruleset)).network;
+	evict();
+	return network;
+}
+
+void BrainRegistry::swap(const std::string& difficulty,
+	const std::string& ruleset, const std::string& filepath)
+{
+	// Load outside of the lock, so AIs can still be allocated meanwhile.
+	size_t bytes = 0;
+	std::shared_ptr<const Network> network = load(filepath, bytes);
+
+	std::lock_guard<std::mutex> lock(_mutex);
+	auto found = _entries.find(filepath);
+	if (found != _entries.end())
+	{
+		// AIs that are still playing keep the old brain in memory.
+		_retired.push_back(std::move(found->second));
+		_entries.erase(found);
+	}
+	_entries.emplace(filepath, Entry{network, bytes, ++_clock});
+	_bytes += bytes;
+	_overrides[difficulty + "/" + ruleset] = filepath;
+	evict();
+}
+
+size_t BrainRegistry::size()
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	return _entries.size();
+}
+
+size_t BrainRegistry::bytes()
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	release();
+	return _bytes;
+}
@@ -0,0 +1,109 @@
+/**
+ * Part of Epicinium NeuralNewt
+ * developed by A Bunch of Hacks.
+ *
+ * Copyright (c) 2020 A Bunch of Hacks
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * [authors:]
+ * Daan Mulder (daan@abunchofhacks.coop)
+ */
+
+
+#pragma once
+
+#include <string>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+#include <mutex>
+#include <cstdint>
+
+struct Settings;
+class Network;
+
+
+// Serves the brains of the neuralnewt library, keyed by difficulty and
+// ruleset. For a difficulty "hard" and ruleset "v1.0", the first of
+//
+//   a brain installed with swap("hard", "v1.0", ...)
+//   a brain installed with swap("hard", "", ...)
+//   [folder]/hard-v1.0.pack
+//   [folder]/hard.pack
+//   [folder]/default.pack or [folder]/default.brain
+//
+// is used. Brains are loaded the first time they are needed and every AI
+// using the same file shares the same read-only weights. When the loaded
+// brains exceed the memory budget, the least recently used brains that no
+// AI is using anymore are dropped. Brains replaced by swap() count against
+// the budget until the last AI using them is gone.
+//
+// If the library is built with NEURALNEWT_LITE, brains are evaluated by a
+// LiteNetwork without libtorch and only brain packs can be loaded.
+class BrainRegistry
+{
+private:
+	struct Entry
+	{
+		std::shared_ptr<const Network> network;
+		size_t bytes;
+		uint64_t lastUsed;
+	};
+
+	const Settings& _settings;
+	std::string _folder;
+	size_t _budget;
+	std::unordered_map<std::string, Entry> _entries;
+	std::unordered_map<std::string, std::string> _overrides;
+	// Replaced brains that AIs are still using.
+	std::vector<Entry> _retired;
+	size_t _bytes;
+	uint64_t _clock;
+	std::mutex _mutex;
+
+public:
+	// A budget of 0 bytes means that brains are never dropped.
+	BrainRegistry(const Settings& settings, const std::string& folder,
+		size_t budget);
+	BrainRegistry(const BrainRegistry&) = delete;
+	BrainRegistry(BrainRegistry&&) = delete;
+	BrainRegistry& operator=(const BrainRegistry&) = delete;
+	BrainRegistry& operator=(BrainRegistry&&) = delete;
+	~BrainRegistry() = default;
+
+private:
+	std::string resolve(const std::string& difficulty,
+		const std::string& ruleset) const;
+	std::shared_ptr<const Network> load(const std::string& filepath,
+		size_t& bytes);
+	const Entry& acquire(const std::string& filepath);
+	void release();
+	void evict();
+
+public:
+	// Pass empty strings to get the default brain.
+	std::shared_ptr<const Network> get(const std::string& difficulty,
+		const std::string& ruleset);
+
+	// Loads the brain in the given file and uses it for all AIs allocated
+	// from now on with this difficulty and ruleset, or with this difficulty
+	// and any ruleset if the ruleset is empty. AIs that are already playing
+	// keep their brain. If the file was loaded before, it is reloaded.
+	// Throws and leaves the registry unchanged if the brain cannot be loaded.
+	void swap(const std::string& difficulty, const std::string& ruleset,
+		const std::string& filepath);
+
+	size_t size();
+	size_t bytes();
+};
@@ -0,0 +1,170 @@
+/**
+ * Part of Epicinium NeuralNewt
+ * developed by A Bunch of Hacks.
+ *
+ * Copyright (c) 2020 A Bunch of Hacks
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * [authors:]
+ * Daan Mulder (daan@abunchofhacks.coop)
+ */
+
+#include "brainstore.hpp"
+
+#include <fstream>
+#include <unordered_set>
+#include <stdexcept>
+#include <ctime>
+#include <cstdio>
+#include <sys/stat.h>
+#include <utime.h>
+
+#include "libs/openssl/sha.h"
+
+#include "folders.hpp"
+
+
+const std::string BrainStore::PREFIX = "sha256:";
+
+BrainStore::BrainStore(const std::string& folder) :
+	_folder(folder)
+{}
+
+std::string BrainStore::path(const std::string& hash) const
+{
+	// Objects are spread over subfolders to keep the folders small.
+	return _folder + "/" + hash.substr(0, 2) + "/" + hash + ".pack";
+}
+
+bool BrainStore::contains(const std::string& hash) const
+{
+	return pathExists(path(hash));
+}
+
+std::string BrainStore::put(BrainPack::Dtype dtype,
+	const std::vector<BrainPack::Tensor>& layout,
+	const std::vector<const void*>& block, bool& written)
+{
+	// The layout is part of the hash, so brains with different architectures
+	// or precisions never share an object.
+	SHA256_CTX ctx;
+	SHA256_Init(&ctx);
+	uint32_t type = uint32_t(dtype);
+	SHA256_Update(&ctx, &type, sizeof(type));
+	for (size_t t = 0; t < layout.size(); t++)
+	{
+		uint64_t numel = layout[t].numel;
+		SHA256_Update(&ctx, layout[t].name.data(), layout[t].name.size() + 1);
+		SHA256_Update(&ctx, &numel, sizeof(numel));
+		SHA256_Update(&ctx, block[t],
+			layout[t].numel * BrainPack::elementSize(dtype));
+	}
+	uint8_t digest[SHA256_DIGEST_LENGTH];
+	SHA256_Final(digest, &ctx);
+	char buffer[SHA256_DIGEST_LENGTH * 2 + 1];
+	for (size_t i = 0; i < SHA256_DIGEST_LENGTH; i++)
+	{
+		sprintf(buffer + i * 2, "%02x", digest[i]);
+	}
+	std::string hash(buffer);
+
+	written = !contains(hash);
+	if (written)
+	{
+		makeFolder(_folder);
+		makeFolder(_folder + "/" + hash.substr(0, 2));
+		try
+		{
+			BrainPack::save(path(hash), dtype, layout, {hash}, {block});
+		}
+		catch (const std::runtime_error&)
+		{
+			// Another writer may have stored the same object in the meantime,
+			// and its content is identical by construction.
+			if (!contains(hash)) throw;
+			written = false;
+		}
+	}
+	else
+	{
+		// Refresh the modification time, so that collectGarbage() does not
+		// delete the object before the new reference to it has been written.
+		utime(path(hash).c_str(), nullptr);
+	}
+	return hash;
+}
+
+BrainPack BrainStore::get(const std::string& hash) const
+{
+	if (!contains(hash))
+	{
+		throw std::runtime_error("Brain " + PREFIX + hash + " is not in store "
+			+ _folder);
+	}
+	return BrainPack(path(hash));
+}
+
+size_t BrainStore::collectGarbage(const std::string& brainsFolder,
+	long minAge, bool dryRun, size_t& freedBytes) const
+{
+	std::unordered_set<std::string> referenced;
+	for (const std::string& session : listFolder(brainsFolder))
+	{
+		std::string folder = brainsFolder + "/" + session;
+		for (const std::string& filename : listFolder(folder))
+		{
+			if (filename.compare(0, 5, "round") != 0
+				|| filename.size() < 4
+				|| filename.compare(filename.size() - 4, 4, ".txt") != 0)
+			{
+				continue;
+			}
+			std::ifstream file(folder + "/" + filename);
+			std::string line;
+			while (std::getline(file, line))
+			{
+				size_t pos = line.find(PREFIX);
+				if (pos == std::string::npos) continue;
+				referenced.insert(line.substr(pos + PREFIX.size()));
+			}
+		}
+	}
+
+	size_t count = 0;
+	std::time_t now = std::time(nullptr);
+	for (const std::string& subfolder : listFolder(_folder))
+	{
+		std::string folder = _folder + "/" + subfolder;
+		for (const std::string& filename : listFolder(folder))
+		{
+			if (filename.size() < 5
+				|| filename.compare(filename.size() - 5, 5, ".pack") != 0)
+			{
+				continue;
+			}
+			std::string hash = filename.substr(0, filename.size() - 5);
+			if (referenced.count(hash)) continue;
+			std::string filepath = path(hash);
+			struct stat buffer;
+			if (stat(filepath.c_str(), &buffer) != 0) continue;
+			if (now - buffer.st_mtime < minAge) continue;
+			if (dryRun || std::remove(filepath.c_str()) == 0)
+			{
+				freedBytes += buffer.st_size;
+				count++;
+			}
+		}
+	}
+	return count;
+}
@@ -0,0 +1,64 @@
+/**
+ * Part of Epicinium NeuralNewt
+ * developed by A Bunch of Hacks.
+ *
+ * Copyright (c) 2020 A Bunch of Hacks
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * [authors:]
+ * Daan Mulder (daan@abunchofhacks.coop)
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "brainpack.hpp"
+
+
+// A content-addressed store of brains that is shared between sessions. Each
+// object is a brain pack holding a single brain, named after the SHA-256 hash
+// of its weights, so identical brains are only ever written once. Session
+// manifests refer to brains as "sha256:<hash>".
+class BrainStore
+{
+public:
+	static const std::string PREFIX;
+
+private:
+	std::string _folder;
+
+public:
+	explicit BrainStore(const std::string& folder);
+
+	std::string path(const std::string& hash) const;
+	bool contains(const std::string& hash) const;
+
+	// Stores a brain with the given layout unless an identical brain has
+	// already been stored. Returns the hash under which it is stored.
+	std::string put(BrainPack::Dtype dtype,
+		const std::vector<BrainPack::Tensor>& layout,
+		const std::vector<const void*>& block, bool& written);
+
+	BrainPack get(const std::string& hash) const;
+
+	// Removes every object that is not referenced by a round list in one of
+	// the session folders inside brainsFolder. Objects younger than minAge
+	// seconds are kept, because a running session might not have written the
+	// round list that refers to them yet. Returns the number of removed
+	// objects and adds the freed bytes to freedBytes.
+	size_t collectGarbage(const std::string& brainsFolder, long minAge,
+		bool dryRun, size_t& freedBytes) const;
+};
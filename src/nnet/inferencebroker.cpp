@@ -0,0 +1,256 @@
+/**
+ * Part of Epicinium NeuralNewt
+ * developed by A Bunch of Hacks.
+ *
+ * Copyright (c) 2020 A Bunch of Hacks
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * [authors:]
+ * Daan Mulder (daan@abunchofhacks.coop)
+ */
+
+
+#include "inferencebroker.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+#include "network.hpp"
+
+
+InferenceBroker::InferenceBroker(size_t maxBatchSize, size_t maxWait) :
+	_maxBatchSize(std::max(maxBatchSize, size_t(1))),
+	_maxWait(maxWait),
+	_queuedCount(0),
+	_requesters(0),
+	_stopping(false),
+	_firstLatency(-1.0f),
+	_evaluationTime(0),
+	_thread(&InferenceBroker::run, this)
+{}
+
+InferenceBroker::~InferenceBroker()
+{
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_stopping = true;
+	}
+	_queued.notify_all();
+	_thread.join();
+}
+
+void InferenceBroker::configure(size_t maxBatchSize, size_t maxWait)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	_maxBatchSize = std::max(maxBatchSize, size_t(1));
+	_maxWait = std::chrono::microseconds(maxWait);
+}
+
+void InferenceBroker::addRequester()
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	_requesters++;
+}
+
+void InferenceBroker::removeRequester()
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	_requesters--;
+}
+
+void InferenceBroker::evaluate(const Network& network, const int8_t* input,
+	size_t count, float* output)
+{
+	if (count == 0) return;
+
+	auto start = std::chrono::steady_clock::now();
+	Request request = {&network, input, count, output, false, nullptr};
+	{
+		std::unique_lock<std::mutex> lock(_mutex);
+		_queue.push_back(&request);
+		_queuedCount += count;
+		_queued.notify_all();
+		_finished.wait(lock, [&request]() {
+			return request.done;
+		});
+		answered(start);
+	}
+	if (request.error) std::rethrow_exception(request.error);
+}
+
+bool InferenceBroker::evaluate(const Network& network, const int8_t* input,
+	size_t count, float* output, std::chrono::steady_clock::time_point deadline)
+{
+	if (count == 0) return true;
+
+	auto start = std::chrono::steady_clock::now();
+	Request request = {&network, input, count, output, false, nullptr};
+	{
+		std::unique_lock<std::mutex> lock(_mutex);
+		_queue.push_back(&request);
+		_queuedCount += count;
+		_queued.notify_all();
+		// If the request is still waiting when there is no longer time to
+		// gather and evaluate its batch, it would not be answered in time
+		// anyway.
+		auto giveUp = deadline - _evaluationTime - _maxWait;
+		if (!_finished.wait_until(lock, giveUp, [&request]() {
+				return request.done;
+			}))
+		{
+			auto found = std::find(_queue.begin(), _queue.end(), &request);
+			if (found != _queue.end())
+			{
+				_queue.erase(found);
+				_queuedCount -= count;
+				return false;
+			}
+			// The request is being evaluated, which cannot be interrupted.
+			_finished.wait(lock, [&request]() {
+				return request.done;
+			});
+		}
+		answered(start);
+	}
+	if (request.error) std::rethrow_exception(request.error);
+	return true;
+}
+
+// Must be called with the lock held.
+void InferenceBroker::answered(std::chrono::steady_clock::time_point start)
+{
+	if (_firstLatency < 0.0f)
+	{
+		auto end = std::chrono::steady_clock::now();
+		_firstLatency = std::chrono::duration_cast<std::chrono::microseconds>(
+			end - start).count() / 1000.0f;
+	}
+}
+
+float InferenceBroker::firstLatency()
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	return _firstLatency;
+}
+
+void InferenceBroker::run()
+{
+	std::unique_lock<std::mutex> lock(_mutex);
+	while (true)
+	{
+		_queued.wait(lock, [this]() {
+			return _stopping || !_queue.empty();
+		});
+		// Finish evaluating everything that has been queued before stopping.
+		if (_queue.empty()) return;
+
+		// Give other games a chance to join the batch.
+		if (_requesters != 1)
+		{
+			auto deadline = std::chrono::steady_clock::now() + _maxWait;
+			_queued.wait_until(lock, deadline, [this]() {
+				return _stopping || _queuedCount >= _maxBatchSize;
+			});
+		}
+		// Requests that gave up in the meantime have removed themselves.
+		if (_queue.empty()) continue;
+
+		std::vector<Request*> batch = take();
+		lock.unlock();
+
+		auto start = std::chrono::steady_clock::now();
+		process(batch);
+		auto end = std::chrono::steady_clock::now();
+
+		lock.lock();
+		// A moving average, so that a single slow batch is not decisive.
+		_evaluationTime = (7 * _evaluationTime
+			+ std::chrono::duration_cast<std::chrono::microseconds>(
+				end - start)) / 8;
+		for (Request* request : batch)
+		{
+			request->done = true;
+		}
+		_finished.notify_all();
+	}
+}
+
+// Takes the oldest request and any later requests for the same network, up to
+// maxBatchSize board states in total. Must be called with the lock held.
+std::vector<InferenceBroker::Request*> InferenceBroker::take()
+{
+	std::vector<Request*> batch;
+	if (_queue.empty()) return batch;
+	const Network* network = _queue.front()->network;
+	size_t count = 0;
+	for (auto it = _queue.begin(); it != _queue.end();)
+	{
+		Request* request = *it;
+		if (request->network == network
+			&& (batch.empty() || count + request->count <= _maxBatchSize))
+		{
+			batch.push_back(request);
+			count += request->count;
+			it = _queue.erase(it);
+		}
+		else ++it;
+	}
+	_queuedCount -= count;
+	return batch;
+}
+
+void InferenceBroker::process(const std::vector<Request*>& batch)
+{
+	const Network& network = *batch[0]->network;
+	try
+	{
+		// A lone request can be evaluated without copying its data.
+		if (batch.size() == 1)
+		{
+			network.evaluate(batch[0]->input, batch[0]->count,
+				batch[0]->output);
+			return;
+		}
+
+		size_t inputSize = network.inputSize();
+		size_t outputSize = network.outputSize();
+		size_t count = 0;
+		_input.clear();
+		for (const Request* request : batch)
+		{
+			_input.insert(_input.end(), request->input,
+				request->input + request->count * inputSize);
+			count += request->count;
+		}
+		_output.resize(count * outputSize);
+
+		network.evaluate(_input.data(), count, _output.data());
+
+		size_t offset = 0;
+		for (const Request* request : batch)
+		{
+			std::memcpy(request->output, _output.data() + offset,
+				request->count * outputSize * sizeof(float));
+			offset += request->count * outputSize;
+		}
+	}
+	catch (...)
+	{
+		std::exception_ptr error = std::current_exception();
+		for (Request* request : batch)
+		{
+			request->error = error;
+		}
+	}
+}
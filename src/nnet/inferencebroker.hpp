@@ -0,0 +1,113 @@
+/**
+ * Part of Epicinium NeuralNewt
+ * developed by A Bunch of Hacks.
+ *
+ * Copyright (c) 2020 A Bunch of Hacks
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * [authors:]
+ * Daan Mulder (daan@abunchofhacks.coop)
+ */
+
+
+#pragma once
+
+#include <deque>
+#include <chrono>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+#include <cstdint>
+
+class Network;
+
+
+// Collects evaluation requests from many brains and evaluates them together,
+// so that concurrent games share one forward pass instead of each running
+// their own. A batch is evaluated as soon as maxBatchSize board states are
+// waiting, or when the oldest request has waited for maxWait microseconds.
+// Only requests for the same network are batched together. If only one
+// requester has registered itself, there is no one to wait for.
+class InferenceBroker
+{
+private:
+	struct Request
+	{
+		const Network* network;
+		const int8_t* input;
+		size_t count;
+		float* output;
+		bool done;
+		std::exception_ptr error;
+	};
+
+	size_t _maxBatchSize;
+	std::chrono::microseconds _maxWait;
+	std::deque<Request*> _queue;
+	size_t _queuedCount;
+	size_t _requesters;
+	bool _stopping;
+	float _firstLatency;
+	std::chrono::microseconds _evaluationTime;
+	std::mutex _mutex;
+	std::condition_variable _queued;
+	std::condition_variable _finished;
+	std::thread _thread;
+
+	// Only used by the batching thread.
+	std::vector<int8_t> _input;
+	std::vector<float> _output;
+
+public:
+	InferenceBroker(size_t maxBatchSize, size_t maxWait);
+	InferenceBroker(const InferenceBroker&) = delete;
+	InferenceBroker(InferenceBroker&&) = delete;
+	InferenceBroker& operator=(const InferenceBroker&) = delete;
+	InferenceBroker& operator=(InferenceBroker&&) = delete;
+	~InferenceBroker();
+
+private:
+	void run();
+	std::vector<Request*> take();
+	void process(const std::vector<Request*>& batch);
+	void answered(std::chrono::steady_clock::time_point start);
+
+public:
+	// Changes the batching of requests that arrive from now on.
+	void configure(size_t maxBatchSize, size_t maxWait);
+
+	// Requesters that register themselves while they may send requests let
+	// a lone requester skip the wait for others. If none are registered,
+	// the broker always waits.
+	void addRequester();
+	void removeRequester();
+
+	// Blocks until the output of all count board states has been written.
+	// The network must outlive the call.
+	void evaluate(const Network& network, const int8_t* input, size_t count,
+		float* output);
+
+	// Like evaluate(), but gives up and returns false if the request has not
+	// been taken into a batch by the time there is, judging by recent
+	// batches, no longer enough time left to evaluate it before the deadline.
+	// A request that is already being evaluated is always finished.
+	bool evaluate(const Network& network, const int8_t* input, size_t count,
+		float* output, std::chrono::steady_clock::time_point deadline);
+
+	// The time in milliseconds it took to answer the first request, or a
+	// negative number if no request has been answered yet.
+	float firstLatency();
+};
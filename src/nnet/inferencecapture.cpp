@@ -0,0 +1,196 @@
+/**
+ * Part of Epicinium NeuralNewt
+ * developed by A Bunch of Hacks.
+ *
+ * Copyright (c) 2020 A Bunch of Hacks
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * [authors:]
+ * Daan Mulder (daan@abunchofhacks.coop)
+ */
+
+
+#include "inferencecapture.hpp"
+
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <random>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+
+#include "mappedfile.hpp"
+
+
+static const char CAPTURE_MAGIC[8] = {'N', 'N', 'C', 'A', 'P', 'T', 'R', '\0'};
+static const uint32_t CAPTURE_VERSION = 1;
+
+// Batches sampled while the writer is this far behind are dropped, so that a
+// slow disk cannot make the capture take up all memory.
+static const size_t MAX_PENDING = 256;
+
+static std::atomic<bool> _capturing(false);
+static std::mutex _mutex;
+static std::condition_variable _wakeup;
+static std::thread _thread;
+static bool _stopping = false;
+static std::vector<std::vector<int8_t>> _pending;
+static FILE* _output = nullptr;
+static std::string _outputPath;
+static size_t _outputInputSize = 0;
+static std::default_random_engine _gen;
+static std::bernoulli_distribution _dis;
+
+// Each batch is written as a whole, and the file is flushed whenever the
+// writer has caught up, so readers never see more than one partial batch.
+static void run()
+{
+	std::vector<std::vector<int8_t>> batches;
+	std::unique_lock<std::mutex> lock(_mutex);
+	while (true)
+	{
+		_wakeup.wait(lock, []{ return _stopping || !_pending.empty(); });
+		if (_pending.empty()) break;
+		batches.swap(_pending);
+		lock.unlock();
+		for (const auto& batch : batches)
+		{
+			uint32_t n = batch.size() / _outputInputSize;
+			fwrite(&n, sizeof(n), 1, _output);
+			fwrite(batch.data(), 1, batch.size(), _output);
+		}
+		fflush(_output);
+		batches.clear();
+		lock.lock();
+	}
+}
+
+void InferenceCapture::start(const std::string& filepath, size_t inputSize,
+	float chance)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	if (_output != nullptr)
+	{
+		throw std::runtime_error("Already capturing inference");
+	}
+	FILE* output = fopen(filepath.c_str(), "a+b");
+	if (output == nullptr)
+	{
+		throw std::runtime_error("Cannot open capture file " + filepath);
+	}
+	fseek(output, 0, SEEK_END);
+	if (ftell(output) == 0)
+	{
+		Header header;
+		std::memset(&header, 0, sizeof(Header));
+		std::memcpy(header.magic, CAPTURE_MAGIC, sizeof(CAPTURE_MAGIC));
+		header.version = CAPTURE_VERSION;
+		header.inputSize = inputSize;
+		fwrite(&header, sizeof(Header), 1, output);
+	}
+	else
+	{
+		// Appending boards of a different size would make the whole file
+		// unreadable, so an incompatible file is left alone.
+		Header header;
+		fseek(output, 0, SEEK_SET);
+		if (fread(&header, sizeof(Header), 1, output) != 1
+			|| std::memcmp(header.magic, CAPTURE_MAGIC,
+				sizeof(CAPTURE_MAGIC)) != 0
+			|| header.version != CAPTURE_VERSION
+			|| header.inputSize != inputSize)
+		{
+			fclose(output);
+			throw std::runtime_error("Cannot append to capture file "
+				+ filepath + ", which has a different format");
+		}
+		fseek(output, 0, SEEK_END);
+	}
+	_output = output;
+	_outputPath = filepath;
+	_outputInputSize = inputSize;
+	_gen.seed(std::random_device()());
+	_dis = std::bernoulli_distribution(chance);
+	_stopping = false;
+	_thread = std::thread(run);
+	_capturing = true;
+}
+
+void InferenceCapture::stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		if (_output == nullptr) return;
+		_capturing = false;
+		_stopping = true;
+	}
+	_wakeup.notify_all();
+	_thread.join();
+	std::lock_guard<std::mutex> lock(_mutex);
+	bool ok = (fclose(_output) == 0);
+	_output = nullptr;
+	if (!ok)
+	{
+		throw std::runtime_error("Error while writing capture file "
+			+ _outputPath);
+	}
+}
+
+void InferenceCapture::sample(const int8_t* input, size_t count)
+{
+	if (!_capturing.load(std::memory_order_relaxed)) return;
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		if (_output == nullptr || _stopping) return;
+		if (!_dis(_gen) || _pending.size() >= MAX_PENDING) return;
+		_pending.emplace_back(input, input + count * _outputInputSize);
+	}
+	_wakeup.notify_one();
+}
+
+InferenceCapture::InferenceCapture(const std::string& filepath) :
+	_file(std::make_shared<MappedFile>(filepath))
+{
+	const char* data = _file->data();
+	size_t size = _file->size();
+	if (size < sizeof(Header)
+		|| std::memcmp(data, CAPTURE_MAGIC, sizeof(CAPTURE_MAGIC)) != 0)
+	{
+		throw std::runtime_error("File " + filepath + " is not a capture");
+	}
+	const Header* header = (const Header*) data;
+	if (header->version != CAPTURE_VERSION)
+	{
+		throw std::runtime_error("Capture " + filepath + " has unsupported"
+			" version " + std::to_string(header->version));
+	}
+	_inputSize = header->inputSize;
+	if (_inputSize == 0)
+	{
+		throw std::runtime_error("Capture " + filepath + " is invalid");
+	}
+
+	size_t offset = sizeof(Header);
+	while (size - offset >= sizeof(uint32_t))
+	{
+		uint32_t count;
+		std::memcpy(&count, data + offset, sizeof(count));
+		offset += sizeof(count);
+		if (count == 0 || (size - offset) / _inputSize < count) break;
+		_batches.push_back({(const int8_t*) (data + offset), count});
+		offset += count * _inputSize;
+	}
+}
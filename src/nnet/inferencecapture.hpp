@@ -0,0 +1,82 @@
+/**
+ * Part of Epicinium NeuralNewt
+ * developed by A Bunch of Hacks.
+ *
+ * Copyright (c) 2020 A Bunch of Hacks
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * [authors:]
+ * Daan Mulder (daan@abunchofhacks.coop)
+ */
+
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstdint>
+
+class MappedFile;
+
+
+// Batches of encoded boards exactly as they were evaluated during a round,
+// so that inference can be replayed without running the automaton:
+//
+//   Header
+//   for every batch, a uint32_t count followed by count * inputSize bytes
+//
+// Batches are appended shortly after they are sampled, so a file that is
+// still being written can be read up to its last complete batch.
+class InferenceCapture
+{
+public:
+	struct Header
+	{
+		char magic[8];
+		uint32_t version;
+		uint32_t inputSize;
+	};
+
+	struct Batch
+	{
+		const int8_t* input;
+		size_t count;
+	};
+
+	// Starts appending every evaluated batch with the given chance to the
+	// file, which is created if it does not exist yet. An existing file must
+	// have been captured with the same inputSize.
+	static void start(const std::string& filepath, size_t inputSize,
+		float chance);
+
+	// Writes the batches that were sampled but not written yet and closes
+	// the file. Does nothing unless capturing has been started.
+	static void stop();
+
+	// Copies the batch, which is written to the file by a background thread.
+	// Does nothing unless capturing has been started.
+	static void sample(const int8_t* input, size_t count);
+
+private:
+	std::shared_ptr<MappedFile> _file;
+	size_t _inputSize;
+	std::vector<Batch> _batches;
+
+public:
+	explicit InferenceCapture(const std::string& filepath);
+
+	size_t inputSize() const { return _inputSize; }
+	const std::vector<Batch>& batches() const { return _batches; }
+};
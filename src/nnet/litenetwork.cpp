@@ -0,0 +1,240 @@
+/**
+ * Part of Epicinium NeuralNewt
+ * developed by A Bunch of Hacks.
+ *
+ * Copyright (c) 2020 A Bunch of Hacks
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * [authors:]
+ * Daan Mulder (daan@abunchofhacks.coop)
+ */
+
+
+#include "litenetwork.hpp"
+
+#include <stdexcept>
+#include <cmath>
+#include <algorithm>
+
+#include "libs/aftermath/newtbrain.hpp"
+#include "libs/aftermath/position.hpp"
+
+#include "neuralnewtbrain.hpp"
+#include "brainpack.hpp"
+
+
+LiteNetwork::LiteNetwork(const std::shared_ptr<const BrainPack>& pack,
+		size_t i) :
+	_pack(pack),
+	_channels(0),
+	_planes(NeuralNewtBrain::NUM_PLANES),
+	_planeX(Position::MAX_COLS),
+	_planeY(Position::MAX_ROWS),
+	_actionSize(NewtBrain::Output::SIZE)
+{
+	if (_pack->dtype() != BrainPack::Dtype::FLOAT32)
+	{
+		throw std::runtime_error("Brain " + _pack->name(i) + " does not have"
+			" float weights; convert it with main --convert");
+	}
+
+	// The tensors are stored in the order of Module::named_parameters().
+	static const char* const names[] = {
+		"conv1.weight", "conv2.weight", "conv3.weight", "conv4.weight",
+		"fc1.weight", "fc1.bias",
+		"fc2.weight", "fc2.bias",
+		"fc3.weight", "fc3.bias",
+	};
+	static const size_t numNames = sizeof(names) / sizeof(names[0]);
+	if (_pack->numTensors() != numNames)
+	{
+		throw std::runtime_error("Brain " + _pack->name(i) + " in pack has "
+			+ std::to_string(_pack->numTensors()) + " tensors, expected "
+			+ std::to_string(numNames));
+	}
+	for (size_t t = 0; t < numNames; t++)
+	{
+		if (_pack->tensorName(t) != names[t])
+		{
+			throw std::runtime_error("Tensor " + _pack->tensorName(t)
+				+ " in pack does not match " + names[t]);
+		}
+	}
+
+	// Like Module, the architecture is determined by the number of channels.
+	_channels = _pack->numel(0) / (_planes * 9);
+	size_t flat = _channels * (_planeX - 4) * (_planeY - 4);
+	const size_t expected[] = {
+		_channels * _planes * 9,
+		_channels * _channels * 9,
+		_channels * _channels * 9,
+		_channels * _channels * 9,
+		_actionSize * 2 * flat, _actionSize * 2,
+		_actionSize * _actionSize * 2, _actionSize,
+		_actionSize * _actionSize, _actionSize,
+	};
+	for (size_t t = 0; t < numNames; t++)
+	{
+		if (_pack->numel(t) != expected[t])
+		{
+			throw std::runtime_error("Tensor " + _pack->tensorName(t)
+				+ " in pack has " + std::to_string(_pack->numel(t))
+				+ " elements, expected " + std::to_string(expected[t]));
+		}
+	}
+
+	auto tensor = [this, i](size_t t) {
+		return (const float*) _pack->data(i, t);
+	};
+	_conv1 = {tensor(0), nullptr};
+	_conv2 = {tensor(1), nullptr};
+	_conv3 = {tensor(2), nullptr};
+	_conv4 = {tensor(3), nullptr};
+	_fc1 = {tensor(4), tensor(5)};
+	_fc2 = {tensor(6), tensor(7)};
+	_fc3 = {tensor(8), tensor(9)};
+}
+
+size_t LiteNetwork::inputSize() const
+{
+	return _planes * _planeX * _planeY;
+}
+
+size_t LiteNetwork::outputSize() const
+{
+	return _actionSize;
+}
+
+size_t LiteNetwork::parameterBytes() const
+{
+	size_t bytes = 0;
+	for (size_t t = 0; t < _pack->numTensors(); t++)
+	{
+		bytes += _pack->numel(t) * sizeof(float);
+	}
+	return bytes;
+}
+
+// A 3x3 convolution with stride 1 and no bias, followed by a ReLU, on planes
+// of width by height. With padding, the output has the same size as the
+// input, otherwise it is two smaller in both dimensions.
+static void conv3x3(const float* input, size_t inChannels,
+	size_t width, size_t height, const float* weight, size_t outChannels,
+	bool padding, float* output)
+{
+	size_t pad = padding ? 1 : 0;
+	size_t outWidth = width + 2 * pad - 2;
+	size_t outHeight = height + 2 * pad - 2;
+	size_t outSize = outWidth * outHeight;
+	std::fill(output, output + outChannels * outSize, 0.0f);
+	for (size_t o = 0; o < outChannels; o++)
+	{
+		float* out = output + o * outSize;
+		for (size_t c = 0; c < inChannels; c++)
+		{
+			const float* in = input + c * width * height;
+			const float* w = weight + (o * inChannels + c) * 9;
+			for (size_t kx = 0; kx < 3; kx++)
+			{
+				for (size_t ky = 0; ky < 3; ky++)
+				{
+					float k = w[kx * 3 + ky];
+					for (size_t x = 0; x < outWidth; x++)
+					{
+						// The input coordinate is x + kx - pad.
+						if (x + kx < pad || x + kx - pad >= width) continue;
+						const float* row = in + (x + kx - pad) * height;
+						size_t yBegin = (ky < pad) ? pad - ky : 0;
+						size_t yEnd = std::min(outHeight, height + pad - ky);
+						float* outRow = out + x * outHeight;
+						for (size_t y = yBegin; y < yEnd; y++)
+						{
+							outRow[y] += k * row[y + ky - pad];
+						}
+					}
+				}
+			}
+		}
+		for (size_t j = 0; j < outSize; j++)
+		{
+			out[j] = std::max(out[j], 0.0f);
+		}
+	}
+}
+
+static void linear(const float* input, size_t inSize,
+	const float* weight, const float* bias, size_t outSize, float* output)
+{
+	for (size_t o = 0; o < outSize; o++)
+	{
+		const float* w = weight + o * inSize;
+		float sum = 0.0f;
+		for (size_t j = 0; j < inSize; j++)
+		{
+			sum += w[j] * input[j];
+		}
+		output[o] = sum + bias[o];
+	}
+}
+
+void LiteNetwork::forward(const int8_t* input, float* output,
+	std::vector<float>& a, std::vector<float>& b) const
+{
+	size_t planeSize = _planeX * _planeY;
+	size_t maxSize = std::max(_planes, _channels) * planeSize;
+	a.resize(maxSize);
+	b.resize(maxSize);
+
+	std::copy(input, input + _planes * planeSize, a.begin());
+	conv3x3(a.data(), _planes, _planeX, _planeY,
+		_conv1.weight, _channels, true, b.data());
+	conv3x3(b.data(), _channels, _planeX, _planeY,
+		_conv2.weight, _channels, true, a.data());
+	conv3x3(a.data(), _channels, _planeX, _planeY,
+		_conv3.weight, _channels, false, b.data());
+	conv3x3(b.data(), _channels, _planeX - 2, _planeY - 2,
+		_conv4.weight, _channels, false, a.data());
+
+	size_t flat = _channels * (_planeX - 4) * (_planeY - 4);
+	linear(a.data(), flat, _fc1.weight, _fc1.bias, _actionSize * 2,
+		b.data());
+	for (size_t j = 0; j < _actionSize * 2; j++)
+	{
+		b[j] = std::max(b[j], 0.0f);
+	}
+	linear(b.data(), _actionSize * 2, _fc2.weight, _fc2.bias, _actionSize,
+		a.data());
+	for (size_t j = 0; j < _actionSize; j++)
+	{
+		a[j] = std::max(a[j], 0.0f);
+	}
+	linear(a.data(), _actionSize, _fc3.weight, _fc3.bias, _actionSize,
+		output);
+	for (size_t j = 0; j < _actionSize; j++)
+	{
+		output[j] = 1.0f / (1.0f + std::exp(-output[j]));
+	}
+}
+
+void LiteNetwork::evaluate(const int8_t* input, size_t count,
+	float* output) const
+{
+	// Scratch buffers are per call, so that concurrent calls are safe.
+	std::vector<float> a;
+	std::vector<float> b;
+	for (size_t n = 0; n < count; n++)
+	{
+		forward(input + n * inputSize(), output + n * _actionSize, a, b);
+	}
+}
@@ -0,0 +1,72 @@
+/**
+ * Part of Epicinium NeuralNewt
+ * developed by A Bunch of Hacks.
+ *
+ * Copyright (c) 2020 A Bunch of Hacks
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * [authors:]
+ * Daan Mulder (daan@abunchofhacks.coop)
+ */
+
+
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include "network.hpp"
+
+class BrainPack;
+
+
+// Evaluates the architecture of Module without libtorch, reading the weights
+// of a float brain pack directly from its memory mapping. This lets the
+// neuralnewt library be built without linking libtorch.
+class LiteNetwork : public Network
+{
+private:
+	struct Layer
+	{
+		const float* weight;
+		const float* bias;
+	};
+
+	std::shared_ptr<const BrainPack> _pack;
+	size_t _channels;
+	size_t _planes, _planeX, _planeY;
+	size_t _actionSize;
+	Layer _conv1, _conv2, _conv3, _conv4;
+	Layer _fc1, _fc2, _fc3;
+
+public:
+	LiteNetwork(const std::shared_ptr<const BrainPack>& pack, size_t i);
+	LiteNetwork(const LiteNetwork&) = delete;
+	LiteNetwork(LiteNetwork&&) = delete;
+	LiteNetwork& operator=(const LiteNetwork&) = delete;
+	LiteNetwork& operator=(LiteNetwork&&) = delete;
+	~LiteNetwork() = default;
+
+	virtual size_t inputSize() const override;
+	virtual size_t outputSize() const override;
+
+	virtual void evaluate(const int8_t* input, size_t count,
+		float* output) const override;
+
+	size_t parameterBytes() const;
+
+private:
+	void forward(const int8_t* input, float* output,
+		std::vector<float>& a, std::vector<float>& b) const;
+};
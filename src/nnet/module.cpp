@@ -23,37 +23,37 @@
 
 #include "module.hpp"
 
+#include <cstring>
+
 #include "libs/aftermath/newtbrain.hpp"
 #include "libs/aftermath/position.hpp"
 #include "neuralnewtbrain.hpp"
 
-#include "setting.hpp"
-
 
-Module::Module(std::unordered_map<std::string, Setting>& settings) :
-	_settings(settings),
+Module::Module(size_t channels) :
+	_channels(channels),
 	_planes(NeuralNewtBrain::NUM_PLANES),
 	_planeX(Position::MAX_COLS),
 	_planeY(Position::MAX_ROWS),
 	_actionSize(NewtBrain::Output::SIZE),
 	_conv1(register_module("conv1", torch::nn::Conv2d(torch::nn::Conv2dOptions(
 		_planes,
-		int(_settings["num_channels"]),
+		_channels,
 		3).stride(1).padding(1).bias(false)))),
 	_conv2(register_module("conv2", torch::nn::Conv2d(torch::nn::Conv2dOptions(
-		int(_settings["num_channels"]),
-		int(_settings["num_channels"]),
+		_channels,
+		_channels,
 		3).stride(1).padding(1).bias(false)))),
 	_conv3(register_module("conv3", torch::nn::Conv2d(torch::nn::Conv2dOptions(
-		int(_settings["num_channels"]),
-		int(_settings["num_channels"]),
+		_channels,
+		_channels,
 		3).stride(1).bias(false)))),
 	_conv4(register_module("conv4", torch::nn::Conv2d(torch::nn::Conv2dOptions(
-		int(_settings["num_channels"]),
-		int(_settings["num_channels"]),
+		_channels,
+		_channels,
 		3).stride(1).bias(false)))),
 	_fc1(register_module("fc1", torch::nn::Linear(
-		int(_settings["num_channels"]) * (_planeX - 4) * (_planeY - 4), _actionSize * 2))),
+		_channels * (_planeX - 4) * (_planeY - 4), _actionSize * 2))),
 	_fc2(register_module("fc2", torch::nn::Linear(_actionSize * 2, _actionSize))),
 	_fc3(register_module("fc3", torch::nn::Linear(_actionSize, _actionSize)))
 {
@@ -62,7 +62,7 @@ Module::Module(std::unordered_map<std::string, Setting>& settings) :
 }
 
 Module::Module(Module&& other) :
-	_settings(other._settings),
+	_channels(other._channels),
 	_planes(NeuralNewtBrain::NUM_PLANES),
 	_planeX(Position::MAX_COLS),
 	_planeY(Position::MAX_ROWS),
@@ -80,7 +80,7 @@ Module& Module::operator=(Module&& other)
 {
 	if (this != &other)
 	{
-		_settings = other._settings;
+		_channels = other._channels;
 		_conv1 = register_module("conv1", std::move(other._conv1));
 		_conv2 = register_module("conv2", std::move(other._conv2));
 		_conv3 = register_module("conv3", std::move(other._conv3));
@@ -94,7 +94,7 @@ Module& Module::operator=(Module&& other)
 
 void Module::reset()
 {
-	*this = Module(_settings);
+	*this = Module(_channels);
 }
 
 // This is the Conv2d::forward implementation of libtorch v1.4.0
@@ -139,8 +139,7 @@ torch::Tensor Module::forward(torch::Tensor& s) const
 	s = torch::relu(convForward(_conv2, s));
 	s = torch::relu(convForward(_conv3, s));
 	s = torch::relu(convForward(_conv4, s));
-	s = s.view({-1,
-		long(int(_settings["num_channels"]) * (_planeX - 4) * (_planeY - 4))});
+	s = s.view({-1, long(_channels * (_planeX - 4) * (_planeY - 4))});
 
 	s = torch::relu(torch::linear(s, _fc1->weight, _fc1->bias));
 	s = torch::relu(torch::linear(s, _fc2->weight, _fc2->bias));
@@ -149,3 +148,38 @@ torch::Tensor Module::forward(torch::Tensor& s) const
 
 	return torch::sigmoid(pi);
 }
+
+size_t Module::inputSize() const
+{
+	return _planes * _planeX * _planeY;
+}
+
+size_t Module::outputSize() const
+{
+	return _actionSize;
+}
+
+void Module::evaluate(const int8_t* input, size_t count, float* output) const
+{
+	// The guard is thread-local and evaluate() may be called from any thread.
+	torch::NoGradGuard no_grad;
+
+	// The input is converted to the device and type of the weights, which
+	// also makes a copy, so from_blob never writes to the caller's buffer.
+	const torch::Tensor& weight = _conv1->weight;
+	torch::Tensor s = torch::from_blob(
+		const_cast<int8_t*>(input),
+		{
+			long(count),
+			long(_planes),
+			long(_planeX),
+			long(_planeY),
+		},
+		torch::kInt8
+	).to(weight.device(), weight.scalar_type());
+
+	torch::Tensor result = forward(s).to(torch::kCPU, torch::kFloat);
+	result = result.contiguous();
+	std::memcpy(output, result.data_ptr<float>(),
+		count * _actionSize * sizeof(float));
+}
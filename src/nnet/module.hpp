@@ -25,15 +25,15 @@
 
 #include <torch/torch.h>
 
-class Setting;
+#include "network.hpp"
 
 
-class Module : public torch::nn::Cloneable<Module>
+class Module : public torch::nn::Cloneable<Module>, public Network
 {
 private:
 	friend class NeuralNewtBrain;
 
-	std::unordered_map<std::string, Setting>& _settings;
+	size_t _channels;
 	size_t _planes, _planeX, _planeY;
 	size_t _actionSize;
 	torch::nn::Conv2d _conv1;
@@ -45,7 +45,7 @@ private:
 	torch::nn::Linear _fc3;
 
 public:
-	Module(std::unordered_map<std::string, Setting>& settings);
+	explicit Module(size_t channels);
 	Module(const Module&) = default;
 	Module(Module&& other);
 	Module& operator=(const Module&) = default;
@@ -55,4 +55,10 @@ public:
 	void reset() override;
 
 	torch::Tensor forward(torch::Tensor& s) const;
+
+	virtual size_t inputSize() const override;
+	virtual size_t outputSize() const override;
+
+	virtual void evaluate(const int8_t* input, size_t count,
+		float* output) const override;
 };
@@ -0,0 +1,45 @@
+/**
+ * Part of Epicinium NeuralNewt
+ * developed by A Bunch of Hacks.
+ *
+ * Copyright (c) 2020 A Bunch of Hacks
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * [authors:]
+ * Daan Mulder (daan@abunchofhacks.coop)
+ */
+
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+
+// Anything that turns a batch of encoded board states into brain output.
+// Implementations must allow concurrent calls to evaluate().
+class Network
+{
+public:
+	virtual ~Network() = default;
+
+	// The number of bytes of a single encoded board state.
+	virtual size_t inputSize() const = 0;
+	// The number of floats of a single output.
+	virtual size_t outputSize() const = 0;
+
+	// Reads count * inputSize() bytes and writes count * outputSize() floats.
+	virtual void evaluate(const int8_t* input, size_t count,
+		float* output) const = 0;
+};
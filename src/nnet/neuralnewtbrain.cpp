@@ -34,64 +34,17 @@
 #include <torch/torch.h>
 
 #include "libs/aftermath/aicommander.hpp"
-#include "libs/aftermath/position.hpp"
-#include "libs/aftermath/board.hpp"
-#include "libs/aftermath/tiletype.hpp"
-#include "libs/aftermath/unittype.hpp"
-#include "libs/aftermath/cell.hpp"
 
 #include "setting.hpp"
+#include "folders.hpp"
+#include "counters.hpp"
+#include "profiler.hpp"
 #include "module.hpp"
+#include "brainpack.hpp"
+#include "brainstore.hpp"
+#include "inferencecapture.hpp"
 
 
-enum BoardPlane : uint8_t
-{
-	P_TILETYPE,
-	P_TILEOWNER,
-	P_TILESTACKS,
-	P_TILEPOWER,
-	P_GROUNDTYPE,
-	P_GROUNDOWNER,
-	P_GROUNDSTACKS,
-	P_AIRTYPE,
-	P_AIROWNER,
-	P_AIRSTACKS,
-	P_HUMIDITY,
-	P_CHAOS,
-	P_GAS,
-	P_SNOW,
-	P_FROSTBITE,
-	P_FIRESTORM,
-	P_BONEDROUGHT,
-	P_DEATH,
-	P_VISION,
-};
-
-static constexpr size_t NUM_BOARDPLANES = ((size_t) P_VISION) + 1;
-
-static constexpr size_t PLANESIZE = Position::MAX_ROWS * Position::MAX_COLS;
-
-static constexpr int plix(BoardPlane plane, size_t offset)
-{
-	return ((int) plane) * PLANESIZE + offset;
-}
-
-#ifdef ORDERSENCODED
-static constexpr size_t OLDORDERSCAP = 10;
-static constexpr size_t NEWORDERSCAP = 5;
-static constexpr size_t NUM_ORDERS = OLDORDERSCAP + NEWORDERSCAP;
-static constexpr size_t PLANES_PER_ORDER = 4;
-static constexpr size_t NUM_ORDERPLANES = NUM_ORDERS * PLANES_PER_ORDER;
-#else
-static constexpr size_t NUM_ORDERPLANES = 2;
-#endif
-
-static constexpr size_t NUM_MONEYPLANES = 10;
-static constexpr size_t NUM_TIMEPLANES = 3;
-
-const size_t NeuralNewtBrain::NUM_PLANES = NUM_BOARDPLANES
-	+ NUM_ORDERPLANES + NUM_MONEYPLANES + NUM_TIMEPLANES;
-
 static std::default_random_engine gen;
 
 // We are not backpropagating, so no need for gradient calculation.
@@ -196,26 +149,24 @@ std::pair<NeuralNewtBrain, NeuralNewtBrain> NeuralNewtBrain::combine(
 	return std::make_pair(std::move(coBrain1), std::move(coBrain2));
 }
 
-NeuralNewtBrain::NeuralNewtBrain(
-		std::unordered_map<std::string, Setting>& settings,
+NeuralNewtBrain::NeuralNewtBrain(const Settings& settings,
 		const BrainNamePtr& name) :
 	_settings(settings),
-	_module(new Module(settings)),
+	_module(new Module(settings.numChannels)),
 	_name(name)
 {
-	if (_settings["cuda"]) _module->to(torch::kCUDA, torch::kHalf);
+	if (_settings.cuda) _module->to(torch::kCUDA, torch::kHalf);
 	else _module->to(torch::kFloat);
 }
 
 NeuralNewtBrain::NeuralNewtBrain(
 		const std::shared_ptr<Module>& module,
-		std::unordered_map<std::string, Setting>& settings,
-		const BrainNamePtr& name) :
+		const Settings& settings, const BrainNamePtr& name) :
 	_settings(settings),
 	_module(module),
 	_name(name)
 {
-	if (_settings["cuda"]) _module->to(torch::kCUDA, torch::kHalf);
+	if (_settings.cuda) _module->to(torch::kCUDA, torch::kHalf);
 	else _module->to(torch::kFloat);
 }
 
@@ -233,334 +184,26 @@ NeuralNewtBrain::NeuralNewtBrain(const NeuralNewtBrain& brain,
 	_name(name)
 {}
 
-#ifdef ORDERSENCODED
-static inline void encodeOrder(const Board& board,
-	std::vector<int8_t>& data, size_t offset,
-	const Order& order)
+std::shared_ptr<const Network> NeuralNewtBrain::network() const
 {
-	DEBUG_ASSERT(offset + PLANESIZE <= data.size());
-	std::fill(data.begin() + offset, data.begin() + offset + PLANESIZE, 0);
-	if (order.type != Order::Type::NONE)
-	{
-		Position pos = order.subject.position;
-		size_t i = pos.row * Position::MAX_COLS + pos.col;
-		data[offset + i] = (int8_t) order.subject.type;
-	}
-	offset += PLANESIZE;
-
-	DEBUG_ASSERT(offset + PLANESIZE <= data.size());
-	switch (order.type)
-	{
-		case Order::Type::NONE:
-		{
-			// Fill with a positive value to differentiate from not giving
-			// an order, because (int8_t) Order::Type::NONE == 0.
-			std::fill(data.begin() + offset, data.begin() + offset + PLANESIZE,
-				(int8_t) Order::TYPE_SIZE);
-		}
-		break;
-		case Order::Type::MOVE:
-		{
-			std::fill(data.begin() + offset, data.begin() + offset + PLANESIZE,
-				0);
-			Cell current = board.cell(order.subject.position);
-			for (const Move& move : order.moves)
-			{
-				current = current + move;
-				// Convert to pos and then back to index, because the "stride"
-				// should be MAX_COLS and not board._width.
-				Position pos = current.pos();
-				size_t i = pos.row * Position::MAX_COLS + pos.col;
-				data[offset + i] = (int8_t) order.type;
-			}
-		}
-		break;
-		case Order::Type::GUARD:
-		case Order::Type::FOCUS:
-		case Order::Type::LOCKDOWN:
-		case Order::Type::SHELL:
-		case Order::Type::BOMBARD:
-		case Order::Type::EXPAND:
-		case Order::Type::PRODUCE:
-		{
-			std::fill(data.begin() + offset, data.begin() + offset + PLANESIZE,
-				0);
-			Position pos = order.target.position;
-			size_t i = pos.row * Position::MAX_COLS + pos.col;
-			data[offset + i] = (int8_t) order.type;
-		}
-		break;
-		case Order::Type::BOMB:
-		case Order::Type::CAPTURE:
-		case Order::Type::SHAPE:
-		case Order::Type::SETTLE:
-		case Order::Type::UPGRADE:
-		case Order::Type::CULTIVATE:
-		case Order::Type::HALT:
-		{
-			std::fill(data.begin() + offset, data.begin() + offset + PLANESIZE,
-				0);
-			Position pos = order.subject.position;
-			size_t i = pos.row * Position::MAX_COLS + pos.col;
-			data[offset + i] = (int8_t) order.type;
-		}
-		break;
-	}
-	offset += PLANESIZE;
-
-	DEBUG_ASSERT(offset + PLANESIZE <= data.size());
-	switch (order.type)
-	{
-		case Order::Type::NONE:
-		case Order::Type::MOVE:
-		case Order::Type::GUARD:
-		case Order::Type::FOCUS:
-		case Order::Type::LOCKDOWN:
-		case Order::Type::SHELL:
-		case Order::Type::BOMBARD:
-		case Order::Type::BOMB:
-		case Order::Type::CAPTURE:
-		case Order::Type::PRODUCE:
-		case Order::Type::HALT:
-		{
-			std::fill(data.begin() + offset, data.begin() + offset + PLANESIZE,
-				0);
-		}
-		break;
-		case Order::Type::EXPAND:
-		{
-			std::fill(data.begin() + offset, data.begin() + offset + PLANESIZE,
-				0);
-			Position pos = order.target.position;
-			size_t i = pos.row * Position::MAX_COLS + pos.col;
-			data[offset + i] = (int8_t) order.tiletype;
-		}
-		break;
-		case Order::Type::SHAPE:
-		case Order::Type::SETTLE:
-		case Order::Type::UPGRADE:
-		{
-			std::fill(data.begin() + offset, data.begin() + offset + PLANESIZE,
-				0);
-			Position pos = order.subject.position;
-			size_t i = pos.row * Position::MAX_COLS + pos.col;
-			data[offset + i] = (int8_t) order.tiletype;
-		}
-		break;
-		case Order::Type::CULTIVATE:
-		{
-			std::fill(data.begin() + offset, data.begin() + offset + PLANESIZE,
-				0);
-			Cell center = board.cell(order.subject.position);
-			for (Cell other : board.area(center, 1, 2))
-			{
-				// Convert to pos and then back to index, because the "stride"
-				// should be MAX_COLS and not ai._board._width.
-				Position pos = other.pos();
-				size_t i = pos.row * Position::MAX_COLS + pos.col;
-				data[offset + i] = (int8_t) order.tiletype;
-			}
-		}
-		break;
-	}
-	offset += PLANESIZE;
-
-	DEBUG_ASSERT(offset + PLANESIZE <= data.size());
-	switch (order.type)
-	{
-		case Order::Type::NONE:
-		case Order::Type::MOVE:
-		case Order::Type::GUARD:
-		case Order::Type::FOCUS:
-		case Order::Type::LOCKDOWN:
-		case Order::Type::SHELL:
-		case Order::Type::BOMBARD:
-		case Order::Type::BOMB:
-		case Order::Type::CAPTURE:
-		case Order::Type::EXPAND:
-		case Order::Type::SHAPE:
-		case Order::Type::SETTLE:
-		case Order::Type::UPGRADE:
-		case Order::Type::CULTIVATE:
-		case Order::Type::HALT:
-		{
-			std::fill(data.begin() + offset, data.begin() + offset + PLANESIZE,
-				0);
-		}
-		break;
-		case Order::Type::PRODUCE:
-		{
-			std::fill(data.begin() + offset, data.begin() + offset + PLANESIZE,
-				0);
-			Position pos = order.target.position;
-			size_t i = pos.row * Position::MAX_COLS + pos.col;
-			data[offset + i] = (int8_t) order.unittype;
-		}
-		break;
-	}
-	offset += PLANESIZE;
+	return _module;
 }
-#endif
 
-std::vector<int8_t> NeuralNewtBrain::encode(const AICommander& ai)
+size_t NeuralNewtBrain::numParameters() const
 {
-	DEBUG_ASSERT(TILETYPE_SIZE < 128);
-	DEBUG_ASSERT(UNITTYPE_SIZE < 128);
-	DEBUG_ASSERT(PLAYER_SIZE < 128);
-
-	std::vector<int8_t> data(NUM_PLANES * PLANESIZE);
-
-	for (Cell index : ai._board)
-	{
-		Position pos = index.pos();
-		DEBUG_ASSERT(pos.row >= 0 && pos.row <= Position::MAX_ROWS);
-		DEBUG_ASSERT(pos.col >= 0 && pos.col <= Position::MAX_COLS);
-		size_t i = pos.row * Position::MAX_COLS + pos.col;
-
-		const TileToken& tile = ai._board.tile(index);
-		data[plix(P_TILETYPE, i)] = (int8_t) tile.type;
-		data[plix(P_TILEOWNER, i)] = (int8_t) ((tile.owner == ai._player)
-			? Player::SELF : tile.owner);
-		data[plix(P_TILESTACKS, i)] = tile.stacks;
-		data[plix(P_TILEPOWER, i)] = tile.power;
-
-		const UnitToken& ground = ai._board.ground(index);
-		data[plix(P_GROUNDTYPE, i)] = (int8_t) ground.type;
-		data[plix(P_GROUNDOWNER, i)] = (int8_t) ((ground.owner == ai._player)
-			? Player::SELF : ground.owner);
-		data[plix(P_GROUNDSTACKS, i)] = ground.stacks;
-
-		const UnitToken& air = ai._board.air(index);
-		data[plix(P_AIRTYPE, i)] = (int8_t) air.type;
-		data[plix(P_AIROWNER, i)] = (int8_t) ((air.owner == ai._player)
-			? Player::SELF : air.owner);
-		data[plix(P_AIRSTACKS, i)] = air.stacks;
-
-		DEBUG_ASSERT(ai._board.bypass(index).type == UnitType::NONE);
-
-		DEBUG_ASSERT(ai._board.temperature(index) == 0);
-		data[plix(P_HUMIDITY, i)] = ai._board.humidity(index);
-		data[plix(P_CHAOS, i)] = ai._board.chaos(index);
-		data[plix(P_GAS, i)] = ai._board.gas(index);
-		DEBUG_ASSERT(ai._board.radiation(index) == 0);
-
-		data[plix(P_SNOW, i)] = ai._board.snow(index);
-		data[plix(P_FROSTBITE, i)] = ai._board.frostbite(index);
-		data[plix(P_FIRESTORM, i)] = ai._board.firestorm(index);
-		data[plix(P_BONEDROUGHT, i)] = ai._board.bonedrought(index);
-		data[plix(P_DEATH, i)] = ai._board.death(index);
-
-		data[plix(P_VISION, i)] = ai._board.current(index);
-	}
-
-	size_t i = NUM_BOARDPLANES * PLANESIZE;
-
-#ifdef ORDERSENCODED
-	// The cap on old orders is not enforced by the Automaton, and it is not
-	// an error if this occurs in release. But we think this will not occur in
-	// real games, so we use a debug assertion to confirm that suspicion.
-	DEBUG_ASSERT(ai._unfinishedOrders.size() <= OLDORDERSCAP);
-	// The cap on new orders is relatively save because we will not change
-	// Bible::newOrderLimit() before release; it is not an error if this
-	// occurs in release as we will simply ignore further orders.
-	DEBUG_ASSERT(ai._newOrders.size() <= NEWORDERSCAP);
-
-	int ordernum = 0 - ((int) OLDORDERSCAP);
-
-	if (ai._unfinishedOrders.size() < OLDORDERSCAP)
-	{
-		size_t n = OLDORDERSCAP - ai._unfinishedOrders.size();
-		size_t len = n * PLANES_PER_ORDER * PLANESIZE;
-		std::fill(data.begin() + i, data.begin() + i + len, 0);
-		i += len;
-		ordernum += n;
-	}
-
-	for (const Order& order : ai._unfinishedOrders)
-	{
-		encodeOrder(ai._board, data, i, order);
-		i += PLANES_PER_ORDER * PLANESIZE;
-		ordernum += 1;
-		if (ordernum >= 0) break;
-	}
-
-	DEBUG_ASSERT(ordernum == 0);
-
-	for (const Order& order : ai._newOrders)
-	{
-		encodeOrder(ai._board, data, i, order);
-		i += PLANES_PER_ORDER * PLANESIZE;
-		ordernum += 1;
-		if ((size_t) ordernum >= NEWORDERSCAP) break;
-	}
-
-	if ((size_t) ordernum < NEWORDERSCAP)
+	size_t count = 0;
+	for (const auto& parameter : _module->parameters())
 	{
-		size_t n = NEWORDERSCAP - ordernum;
-		size_t len = n * PLANES_PER_ORDER * PLANESIZE;
-		std::fill(data.begin() + i, data.begin() + i + len, 0);
-		i += len;
-		ordernum += n;
+		count += parameter.numel();
 	}
-
-	DEBUG_ASSERT(ordernum == NEWORDERSCAP);
-#else
-	// For now we only store the number of old and new orders.
-	// The cap on old orders is not enforced by the Automaton, and it is not
-	// an error if this occurs in release. But we think this will not occur in
-	// real games, so we use a debug assertion to confirm that suspicion.
-	DEBUG_ASSERT(ai._unfinishedOrders.size() < 128);
-	DEBUG_ASSERT(i + PLANESIZE <= data.size());
-	std::fill(data.begin() + i, data.begin() + i + PLANESIZE,
-		(int8_t) std::min(ai._unfinishedOrders.size(), (size_t) 127));
-	i += PLANESIZE;
-	DEBUG_ASSERT(ai._newOrders.size() < 128);
-	DEBUG_ASSERT(i + PLANESIZE <= data.size());
-	std::fill(data.begin() + i, data.begin() + i + PLANESIZE,
-		(int8_t) std::min(ai._newOrders.size(), (size_t) 127));
-	i += PLANESIZE;
-#endif
-
-	// It is probably best to store the money continuously, so we have it spill
-	// over into "buckets". So 100 is stored as (100, 0, 0, ...), 101 is stored
-	// as (100, 1, 0, ...) and e.g. 274 is stored as (100, 100, 74, 0, ...).
-	DEBUG_ASSERT(ai._money >= 0);
-	for (int offset = 0; offset < 1000; offset += 100)
-	{
-		DEBUG_ASSERT(i + PLANESIZE <= data.size());
-		std::fill(data.begin() + i, data.begin() + i + PLANESIZE,
-			(int8_t) std::min(std::max(0, ai._money - offset), 100));
-		i += PLANESIZE;
-	}
-
-	// Everything past year 100 is "extreme lategame" anyway.
-	DEBUG_ASSERT(ai._year >= 0);
-	DEBUG_ASSERT(i + PLANESIZE <= data.size());
-	std::fill(data.begin() + i, data.begin() + i + PLANESIZE,
-		(int8_t) std::min(std::max(0, ai._year), 100));
-	i += PLANESIZE;
-
-	DEBUG_ASSERT(SEASON_SIZE < 128);
-	DEBUG_ASSERT(i + PLANESIZE <= data.size());
-	std::fill(data.begin() + i, data.begin() + i + PLANESIZE,
-		(int8_t) ai._season);
-	i += PLANESIZE;
-
-	DEBUG_ASSERT(DAYTIME_SIZE < 128);
-	DEBUG_ASSERT(i + PLANESIZE <= data.size());
-	std::fill(data.begin() + i, data.begin() + i + PLANESIZE,
-		(int8_t) ai._daytime);
-	i += PLANESIZE;
-
-	// The phase is always PLANNING.
-
-	DEBUG_ASSERT(i == data.size());
-
-	return data;
+	return count;
 }
 
 void NeuralNewtBrain::prepare(const AICommander& ai)
 {
+	Counters::Timer timer(Counters::Phase::ENCODE);
+	Profiler::Scope scope("encode");
+	Counters::add(Counters::Count::DECISIONS);
 	std::vector<int8_t> data = encode(ai);
 	_input.insert(_input.end(), data.begin(), data.end());
 	_count++;
@@ -574,36 +217,30 @@ NewtBrain::Output NeuralNewtBrain::evaluate()
 	if (_output.size() == 0)
 	{
 		std::chrono::high_resolution_clock::time_point start;
-		static bool timing = _settings["timing"];
+		bool timing = _settings.timing;
 		static float ds = 0.0f;
 		static size_t evals = 0;
 		static size_t counts = 0;
 		if (timing) start = std::chrono::high_resolution_clock::now();
 
 		// Generate all the output at once with the NN.
-		torch::Tensor dataTensor = torch::from_blob(
-			&_input[0],
-			{
-				long(_count),
-				long(NUM_PLANES),
-				long(Position::MAX_COLS),
-				long(Position::MAX_ROWS),
-			},
-			torch::kInt8
-		).clone().to(_settings["cuda"] ? torch::kHalf : torch::kFloat);
+		std::vector<float> result(_count * NewtBrain::Output::SIZE);
+		InferenceCapture::sample(_input.data(), _count);
+		{
+			Counters::Timer timer(Counters::Phase::INFERENCE);
+			Profiler::Scope scope("forward");
+			_module->evaluate(_input.data(), _count, result.data());
+		}
+		Counters::add(Counters::Count::EVALUATIONS);
+		Counters::add(Counters::Count::EVALUATED_BOARDS, _count);
+		Counters::addBatch(_count);
 		_input.clear();
-		if (_settings["cuda"]) dataTensor = dataTensor.contiguous().cuda();
-
-		torch::Tensor resultTensor = _module->forward(dataTensor);
-
-		resultTensor = resultTensor.to(torch::kCPU, torch::kFloat);
 		for (size_t i = 0; i < _count; i++)
 		{
 			_output.emplace();
 			std::vector<float> output(
-				resultTensor.data_ptr<float>() + i * NewtBrain::Output::SIZE,
-				resultTensor.data_ptr<float>()
-					+ (i + 1) * NewtBrain::Output::SIZE
+				result.begin() + i * NewtBrain::Output::SIZE,
+				result.begin() + (i + 1) * NewtBrain::Output::SIZE
 			);
 			_output.back().assign(output);
 		}
@@ -705,22 +342,22 @@ void load_state_dict(torch::nn::Module& module, const std::string& filename,
 	}
 }
 
-bool NeuralNewtBrain::save(const std::string& folder,
-	const std::string& filename)
+static void makeCheckpointFolder(const std::string& folder)
 {
-	std::string filepath = folder + "/" + filename;
-	struct stat buffer;
-	if (stat(folder.c_str(), &buffer) != 0)
+	if (makeFolder(folder))
 	{
 		std::cout << "Checkpoint Directory does not exist! Making directory "
 			<< folder << std::endl;
-		mkdir(
-			folder.c_str()
-#ifdef __unix__
-			, S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH
-#endif
-		);
 	}
+}
+
+bool NeuralNewtBrain::save(const std::string& folder,
+	const std::string& filename)
+{
+	Profiler::Scope scope("save");
+	std::string filepath = folder + "/" + filename;
+	makeCheckpointFolder(folder);
+	struct stat buffer;
 	if (stat(filepath.c_str(), &buffer) != 0)
 	{
 		save_state_dict(*_module, filepath);
@@ -732,6 +369,7 @@ bool NeuralNewtBrain::save(const std::string& folder,
 void NeuralNewtBrain::load(const std::string& folder,
 	const std::string& filename)
 {
+	Profiler::Scope scope("load");
 	// https://github.com/pytorch/examples/blob/master/imagenet/main.py#L98
 	std::string filepath = folder + "/" + filename;
 	struct stat buffer;
@@ -740,6 +378,146 @@ void NeuralNewtBrain::load(const std::string& folder,
 		throw std::runtime_error("No model in path " + filepath);
 	}
 	load_state_dict(*_module, filepath);
-	if (_settings["cuda"]) _module->to(torch::kCUDA, torch::kHalf);
+	if (_settings.cuda) _module->to(torch::kCUDA, torch::kHalf);
 	else _module->to(torch::kFloat);
 }
+
+static BrainPack::Dtype packLayout(const Module& module,
+	std::vector<BrainPack::Tensor>& layout)
+{
+	BrainPack::Dtype dtype = BrainPack::Dtype::FLOAT32;
+	for (const auto& val : module.named_parameters(true))
+	{
+		if (val.value().scalar_type() == torch::kHalf)
+		{
+			dtype = BrainPack::Dtype::FLOAT16;
+		}
+		layout.push_back({val.key(), size_t(val.value().numel())});
+	}
+	return dtype;
+}
+
+// The CPU copies must outlive the use of the returned block.
+static std::vector<const void*> packBlock(const Module& module,
+	BrainPack::Dtype dtype, std::vector<torch::Tensor>& copies)
+{
+	torch::ScalarType type = (dtype == BrainPack::Dtype::FLOAT16)
+		? torch::kHalf : torch::kFloat;
+	std::vector<const void*> block;
+	for (const auto& val : module.named_parameters(true))
+	{
+		copies.push_back(val.value().to(torch::kCPU, type).contiguous());
+		block.push_back(copies.back().data_ptr());
+	}
+	return block;
+}
+
+void NeuralNewtBrain::savePack(const std::string& folder,
+	const std::string& filename,
+	const std::vector<std::shared_ptr<NeuralNewtBrain>>& brains)
+{
+	Profiler::Scope scope("savePack");
+	torch::NoGradGuard no_grad;
+	makeCheckpointFolder(folder);
+	std::string filepath = folder + "/" + filename;
+
+	// All brains share the same architecture and device, so the first brain
+	// determines the layout of the pack.
+	BrainPack::Dtype dtype = BrainPack::Dtype::FLOAT32;
+	std::vector<BrainPack::Tensor> layout;
+	if (!brains.empty()) dtype = packLayout(*brains[0]->_module, layout);
+
+	std::vector<std::string> names;
+	std::vector<std::vector<const void*>> blocks;
+	std::vector<torch::Tensor> copies;
+	for (const auto& brain : brains)
+	{
+		names.push_back(brain->shortName());
+		blocks.push_back(packBlock(*brain->_module, dtype, copies));
+	}
+
+	BrainPack::save(filepath, dtype, layout, names, blocks);
+}
+
+std::string NeuralNewtBrain::store(BrainStore& store, bool& written) const
+{
+	Profiler::Scope scope("store");
+	torch::NoGradGuard no_grad;
+	std::vector<BrainPack::Tensor> layout;
+	BrainPack::Dtype dtype = packLayout(*_module, layout);
+	std::vector<torch::Tensor> copies;
+	std::vector<const void*> block = packBlock(*_module, dtype, copies);
+	return store.put(dtype, layout, block, written);
+}
+
+static void checkPackLayout(const Module& module, const BrainPack& pack,
+	size_t i)
+{
+	auto params = module.named_parameters(true);
+	if (params.size() != pack.numTensors())
+	{
+		throw std::runtime_error("Brain " + pack.name(i) + " in pack has "
+			+ std::to_string(pack.numTensors()) + " tensors, expected "
+			+ std::to_string(params.size()));
+	}
+	size_t t = 0;
+	for (const auto& val : params)
+	{
+		if (val.key() != pack.tensorName(t)
+			|| size_t(val.value().numel()) != pack.numel(t))
+		{
+			throw std::runtime_error("Tensor " + pack.tensorName(t)
+				+ " in pack does not match " + val.key() + ", was the brain"
+				  " saved with a different num_channels?");
+		}
+		t++;
+	}
+}
+
+void NeuralNewtBrain::restore(const BrainPack& pack, size_t i)
+{
+	Profiler::Scope scope("restore");
+	torch::NoGradGuard no_grad;
+	checkPackLayout(*_module, pack, i);
+	torch::ScalarType type = (pack.dtype() == BrainPack::Dtype::FLOAT16)
+		? torch::kHalf : torch::kFloat;
+	size_t t = 0;
+	for (auto& val : _module->named_parameters(true))
+	{
+		// The pack is mapped read-only, but from_blob() requires a non-const
+		// pointer; copy_() only reads from it.
+		torch::Tensor data = torch::from_blob(
+			const_cast<void*>(pack.data(i, t)),
+			val.value().sizes(), type);
+		val.value().copy_(data);
+		t++;
+	}
+}
+
+void NeuralNewtBrain::attach(const std::shared_ptr<const BrainPack>& pack,
+	size_t i)
+{
+	Profiler::Scope scope("attach");
+	torch::NoGradGuard no_grad;
+	checkPackLayout(*_module, *pack, i);
+	if (_settings.cuda || pack->dtype() != BrainPack::Dtype::FLOAT32)
+	{
+		// The weights have to be converted anyway, so they are copied.
+		restore(*pack, i);
+		return;
+	}
+	size_t t = 0;
+	for (auto& val : _module->named_parameters(true))
+	{
+		// Each tensor keeps the pack, and thereby the mapping, alive. The
+		// mapping is read-only, so the weights must never be altered.
+		std::shared_ptr<const BrainPack> owner = pack;
+		torch::Tensor data = torch::from_blob(
+			const_cast<void*>(pack->data(i, t)),
+			val.value().sizes(),
+			[owner](void*) {},
+			torch::TensorOptions().dtype(torch::kFloat));
+		val.value().set_data(data);
+		t++;
+	}
+}
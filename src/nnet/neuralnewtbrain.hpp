@@ -30,14 +30,21 @@
 #include <unordered_map>
 #include <queue>
 
-class Setting;
+struct Settings;
+class Network;
 class Module;
+class BrainPack;
+class BrainStore;
 
 
 class NeuralNewtBrain : public NewtBrain
 {
 public:
 	static const size_t NUM_PLANES;
+	// The number of bytes in the encoding of a single board state.
+	static const size_t INPUT_SIZE;
+
+	static std::vector<int8_t> encode(const AICommander& input);
 
 	static NeuralNewtBrain mutate(const NeuralNewtBrain& brain,
 		size_t round, float deviationFactor, float selectionChance);
@@ -46,7 +53,7 @@ public:
 		size_t round);
 
 private:
-	std::unordered_map<std::string, Setting>& _settings;
+	const Settings& _settings;
 	std::shared_ptr<Module> _module;
 	BrainNamePtr _name;
 
@@ -55,11 +62,9 @@ private:
 	std::queue<Output> _output;
 
 public:
-	NeuralNewtBrain(std::unordered_map<std::string, Setting>& settings,
-		const BrainNamePtr& name);
+	NeuralNewtBrain(const Settings& settings, const BrainNamePtr& name);
 	NeuralNewtBrain(const std::shared_ptr<Module>& module,
-		std::unordered_map<std::string, Setting>& settings,
-		const BrainNamePtr& name);
+		const Settings& settings, const BrainNamePtr& name);
 	NeuralNewtBrain(const NeuralNewtBrain&) = delete;
 	NeuralNewtBrain(NeuralNewtBrain&& other);
 	NeuralNewtBrain& operator=(const NeuralNewtBrain&) = delete;
@@ -69,8 +74,6 @@ public:
 private:
 	NeuralNewtBrain(const NeuralNewtBrain& brain, const BrainNamePtr& name);
 
-	static std::vector<int8_t> encode(const AICommander& input);
-
 	virtual void prepare(const AICommander& input) override;
 	virtual Output evaluate() override;
 
@@ -79,6 +82,23 @@ public:
 
 	void load(const std::string& folder, const std::string& filename);
 
+	static void savePack(const std::string& folder, const std::string& filename,
+		const std::vector<std::shared_ptr<NeuralNewtBrain>>& brains);
+
+	void restore(const BrainPack& pack, size_t i);
+
+	// Uses the weights of brain i directly from the memory mapping of the
+	// pack instead of copying them, so that processes serving the same brain
+	// share its pages. Only for brains that are never mutated.
+	void attach(const std::shared_ptr<const BrainPack>& pack, size_t i);
+
+	std::string store(BrainStore& store, bool& written) const;
+
+	std::shared_ptr<const Network> network() const;
+
+	size_t numParameters() const;
+
+	uint32_t id() const { return _name->id(); }
 	std::string mediumName() const { return _name->mediumName(); }
 	std::string shortName() const { return _name->shortName(); }
 };
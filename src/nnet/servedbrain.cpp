@@ -0,0 +1,126 @@
+/**
+ * Part of Epicinium NeuralNewt
+ * developed by A Bunch of Hacks.
+ *
+ * Copyright (c) 2020 A Bunch of Hacks
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * [authors:]
+ * Daan Mulder (daan@abunchofhacks.coop)
+ */
+
+
+#include "servedbrain.hpp"
+
+#include <algorithm>
+
+#include "network.hpp"
+#include "inferencebroker.hpp"
+#include "neuralnewtbrain.hpp"
+
+
+std::atomic<size_t> ServedBrain::_deadline(0);
+std::atomic<uint64_t> ServedBrain::_turns(0);
+std::atomic<uint64_t> ServedBrain::_fallbacks(0);
+std::atomic<uint64_t> ServedBrain::_late(0);
+
+void ServedBrain::setDeadline(size_t milliseconds)
+{
+	_deadline = milliseconds;
+}
+
+ServedBrain::ServedBrain(const std::shared_ptr<const Network>& network,
+		InferenceBroker& broker) :
+	_network(network),
+	_broker(broker)
+{
+	_broker.addRequester();
+}
+
+ServedBrain::~ServedBrain()
+{
+	_broker.removeRequester();
+}
+
+void ServedBrain::prepare(const AICommander& ai)
+{
+	if (_count == 0) _turnStart = std::chrono::steady_clock::now();
+	std::vector<int8_t> data = NeuralNewtBrain::encode(ai);
+	_input.insert(_input.end(), data.begin(), data.end());
+	_count++;
+}
+
+NewtBrain::Output ServedBrain::evaluate()
+{
+	DEBUG_ASSERT(_count > 0);
+
+	// Do we still need to generate the output?
+	if (_output.size() == 0)
+	{
+		size_t size = _network->outputSize();
+		std::vector<float> result(_count * size);
+		evaluateTurn(result);
+		_input.clear();
+		_previous.assign(result.end() - size, result.end());
+		for (size_t i = 0; i < _count; i++)
+		{
+			_output.emplace();
+			std::vector<float> output(
+				result.begin() + i * size,
+				result.begin() + (i + 1) * size
+			);
+			_output.back().assign(output);
+		}
+	}
+
+	// We have already generated all the output, return the first.
+	DEBUG_ASSERT(_count == _output.size());
+	Output output = _output.front();
+	_output.pop();
+	_count--;
+	return output;
+}
+
+void ServedBrain::evaluateTurn(std::vector<float>& result)
+{
+	_turns++;
+	size_t deadline = _deadline;
+	if (deadline == 0)
+	{
+		_broker.evaluate(*_network, _input.data(), _count, result.data());
+		return;
+	}
+
+	auto end = _turnStart + std::chrono::milliseconds(deadline);
+	if (_broker.evaluate(*_network, _input.data(), _count, result.data(),
+		end))
+	{
+		if (std::chrono::steady_clock::now() > end) _late++;
+		return;
+	}
+
+	_fallbacks++;
+	size_t size = _network->outputSize();
+	for (size_t i = 0; i < _count; i++)
+	{
+		if (_previous.empty())
+		{
+			// The output is a sigmoid, so this is right in the middle.
+			std::fill(result.begin() + i * size,
+				result.begin() + (i + 1) * size, 0.5f);
+		}
+		else std::copy(_previous.begin(), _previous.end(),
+			result.begin() + i * size);
+	}
+}
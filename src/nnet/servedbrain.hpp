@@ -0,0 +1,86 @@
+/**
+ * Part of Epicinium NeuralNewt
+ * developed by A Bunch of Hacks.
+ *
+ * Copyright (c) 2020 A Bunch of Hacks
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * [authors:]
+ * Daan Mulder (daan@abunchofhacks.coop)
+ */
+
+
+#pragma once
+
+#include "libs/aftermath/newtbrain.hpp"
+
+#include <memory>
+#include <queue>
+#include <atomic>
+#include <chrono>
+
+class Network;
+class InferenceBroker;
+
+
+// The brain handed out by the neuralnewt library. Instead of running its own
+// forward pass it sends its prepared input to a broker shared by all brains,
+// so that the inputs of concurrent games are evaluated in one batch.
+//
+// If a decision deadline is set, a turn that cannot be evaluated within that
+// many milliseconds of its first prepare() gets the output of the previous
+// turn instead, or neutral output if there is no previous turn.
+class ServedBrain : public NewtBrain
+{
+private:
+	static std::atomic<size_t> _deadline;
+	static std::atomic<uint64_t> _turns;
+	static std::atomic<uint64_t> _fallbacks;
+	static std::atomic<uint64_t> _late;
+
+	std::shared_ptr<const Network> _network;
+	InferenceBroker& _broker;
+
+	size_t _count = 0;
+	std::vector<int8_t> _input;
+	std::queue<Output> _output;
+	std::chrono::steady_clock::time_point _turnStart;
+	std::vector<float> _previous;
+
+public:
+	// A deadline of 0 milliseconds means there is no deadline.
+	static void setDeadline(size_t milliseconds);
+
+	// The number of turns evaluated, the number of turns that got fallback
+	// output and the number of turns that were evaluated after the deadline
+	// because they were already being evaluated.
+	static uint64_t turns() { return _turns; }
+	static uint64_t fallbacks() { return _fallbacks; }
+	static uint64_t late() { return _late; }
+
+public:
+	ServedBrain(const std::shared_ptr<const Network>& network,
+		InferenceBroker& broker);
+	ServedBrain(const ServedBrain&) = delete;
+	ServedBrain(ServedBrain&&) = delete;
+	ServedBrain& operator=(const ServedBrain&) = delete;
+	ServedBrain& operator=(ServedBrain&&) = delete;
+	~ServedBrain();
+
+private:
+	virtual void prepare(const AICommander& input) override;
+	virtual Output evaluate() override;
+
+	void evaluateTurn(std::vector<float>& result);
+};
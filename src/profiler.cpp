@@ -0,0 +1,140 @@
+/**
+ * Part of Epicinium NeuralNewt
+ * developed by A Bunch of Hacks.
+ *
+ * Copyright (c) 2020 A Bunch of Hacks
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * [authors:]
+ * Daan Mulder (daan@abunchofhacks.coop)
+ */
+
+
+#include "profiler.hpp"
+
+#include <fstream>
+#include <iomanip>
+#include <chrono>
+#include <stdexcept>
+
+
+std::atomic<bool> Profiler::_enabled(false);
+std::mutex Profiler::_mutex;
+std::vector<std::unique_ptr<Profiler::ThreadBuffer>> Profiler::_buffers;
+thread_local Profiler::ThreadBuffer* Profiler::_threadBuffer = nullptr;
+
+static const std::chrono::steady_clock::time_point _epoch =
+	std::chrono::steady_clock::now();
+
+void Profiler::enable(bool enabled)
+{
+	_enabled.store(enabled, std::memory_order_relaxed);
+}
+
+// Nanoseconds since the profiler was loaded, plus one so that a recorded
+// start time is never 0.
+uint64_t Profiler::now()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now() - _epoch).count() + 1;
+}
+
+Profiler::ThreadBuffer& Profiler::buffer()
+{
+	if (_threadBuffer == nullptr)
+	{
+		std::unique_ptr<ThreadBuffer> buffer(new ThreadBuffer());
+		buffer->events.resize(CAPACITY);
+		buffer->head = 0;
+		buffer->tail = 0;
+		std::lock_guard<std::mutex> lock(_mutex);
+		buffer->tid = _buffers.size() + 1;
+		buffer->name = "thread " + std::to_string(buffer->tid);
+		_threadBuffer = buffer.get();
+		_buffers.push_back(std::move(buffer));
+	}
+	return *_threadBuffer;
+}
+
+void Profiler::record(const char* name, uint64_t start, uint64_t end)
+{
+	ThreadBuffer& buffer = Profiler::buffer();
+	uint64_t head = buffer.head.load(std::memory_order_relaxed);
+	buffer.events[head % CAPACITY] = {name, start, end};
+	buffer.head.store(head + 1, std::memory_order_release);
+}
+
+void Profiler::nameThread(const std::string& name)
+{
+	ThreadBuffer& buffer = Profiler::buffer();
+	std::lock_guard<std::mutex> lock(_mutex);
+	buffer.name = name;
+}
+
+static void writeString(std::ostream& os, const std::string& text)
+{
+	os << '"';
+	for (char c : text)
+	{
+		if (c == '"' || c == '\\') os << '\\';
+		if (c >= 0 && c < ' ') continue;
+		os << c;
+	}
+	os << '"';
+}
+
+size_t Profiler::writeTrace(const std::string& filename)
+{
+	std::ofstream file(filename);
+	if (!file.is_open())
+	{
+		throw std::runtime_error("Cannot open trace file " + filename);
+	}
+
+	size_t dropped = 0;
+	bool first = true;
+	file << std::fixed << std::setprecision(3);
+	file << "{\"traceEvents\":[\n";
+	std::lock_guard<std::mutex> lock(_mutex);
+	for (const auto& buffer : _buffers)
+	{
+		if (!first) file << ",\n";
+		first = false;
+		file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":"
+			<< buffer->tid << ",\"args\":{\"name\":";
+		writeString(file, buffer->name);
+		file << "}}";
+
+		uint64_t head = buffer->head.load(std::memory_order_acquire);
+		uint64_t tail = buffer->tail;
+		if (head - tail > CAPACITY)
+		{
+			dropped += head - tail - CAPACITY;
+			tail = head - CAPACITY;
+		}
+		for (uint64_t i = tail; i < head; i++)
+		{
+			const Event& event = buffer->events[i % CAPACITY];
+			// Trace timestamps are in microseconds.
+			file << ",\n{\"name\":";
+			writeString(file, event.name);
+			file << ",\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer->tid
+				<< ",\"ts\":" << (event.start / 1000.0)
+				<< ",\"dur\":" << ((event.end - event.start) / 1000.0) << "}";
+		}
+		buffer->tail = head;
+	}
+	file << "\n]}\n";
+	return dropped;
+}
@@ -0,0 +1,108 @@
+/**
+ * Part of Epicinium NeuralNewt
+ * developed by A Bunch of Hacks.
+ *
+ * Copyright (c) 2020 A Bunch of Hacks
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * [authors:]
+ * Daan Mulder (daan@abunchofhacks.coop)
+ */
+
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <cstdint>
+
+
+// Records named spans of time on any thread, for viewing in a Chrome trace
+// viewer (chrome://tracing or Perfetto). Profiling is off by default, in
+// which case a Scope costs a single relaxed load.
+//
+// Each thread records into its own fixed-size ring buffer without locking.
+// When a thread records more than CAPACITY spans between two writes of the
+// trace, the oldest spans are dropped. The trace should be written while
+// the recording threads are between spans, such as at the end of a round.
+class Profiler
+{
+public:
+	static const size_t CAPACITY = 1 << 16;
+
+	// The name must be a string literal, or at least outlive the profiler.
+	class Scope
+	{
+	private:
+		const char* _name;
+		uint64_t _start;
+
+	public:
+		explicit Scope(const char* name) :
+			_name(name),
+			_start(Profiler::enabled() ? Profiler::now() : 0)
+		{}
+		Scope(const Scope&) = delete;
+		Scope(Scope&&) = delete;
+		Scope& operator=(const Scope&) = delete;
+		Scope& operator=(Scope&&) = delete;
+		~Scope()
+		{
+			if (_start != 0) Profiler::record(_name, _start, Profiler::now());
+		}
+	};
+
+private:
+	struct Event
+	{
+		const char* name;
+		uint64_t start;
+		uint64_t end;
+	};
+
+	struct ThreadBuffer
+	{
+		uint32_t tid;
+		std::string name;
+		std::vector<Event> events;
+		std::atomic<uint64_t> head;
+		uint64_t tail;
+	};
+
+	static std::atomic<bool> _enabled;
+	static std::mutex _mutex;
+	// Buffers are kept when their thread exits, so that its last spans are
+	// still written.
+	static std::vector<std::unique_ptr<ThreadBuffer>> _buffers;
+	static thread_local ThreadBuffer* _threadBuffer;
+
+	static ThreadBuffer& buffer();
+	static uint64_t now();
+	static void record(const char* name, uint64_t start, uint64_t end);
+
+public:
+	static void enable(bool enabled);
+	static bool enabled()
+		{ return _enabled.load(std::memory_order_relaxed); }
+
+	// Names the calling thread in the trace.
+	static void nameThread(const std::string& name);
+
+	// Writes every span recorded since the previous call as trace-event JSON
+	// and returns the number of spans that had to be dropped.
+	static size_t writeTrace(const std::string& filename);
+};
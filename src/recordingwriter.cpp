@@ -0,0 +1,210 @@
+/**
+ * Part of Epicinium NeuralNewt
+ * developed by A Bunch of Hacks.
+ *
+ * Copyright (c) 2020 A Bunch of Hacks
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * [authors:]
+ * Daan Mulder (daan@abunchofhacks.coop)
+ */
+
+
+
+#include "recordingwriter.hpp"
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <iostream>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <stdexcept>
+#ifdef NEURALNEWT_ZLIB
+#include <zlib.h>
+#endif
+#ifdef _WIN32
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "atomicfile.hpp"
+#include "folders.hpp"
+
+
+namespace
+{
+	struct Recording
+	{
+		std::string name;
+		std::string text;
+	};
+}
+
+static std::mutex _mutex;
+static std::condition_variable _wakeup;
+static std::thread _thread;
+static bool _running = false;
+static bool _stopping = false;
+static std::string _folder = "recordings";
+static std::vector<Recording> _pending;
+
+#ifdef NEURALNEWT_ZLIB
+static const char* EXTENSION = ".rec.gz";
+
+static std::string compress(const std::string& text)
+{
+	z_stream stream;
+	std::memset(&stream, 0, sizeof(stream));
+	// Adding 16 to the window bits asks for a gzip header, so that the files
+	// can be read with gunzip.
+	if (deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8,
+		Z_DEFAULT_STRATEGY) != Z_OK)
+	{
+		throw std::runtime_error("Cannot start compressing");
+	}
+	std::string result(deflateBound(&stream, text.size()), '\0');
+	stream.next_in = (Bytef*) text.data();
+	stream.avail_in = text.size();
+	stream.next_out = (Bytef*) &result[0];
+	stream.avail_out = result.size();
+	int status = deflate(&stream, Z_FINISH);
+	size_t size = stream.total_out;
+	deflateEnd(&stream);
+	if (status != Z_STREAM_END)
+	{
+		throw std::runtime_error("Cannot compress recording");
+	}
+	result.resize(size);
+	return result;
+}
+#else
+static const char* EXTENSION = ".rec";
+
+static std::string compress(const std::string& text)
+{
+	return text;
+}
+#endif
+
+// Every recording is complete once it is listed. The list is only appended
+// to, with a single write, so that processes that record games into the
+// same folder do not lose each other's lines.
+static void writeAll(const std::string& folder,
+	const std::vector<Recording>& recordings)
+{
+	makeFolder(folder);
+	std::string list;
+	for (const Recording& recording : recordings)
+	{
+		try
+		{
+			AtomicFile file(folder + "/" + recording.name + EXTENSION);
+			file.write(compress(recording.text));
+			file.commit();
+			list += recording.name + EXTENSION + "\n";
+		}
+		catch (const std::exception& e)
+		{
+			std::cerr << "WARNING: recording " << recording.name << " is"
+				" lost: " << e.what() << std::endl;
+		}
+	}
+	if (list.empty()) return;
+	std::string listpath = folder + "/history.list";
+	FILE* file = std::fopen(listpath.c_str(), "ab");
+	if (file == nullptr)
+	{
+		std::cerr << "WARNING: cannot open " << listpath << std::endl;
+		return;
+	}
+	std::setvbuf(file, nullptr, _IONBF, 0);
+	std::fwrite(list.data(), 1, list.size(), file);
+	std::fclose(file);
+}
+
+static void run()
+{
+	std::vector<Recording> recordings;
+	std::unique_lock<std::mutex> lock(_mutex);
+	while (true)
+	{
+		_wakeup.wait(lock, []{ return _stopping || !_pending.empty(); });
+		if (_pending.empty()) break;
+		recordings.swap(_pending);
+		std::string folder = _folder;
+		lock.unlock();
+		writeAll(folder, recordings);
+		recordings.clear();
+		lock.lock();
+	}
+}
+
+void RecordingWriter::start(const std::string& folder)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	if (_running) throw std::runtime_error("RecordingWriter already started");
+	_folder = folder;
+	_stopping = false;
+	_running = true;
+	_thread = std::thread(run);
+}
+
+void RecordingWriter::stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		if (!_running) return;
+		_stopping = true;
+	}
+	_wakeup.notify_all();
+	_thread.join();
+	std::lock_guard<std::mutex> lock(_mutex);
+	_running = false;
+}
+
+std::string RecordingWriter::newName()
+{
+	static std::atomic<unsigned long> counter(0);
+	char buffer[32];
+	std::time_t now = std::time(nullptr);
+	std::strftime(buffer, sizeof(buffer), "%Y-%m-%d_%H-%M-%S",
+		std::gmtime(&now));
+#ifdef _WIN32
+	long pid = _getpid();
+#else
+	long pid = getpid();
+#endif
+	return std::string(buffer) + "_" + std::to_string(pid) + "_"
+		+ std::to_string(counter++);
+}
+
+void RecordingWriter::write(const std::string& name, std::string&& text)
+{
+	std::unique_lock<std::mutex> lock(_mutex);
+	if (!_running)
+	{
+		std::string folder = _folder;
+		lock.unlock();
+		writeAll(folder, {Recording{name, std::move(text)}});
+		return;
+	}
+	_pending.push_back(Recording{name, std::move(text)});
+	lock.unlock();
+	_wakeup.notify_one();
+}
@@ -0,0 +1,48 @@
+/**
+ * Part of Epicinium NeuralNewt
+ * developed by A Bunch of Hacks.
+ *
+ * Copyright (c) 2020 A Bunch of Hacks
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * [authors:]
+ * Daan Mulder (daan@abunchofhacks.coop)
+ */
+
+
+#pragma once
+
+#include <string>
+
+
+// Writes game recordings from a background thread, so that recording games
+// does not slow down the game loop. Each recording is compressed with gzip
+// (if zlib was found at build time), written to folder/[name].rec.gz in one
+// go and only then listed in folder/history.list.
+class RecordingWriter
+{
+public:
+	static void start(const std::string& folder);
+
+	// Writes the recordings that have been handed over and stops the
+	// background thread.
+	static void stop();
+
+	// A name that no other recording has, based on the current time.
+	static std::string newName();
+
+	// Before start() and after stop(), the recording is written right away,
+	// to the recordings folder.
+	static void write(const std::string& name, std::string&& text);
+};
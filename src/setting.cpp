@@ -27,8 +27,56 @@
 #include "libs/jsoncpp/json.h"
 
 
-std::unordered_map<std::string, Setting> Setting::readSettings(
-	const std::string& filename)
+void Setting::assign(const std::string& name, const Setting& value,
+	bool& field)
+{
+	if (value._type != Type::BOOL)
+	{
+		throw std::runtime_error("Setting " + name + " should be a boolean");
+	}
+	field = value._bValue;
+}
+
+void Setting::assign(const std::string& name, const Setting& value,
+	size_t& field)
+{
+	if (value._type != Type::INT || value._iValue < 0)
+	{
+		throw std::runtime_error("Setting " + name + " should be a"
+			" non-negative integer");
+	}
+	field = value._iValue;
+}
+
+void Setting::assign(const std::string& name, const Setting& value,
+	float& field)
+{
+	if (value._type == Type::INT) field = value._iValue;
+	else if (value._type == Type::FLOAT) field = value._fValue;
+	else throw std::runtime_error("Setting " + name + " should be a number");
+}
+
+void Setting::assign(const std::string& name, const Setting& value,
+	std::string& field)
+{
+	if (value._type != Type::STRING)
+	{
+		throw std::runtime_error("Setting " + name + " should be a string");
+	}
+	field = value._sValue;
+}
+
+void Setting::assign(const std::string& name, const Setting& value,
+	std::vector<std::string>& field)
+{
+	if (value._type != Type::VECTOR)
+	{
+		throw std::runtime_error("Setting " + name + " should be a list");
+	}
+	field = value._vValue;
+}
+
+Settings Setting::readSettings(const std::string& filename)
 {
 	std::unordered_map<std::string, Setting> result;
 	Json::Reader reader;
@@ -76,5 +124,155 @@ std::unordered_map<std::string, Setting> Setting::readSettings(
 				+ " in settings file: " + filename);
 		}
 	}
-	return result;
+
+	Settings settings;
+	for (const auto& pair : result)
+	{
+		const std::string& name = pair.first;
+		const Setting& value = pair.second;
+		if (name == "num_rounds")
+			assign(name, value, settings.numRounds);
+		else if (name == "num_pools")
+			assign(name, value, settings.numPools);
+		else if (name == "brains_per_pool")
+			assign(name, value, settings.brainsPerPool);
+		else if (name == "num_AI_games")
+			assign(name, value, settings.numAIGames);
+		else if (name == "save_brains")
+			assign(name, value, settings.saveBrains);
+		else if (name == "checkpoint_queue_size")
+			assign(name, value, settings.checkpointQueueSize);
+		else if (name == "brain_store")
+			assign(name, value, settings.brainStore);
+		else if (name == "lineage_depth")
+			assign(name, value, settings.lineageDepth);
+		else if (name == "timing")
+			assign(name, value, settings.timing);
+		else if (name == "profile")
+			assign(name, value, settings.profile);
+		else if (name == "metrics_port")
+			assign(name, value, settings.metricsPort);
+		else if (name == "coordinator_port")
+			assign(name, value, settings.coordinatorPort);
+		else if (name == "games_per_shard")
+			assign(name, value, settings.gamesPerShard);
+		else if (name == "worker_timeout")
+			assign(name, value, settings.workerTimeout);
+		else if (name == "local_workers")
+			assign(name, value, settings.localWorkers);
+		else if (name == "islands")
+			assign(name, value, settings.islands);
+		else if (name == "migration_interval")
+			assign(name, value, settings.migrationInterval);
+		else if (name == "migration_size")
+			assign(name, value, settings.migrationSize);
+		else if (name == "affinity")
+			assign(name, value, settings.affinity);
+		else if (name == "autotune")
+			assign(name, value, settings.autotune);
+		else if (name == "autotune_games")
+			assign(name, value, settings.autotuneGames);
+		else if (name == "autotune_file")
+			assign(name, value, settings.autotuneFile);
+		else if (name == "verbose")
+			assign(name, value, settings.verbose);
+		else if (name == "console_summary")
+			assign(name, value, settings.consoleSummary);
+		else if (name == "log_folder")
+			assign(name, value, settings.logFolder);
+		else if (name == "aftermath_loglevel")
+			assign(name, value, settings.aftermathLoglevel);
+		else if (name == "recording_chance")
+			assign(name, value, settings.recordingChance);
+		else if (name == "capture_chance")
+			assign(name, value, settings.captureChance);
+		else if (name == "map_names")
+			assign(name, value, settings.mapNames);
+		else if (name == "cuda")
+			assign(name, value, settings.cuda);
+		else if (name == "num_channels")
+			assign(name, value, settings.numChannels);
+		else if (name == "torch_threads")
+			assign(name, value, settings.torchThreads);
+		else if (name == "max_batch_size")
+			assign(name, value, settings.maxBatchSize);
+		else if (name == "max_batch_wait_us")
+			assign(name, value, settings.maxBatchWait);
+		else if (name == "brain_memory_budget_mb")
+			assign(name, value, settings.brainMemoryBudget);
+		else if (name == "mutation_deviation_factor")
+			assign(name, value, settings.mutationDeviationFactor);
+		else if (name == "mutation_selection_chance")
+			assign(name, value, settings.mutationSelectionChance);
+		else
+		{
+			throw std::runtime_error("Unknown setting " + name
+				+ " in settings file: " + filename);
+		}
+	}
+
+	if (settings.numPools == 0 || settings.brainsPerPool == 0)
+	{
+		throw std::runtime_error("There should be at least one pool with at"
+			" least one brain in settings file: " + filename);
+	}
+	if (settings.numChannels == 0)
+	{
+		throw std::runtime_error("Setting num_channels should be positive in"
+			" settings file: " + filename);
+	}
+	if (settings.maxBatchSize == 0)
+	{
+		throw std::runtime_error("Setting max_batch_size should be positive in"
+			" settings file: " + filename);
+	}
+	if (settings.metricsPort > 65535)
+	{
+		throw std::runtime_error("Setting metrics_port should be a valid port"
+			" number in settings file: " + filename);
+	}
+	if (settings.coordinatorPort > 65535)
+	{
+		throw std::runtime_error("Setting coordinator_port should be a valid"
+			" port number in settings file: " + filename);
+	}
+	if (settings.gamesPerShard == 0)
+	{
+		throw std::runtime_error("Setting games_per_shard should be positive"
+			" in settings file: " + filename);
+	}
+	if (settings.islands && settings.coordinatorPort > 0)
+	{
+		throw std::runtime_error("Setting coordinator_port cannot be combined"
+			" with islands in settings file: " + filename);
+	}
+	if (settings.islands
+		&& settings.migrationSize > settings.brainsPerPool / 5 * 2)
+	{
+		throw std::runtime_error("Setting migration_size should be at most"
+			" the number of brains that survive evolution ("
+			+ std::to_string(settings.brainsPerPool / 5 * 2)
+			+ ") in settings file: " + filename);
+	}
+	if (settings.autotune && settings.autotuneGames == 0)
+	{
+		throw std::runtime_error("Setting autotune_games should be positive"
+			" in settings file: " + filename);
+	}
+	if (settings.mapNames.empty())
+	{
+		throw std::runtime_error("Setting map_names should contain at least"
+			" one map in settings file: " + filename);
+	}
+	if (settings.recordingChance < 0.0f || settings.recordingChance > 1.0f)
+	{
+		throw std::runtime_error("Setting recording_chance should be between"
+			" 0 and 1 in settings file: " + filename);
+	}
+	if (settings.captureChance < 0.0f || settings.captureChance > 1.0f)
+	{
+		throw std::runtime_error("Setting capture_chance should be between"
+			" 0 and 1 in settings file: " + filename);
+	}
+	return settings;
 }
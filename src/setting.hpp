@@ -28,11 +28,58 @@
 #include <vector>
 
 
+// All settings, validated and converted to their proper types once, so that
+// no strings have to be looked up while training. The defaults correspond to
+// the example settings.json.
+struct Settings
+{
+	size_t numRounds = 100;
+	size_t numPools = 2;
+	size_t brainsPerPool = 50;
+	size_t numAIGames = 30;
+
+	bool saveBrains = true;
+	size_t checkpointQueueSize = 2;
+	std::string brainStore = "";
+	size_t lineageDepth = 0;
+	bool timing = false;
+	bool profile = false;
+	size_t metricsPort = 0;
+	size_t coordinatorPort = 0;
+	size_t gamesPerShard = 16;
+	size_t workerTimeout = 60;
+	size_t localWorkers = 0;
+	bool islands = false;
+	size_t migrationInterval = 10;
+	size_t migrationSize = 2;
+	bool affinity = false;
+	bool autotune = false;
+	size_t autotuneGames = 24;
+	std::string autotuneFile = "";
+	bool verbose = true;
+	bool consoleSummary = true;
+	std::string logFolder = "logs";
+
+	std::string aftermathLoglevel = "debug";
+	float recordingChance = 0.002f;
+	float captureChance = 0.0f;
+	std::vector<std::string> mapNames;
+
+	bool cuda = true;
+	size_t numChannels = 32;
+	size_t torchThreads = 0;
+	size_t maxBatchSize = 64;
+	size_t maxBatchWait = 1000;
+	size_t brainMemoryBudget = 0;
+
+	float mutationDeviationFactor = 0.5f;
+	float mutationSelectionChance = 0.5f;
+};
+
 class Setting
 {
 public:
-	static std::unordered_map<std::string, Setting> readSettings(
-		const std::string& filename);
+	static Settings readSettings(const std::string& filename);
 
 private:
 	enum class Type : uint8_t
@@ -57,6 +104,17 @@ private:
 
 	Type _type;
 
+	static void assign(const std::string& name, const Setting& value,
+		bool& field);
+	static void assign(const std::string& name, const Setting& value,
+		size_t& field);
+	static void assign(const std::string& name, const Setting& value,
+		float& field);
+	static void assign(const std::string& name, const Setting& value,
+		std::string& field);
+	static void assign(const std::string& name, const Setting& value,
+		std::vector<std::string>& field);
+
 public:
 	Setting() :
 		_type(Type::NONE)
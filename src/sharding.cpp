@@ -0,0 +1,804 @@
+/**
+ * Part of Epicinium NeuralNewt
+ * developed by A Bunch of Hacks.
+ *
+ * Copyright (c) 2020 A Bunch of Hacks
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * [authors:]
+ * Daan Mulder (daan@abunchofhacks.coop)
+ */
+
+
+#include "sharding.hpp"
+
+#include <torch/torch.h>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <unordered_map>
+#include <chrono>
+#include <cstring>
+#include <algorithm>
+#include <cstdio>
+#include <ctime>
+#include <stdexcept>
+#include <exception>
+#ifndef _WIN32
+#include <unistd.h>
+#include <signal.h>
+#include <sys/wait.h>
+#endif
+#ifdef __linux__
+#include <sys/prctl.h>
+#endif
+
+#include "atomicfile.hpp"
+#include "counters.hpp"
+#include "folders.hpp"
+#include "mappedfile.hpp"
+#include "recordingwriter.hpp"
+#include "brainname.hpp"
+#include "nnet/neuralnewtbrain.hpp"
+#include "nnet/brainpack.hpp"
+
+
+enum class Message : uint32_t
+{
+	// worker: ruleset name, worker name
+	HELLO = 1,
+	// coordinator: round, brain pack
+	POPULATION,
+	// coordinator: games
+	GAMES,
+	// worker: results, with brain indices instead of lineage ids, and what
+	// was counted while playing the games
+	RESULTS,
+	// worker: what went wrong while playing the games
+	ERROR,
+	// coordinator: no more rounds
+	DONE,
+	// coordinator: round, path of the brain pack on this machine
+	SHARED_POPULATION,
+};
+
+template <typename T>
+static void put(std::string& data, const T& value)
+{
+	data.append((const char*) &value, sizeof(T));
+}
+
+static void putString(std::string& data, const std::string& value)
+{
+	put<uint32_t>(data, value.size());
+	data += value;
+}
+
+template <typename T>
+static void putVector(std::string& data, const std::vector<T>& values)
+{
+	put<uint32_t>(data, values.size());
+	data.append((const char*) values.data(), values.size() * sizeof(T));
+}
+
+class Reader
+{
+private:
+	const std::string& _data;
+	size_t _offset;
+
+	const char* take(size_t size)
+	{
+		if (size > _data.size() - _offset)
+		{
+			throw std::runtime_error("Message is truncated");
+		}
+		const char* result = _data.data() + _offset;
+		_offset += size;
+		return result;
+	}
+
+public:
+	explicit Reader(const std::string& data) :
+		_data(data),
+		_offset(0)
+	{}
+
+	template <typename T>
+	T get()
+	{
+		T value;
+		std::memcpy(&value, take(sizeof(T)), sizeof(T));
+		return value;
+	}
+
+	std::string getString()
+	{
+		size_t size = get<uint32_t>();
+		return std::string(take(size), size);
+	}
+
+	template <typename T>
+	std::vector<T> getVector()
+	{
+		size_t size = get<uint32_t>();
+		if (size > (_data.size() - _offset) / sizeof(T))
+		{
+			throw std::runtime_error("Message is truncated");
+		}
+		std::vector<T> values(size);
+		std::memcpy(values.data(), take(size * sizeof(T)), size * sizeof(T));
+		return values;
+	}
+
+	const char* rest(size_t& size)
+	{
+		size = _data.size() - _offset;
+		return take(size);
+	}
+};
+
+static std::string writeResults(const Director::RoundResults& results,
+	const Counters::Snapshot& counted)
+{
+	std::string data;
+	put(data, counted);
+	putVector(data, results.popScores);
+	for (const auto& scores : results.aiScores) putVector(data, scores);
+	putVector(data, results.totalScores);
+	putVector(data, results.wins);
+	putVector(data, results.draws);
+	putVector(data, results.losses);
+	putVector(data, results.games);
+	for (const auto& name : results.aiNames) putString(data, name);
+	return data;
+}
+
+// The results must already hold the names of the brains, which determine how
+// many brains there should be.
+static void readResults(const std::string& data,
+	Director::RoundResults& results, Counters::Snapshot& counted)
+{
+	Reader reader(data);
+	counted = reader.get<Counters::Snapshot>();
+	size_t size = results.names.size();
+	auto check = [size](const std::vector<int>& values) {
+		if (values.size() != size)
+		{
+			throw std::runtime_error("Results are for "
+				+ std::to_string(values.size()) + " brains instead of "
+				+ std::to_string(size));
+		}
+		return values;
+	};
+	results.popScores = check(reader.getVector<int>());
+	for (auto& scores : results.aiScores)
+	{
+		scores = check(reader.getVector<int>());
+	}
+	results.totalScores = check(reader.getVector<int>());
+	results.wins = check(reader.getVector<int>());
+	results.draws = check(reader.getVector<int>());
+	results.losses = check(reader.getVector<int>());
+	results.games = reader.getVector<GameLog::Record>();
+	for (auto& name : results.aiNames) name = reader.getString();
+}
+
+ShardCoordinator::ShardCoordinator(const Settings& settings,
+		const std::string& rulesetname, const std::string& packFolder) :
+	_settings(settings),
+	_rulesetname(rulesetname),
+	_packFolder(packFolder),
+	_packFilename("shard.pack"),
+	_listener(Socket::listen(settings.coordinatorPort,
+		settings.coordinatorPort == 0)),
+	_node(0),
+	_stopping(false),
+	_share(1),
+	_inFlight(0)
+{
+#ifdef __linux__
+	if (settings.localWorkers > 0 && pathExists("/dev/shm"))
+	{
+		_packFolder = "/dev/shm";
+		_packFilename = "neuralnewt-" + std::to_string(getpid()) + ".pack";
+	}
+#endif
+
+	// Forking before any other threads are started.
+	forkWorkers(settings.localWorkers);
+
+	_acceptThread = std::thread(&ShardCoordinator::acceptWorkers, this);
+	if (settings.coordinatorPort > 0)
+	{
+		std::cout << "Waiting for workers on port "
+			<< settings.coordinatorPort << std::endl;
+	}
+
+	// Local workers take part from the first round on.
+	std::unique_lock<std::mutex> lock(_mutex);
+	_changed.wait_for(lock, std::chrono::seconds(60), [this]() {
+		return _workers.size() >= _children.size();
+	});
+}
+
+ShardCoordinator::~ShardCoordinator()
+{
+	_stopping = true;
+	_acceptThread.join();
+	for (auto& worker : _workers)
+	{
+		try
+		{
+			worker->socket.send(uint32_t(Message::DONE), "");
+		}
+		catch (const std::exception&)
+		{
+			// The worker is gone already.
+		}
+	}
+#ifndef _WIN32
+	// Connected local workers get a moment to finish writing recordings, but
+	// those that have not connected yet would keep retrying.
+	auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+	for (int pid : _children)
+	{
+		while (waitpid(pid, nullptr, WNOHANG) == 0)
+		{
+			if (std::chrono::steady_clock::now() > deadline)
+			{
+				kill(pid, SIGTERM);
+				waitpid(pid, nullptr, 0);
+				break;
+			}
+			std::this_thread::sleep_for(std::chrono::milliseconds(50));
+		}
+	}
+#endif
+	if (!_children.empty())
+	{
+		std::remove(packPath(_node).c_str());
+		for (const Placement& placement : _placements)
+		{
+			if (placement.node != _node)
+				std::remove(packPath(placement.node).c_str());
+		}
+	}
+}
+
+std::string ShardCoordinator::packPath(size_t node) const
+{
+	if (node == _node) return _packFolder + "/" + _packFilename;
+	std::string stem = _packFilename.substr(0, _packFilename.rfind('.'));
+	return _packFolder + "/" + stem + "-node" + std::to_string(node)
+		+ ".pack";
+}
+
+// Copies the pack from a thread on the given node, so that the pages of the
+// copy are allocated on that node.
+void ShardCoordinator::copyPack(size_t node)
+{
+	Placement placement = {node, {}};
+	for (const Placement& p : _placements)
+	{
+		if (p.node != node) continue;
+		placement.cpus.insert(placement.cpus.end(), p.cpus.begin(),
+			p.cpus.end());
+	}
+	std::string from = packPath(_node);
+	std::string to = packPath(node);
+	std::exception_ptr error;
+	std::thread thread([&]() {
+		try
+		{
+			pinPlacement(placement);
+			MappedFile source(from);
+			AtomicFile file(to);
+			file.write(source.data(), source.size());
+			file.commit();
+		}
+		catch (...)
+		{
+			error = std::current_exception();
+		}
+	});
+	thread.join();
+	if (error) std::rethrow_exception(error);
+}
+
+static void runWorker(const Settings& settings,
+	const std::string& rulesetname, const std::string& host, uint16_t port,
+	bool local, uint32_t node);
+
+void ShardCoordinator::forkWorkers(size_t count)
+{
+	if (count == 0) return;
+#ifdef _WIN32
+	throw std::runtime_error("Local workers are not supported on Windows");
+#else
+	uint16_t port = _listener.localPort();
+	std::vector<Placement> topology = currentTopology();
+	size_t cores = 0;
+	for (const Placement& node : topology) cores += node.cpus.size();
+	// The coordinator is the first process.
+	if (_settings.affinity) _placements = planPlacements(topology, count + 1);
+
+	std::cout.flush();
+	std::cerr.flush();
+	for (size_t i = 0; i < count; i++)
+	{
+		pid_t pid = fork();
+		if (pid < 0) throw std::runtime_error("Cannot fork local worker");
+		if (pid == 0)
+		{
+#ifdef __linux__
+			// A local worker should not outlive the trainer.
+			prctl(PR_SET_PDEATHSIG, SIGTERM);
+#endif
+			_listener.close();
+			srand(std::time(nullptr) + getpid());
+			uint32_t node = 0;
+			size_t share = std::max(cores / (count + 1), size_t(1));
+			if (_settings.affinity)
+			{
+				pinPlacement(_placements[i + 1]);
+				node = _placements[i + 1].node;
+				share = _placements[i + 1].cpus.size();
+			}
+			// Otherwise every worker would use a thread for each core.
+			if (_settings.torchThreads == 0) torch::set_num_threads(share);
+			int status = 0;
+			try
+			{
+				runWorker(_settings, _rulesetname, "127.0.0.1", port, true,
+					node);
+			}
+			catch (const std::exception& e)
+			{
+				std::cerr << "ERROR: local worker: " << e.what() << std::endl;
+				status = 1;
+			}
+			std::cout.flush();
+			std::cerr.flush();
+			_exit(status);
+		}
+		_children.push_back(pid);
+	}
+	std::cout << "Forked " << count << " local workers" << std::endl;
+
+	if (_settings.affinity)
+	{
+		pinPlacement(_placements[0]);
+		_node = _placements[0].node;
+		for (size_t i = 0; i < _placements.size(); i++)
+		{
+			std::cout << (i == 0 ? "Coordinator" : "Local worker "
+					+ std::to_string(i)) << " is placed on "
+				<< describePlacement(_placements[i]) << std::endl;
+		}
+	}
+#endif
+}
+
+void ShardCoordinator::acceptWorkers()
+{
+	while (!_stopping)
+	{
+		Socket socket = _listener.accept(200);
+		if (!socket.valid()) continue;
+
+		std::unique_ptr<Worker> worker(new Worker());
+		try
+		{
+			std::string payload;
+			// A connection that never says hello should not block the others.
+			socket.setTimeout(10000);
+			if (socket.receive(payload) != uint32_t(Message::HELLO)) continue;
+			socket.setTimeout(0);
+			Reader reader(payload);
+			std::string rulesetname = reader.getString();
+			worker->name = reader.getString();
+			worker->local = reader.get<uint8_t>();
+			worker->node = reader.get<uint32_t>();
+			if (rulesetname != _rulesetname)
+			{
+				std::cerr << "WARNING: worker " << worker->name << " uses"
+					" ruleset " << rulesetname << " instead of "
+					<< _rulesetname << std::endl;
+				continue;
+			}
+		}
+		catch (const std::exception& e)
+		{
+			std::cerr << "WARNING: rejected worker: " << e.what()
+				<< std::endl;
+			continue;
+		}
+		worker->socket = std::move(socket);
+		std::cout << "Worker " << worker->name << " connected" << std::endl;
+
+		// Workers join in the next round.
+		std::lock_guard<std::mutex> lock(_mutex);
+		_workers.push_back(std::move(worker));
+		_changed.notify_all();
+	}
+}
+
+Director::RoundResults ShardCoordinator::play(size_t round,
+	const std::vector<std::shared_ptr<NeuralNewtBrain>>& brains,
+	const std::vector<GameSpec>& games)
+{
+	std::vector<std::unique_ptr<Worker>> workers;
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		workers.swap(_workers);
+	}
+
+	// Playing no games gives the results of each brain, all zero.
+	_empty = NewtBrainTrainer::playGames(_settings, _rulesetname, brains, {});
+	_results = _empty;
+	_shards.clear();
+	_queue.clear();
+	_inFlight = 0;
+	size_t shardSize = _settings.gamesPerShard;
+	for (size_t i = 0; i < games.size(); i += shardSize)
+	{
+		_shards.emplace_back(games.begin() + i,
+			games.begin() + std::min(i + shardSize, games.size()));
+		_queue.push_back(_shards.size() - 1);
+	}
+	// Games are only batched together within one director, so each process
+	// takes about half of its share of the round at once, which still
+	// leaves room to balance the load.
+	size_t processes = workers.size() + 1;
+	_share = std::max((_shards.size() + 2 * processes - 1) / (2 * processes),
+		size_t(1));
+
+	std::string population;
+	if (!workers.empty())
+	{
+		NeuralNewtBrain::savePack(_packFolder, _packFilename, brains);
+	}
+	// Local workers on other nodes share a copy on their own node.
+	std::vector<size_t> nodes;
+	for (const auto& worker : workers)
+	{
+		if (!worker->local || worker->node == _node) continue;
+		if (std::find(nodes.begin(), nodes.end(), worker->node) != nodes.end())
+			continue;
+		copyPack(worker->node);
+		nodes.push_back(worker->node);
+	}
+	if (std::any_of(workers.begin(), workers.end(),
+			[](const std::unique_ptr<Worker>& worker) {
+				return !worker->local;
+			}))
+	{
+		std::ifstream file(packPath(_node), std::ios::binary);
+		std::stringstream contents;
+		contents << file.rdbuf();
+		put<uint64_t>(population, round);
+		population += contents.str();
+	}
+
+	std::vector<std::thread> threads;
+	for (auto& worker : workers)
+	{
+		threads.emplace_back(&ShardCoordinator::serve, this,
+			std::ref(*worker), round, std::cref(brains),
+			std::cref(population));
+	}
+
+	// The coordinator plays shards as well, which also takes care of any
+	// shards that are left when every worker has failed.
+	std::unique_lock<std::mutex> lock(_mutex);
+	while (!_queue.empty() || _inFlight > 0)
+	{
+		if (_queue.empty())
+		{
+			_changed.wait(lock);
+			continue;
+		}
+		std::vector<size_t> shards = takeShards();
+		lock.unlock();
+		Director::RoundResults results = NewtBrainTrainer::playGames(
+			_settings, _rulesetname, brains, gamesOf(shards));
+		lock.lock();
+		_results.merge(results);
+		_inFlight -= shards.size();
+	}
+	lock.unlock();
+
+	for (auto& thread : threads)
+	{
+		thread.join();
+	}
+
+	lock.lock();
+	for (auto& worker : workers)
+	{
+		if (worker->socket.valid()) _workers.push_back(std::move(worker));
+	}
+	return std::move(_results);
+}
+
+// Must be called with the lock held.
+std::vector<size_t> ShardCoordinator::takeShards()
+{
+	std::vector<size_t> shards;
+	while (!_queue.empty() && shards.size() < _share)
+	{
+		shards.push_back(_queue.front());
+		_queue.pop_front();
+	}
+	_inFlight += shards.size();
+	return shards;
+}
+
+std::vector<GameSpec> ShardCoordinator::gamesOf(
+	const std::vector<size_t>& shards) const
+{
+	std::vector<GameSpec> games;
+	for (size_t shard : shards)
+	{
+		games.insert(games.end(), _shards[shard].begin(),
+			_shards[shard].end());
+	}
+	return games;
+}
+
+void ShardCoordinator::serve(Worker& worker, size_t round,
+	const std::vector<std::shared_ptr<NeuralNewtBrain>>& brains,
+	const std::string& population)
+{
+	std::unique_lock<std::mutex> lock(_mutex);
+	while (!_queue.empty())
+	{
+		std::vector<size_t> shards = takeShards();
+		lock.unlock();
+
+		Director::RoundResults results = _empty;
+		Counters::Snapshot counted;
+		try
+		{
+			if (worker.round != round && worker.local)
+			{
+				std::string path;
+				put<uint64_t>(path, round);
+				putString(path, packPath(worker.node));
+				worker.socket.send(uint32_t(Message::SHARED_POPULATION),
+					path);
+				worker.round = round;
+			}
+			else if (worker.round != round)
+			{
+				worker.socket.send(uint32_t(Message::POPULATION), population);
+				worker.round = round;
+			}
+			std::string payload;
+			std::vector<GameSpec> games = gamesOf(shards);
+			putVector(payload, games);
+			// A worker that hangs without closing the connection would
+			// otherwise hold on to its shards forever.
+			worker.socket.setTimeout(_settings.workerTimeout * games.size()
+				* 1000);
+			worker.socket.send(uint32_t(Message::GAMES), payload);
+			Message type = Message(worker.socket.receive(payload));
+			if (type == Message::ERROR) throw std::runtime_error(payload);
+			if (type != Message::RESULTS)
+			{
+				throw std::runtime_error("Unexpected message");
+			}
+			readResults(payload, results, counted);
+			for (GameLog::Record& record : results.games)
+			{
+				if (record.first != GameLog::NONE)
+					record.first = brains.at(record.first)->id();
+				if (record.second != GameLog::NONE)
+					record.second = brains.at(record.second)->id();
+			}
+		}
+		catch (const std::exception& e)
+		{
+			std::cerr << "WARNING: worker " << worker.name << " failed ("
+				<< e.what() << "), its games will be played elsewhere"
+				<< std::endl;
+			worker.socket.close();
+			lock.lock();
+			_queue.insert(_queue.begin(), shards.begin(), shards.end());
+			_inFlight -= shards.size();
+			_changed.notify_all();
+			return;
+		}
+
+		// Metrics and round summaries cover the games of every process.
+		Counters::add(counted);
+		lock.lock();
+		_results.merge(results);
+		_inFlight -= shards.size();
+		_changed.notify_all();
+	}
+}
+
+static void attachPopulation(const Settings& settings,
+	const std::string& packpath, size_t round,
+	std::vector<std::shared_ptr<NeuralNewtBrain>>& brains,
+	std::unordered_map<uint32_t, uint32_t>& indices)
+{
+	auto pack = std::make_shared<const BrainPack>(packpath);
+	brains.clear();
+	indices.clear();
+	for (uint32_t i = 0; i < pack->size(); i++)
+	{
+		brains.push_back(std::make_shared<NeuralNewtBrain>(settings,
+			std::make_shared<RestoredBrainName>(pack->name(i), round)));
+		brains.back()->attach(pack, i);
+		indices[brains.back()->id()] = i;
+	}
+}
+
+// Returns true once the coordinator is done.
+static bool serveShards(Socket& socket, const Settings& settings,
+	const std::string& rulesetname, const std::string& name,
+	const std::string& packpath, bool local, uint32_t node)
+{
+	std::string hello;
+	putString(hello, rulesetname);
+	putString(hello, name);
+	put<uint8_t>(hello, local);
+	put<uint32_t>(hello, node);
+	socket.send(uint32_t(Message::HELLO), hello);
+
+	std::vector<std::shared_ptr<NeuralNewtBrain>> brains;
+	std::unordered_map<uint32_t, uint32_t> indices;
+	std::string payload;
+	while (true)
+	{
+		switch (Message(socket.receive(payload)))
+		{
+			case Message::POPULATION:
+			{
+				// The pack is memory mapped, so it is written to a file
+				// first. Brains of the previous round keep their old mapping.
+				Reader reader(payload);
+				uint64_t round = reader.get<uint64_t>();
+				size_t size;
+				const char* data = reader.rest(size);
+				{
+					AtomicFile file(packpath);
+					file.write(data, size);
+					file.commit();
+				}
+				attachPopulation(settings, packpath, round, brains, indices);
+				std::cout << "Received " << brains.size() << " brains for"
+					" round " << round << std::endl;
+			}
+			break;
+
+			case Message::SHARED_POPULATION:
+			{
+				Reader reader(payload);
+				uint64_t round = reader.get<uint64_t>();
+				attachPopulation(settings, reader.getString(), round, brains,
+					indices);
+			}
+			break;
+
+			case Message::GAMES:
+			{
+				try
+				{
+					std::vector<GameSpec> games =
+						Reader(payload).getVector<GameSpec>();
+					for (const GameSpec& game : games)
+					{
+						if (game.brain >= brains.size()
+							|| (game.opponent == 0
+								&& game.other >= brains.size()))
+						{
+							throw std::runtime_error("Unknown brain");
+						}
+					}
+					Counters::Snapshot before = Counters::snapshot();
+					Director::RoundResults results =
+						NewtBrainTrainer::playGames(settings, rulesetname,
+							brains, games);
+					Counters::Snapshot counted = Counters::snapshot() - before;
+					for (GameLog::Record& record : results.games)
+					{
+						if (record.first != GameLog::NONE)
+							record.first = indices.at(record.first);
+						if (record.second != GameLog::NONE)
+							record.second = indices.at(record.second);
+					}
+					socket.send(uint32_t(Message::RESULTS),
+						writeResults(results, counted));
+				}
+				catch (const std::exception& e)
+				{
+					socket.send(uint32_t(Message::ERROR), e.what());
+				}
+			}
+			break;
+
+			case Message::DONE:
+			{
+				return true;
+			}
+
+			default:
+			{
+				throw std::runtime_error("Unexpected message");
+			}
+		}
+	}
+}
+
+static void runWorker(const Settings& trainerSettings,
+	const std::string& rulesetname, const std::string& host, uint16_t port,
+	bool local, uint32_t node)
+{
+	Settings settings = trainerSettings;
+	if (settings.torchThreads > 0)
+		torch::set_num_threads(settings.torchThreads);
+	if (settings.cuda && !torch::cuda::is_available())
+	{
+		settings.cuda = false;
+	}
+
+	std::string name = host;
+	std::string id = "0";
+#ifndef _WIN32
+	char hostname[256] = {0};
+	gethostname(hostname, sizeof(hostname) - 1);
+	name = hostname;
+	id = std::to_string(getpid());
+#endif
+	name += ":" + id;
+	makeFolder("brains");
+	std::string packpath = "brains/worker-" + id + ".pack";
+
+	if (settings.recordingChance > 0) RecordingWriter::start("recordings");
+	while (true)
+	{
+		try
+		{
+			Socket socket = Socket::connect(host, port);
+			if (!local)
+			{
+				std::cout << "Connected to " << host << ":" << port
+					<< std::endl;
+			}
+			if (serveShards(socket, settings, rulesetname, name, packpath,
+				local, node))
+			{
+				if (!local) std::cout << "Coordinator is done" << std::endl;
+				RecordingWriter::stop();
+				return;
+			}
+		}
+		catch (const std::exception& e)
+		{
+			std::cerr << "WARNING: " << e.what() << ", retrying in 5 seconds"
+				<< std::endl;
+		}
+		std::this_thread::sleep_for(std::chrono::seconds(5));
+	}
+}
+
+void runShardWorker(const Settings& settings, const std::string& rulesetname,
+	const std::string& host, uint16_t port)
+{
+	runWorker(settings, rulesetname, host, port, false, 0);
+}
@@ -0,0 +1,116 @@
+/**
+ * Part of Epicinium NeuralNewt
+ * developed by A Bunch of Hacks.
+ *
+ * Copyright (c) 2020 A Bunch of Hacks
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * [authors:]
+ * Daan Mulder (daan@abunchofhacks.coop)
+ */
+
+
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <memory>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+#include "newtbraintrainer.hpp"
+#include "socket.hpp"
+#include "affinity.hpp"
+
+
+// Plays the games of a round in shards, spread over the coordinator itself
+// and any number of worker processes that connect to it over TCP, on the
+// same machine or on others. Before their first shard of a round, workers
+// receive the population as a brain pack. If a worker fails, its shard is
+// played again by someone else.
+//
+// Local workers are forked by the coordinator itself. Instead of a copy of
+// the pack they receive its path, preferably in /dev/shm, so that every
+// process maps the same pages and the population is in memory only once.
+class ShardCoordinator
+{
+private:
+	struct Worker
+	{
+		Socket socket;
+		std::string name;
+		bool local = false;
+		size_t node = 0;
+		size_t round = size_t(-1);
+	};
+
+	Settings _settings;
+	std::string _rulesetname;
+	std::string _packFolder;
+	std::string _packFilename;
+	Socket _listener;
+	std::vector<int> _children;
+	// Where the coordinator and each local worker run, with affinity.
+	std::vector<Placement> _placements;
+	size_t _node;
+	std::atomic<bool> _stopping;
+	std::thread _acceptThread;
+
+	std::mutex _mutex;
+	std::condition_variable _changed;
+	std::vector<std::unique_ptr<Worker>> _workers;
+
+	// The state of the round that is being played.
+	std::vector<std::vector<GameSpec>> _shards;
+	std::deque<size_t> _queue;
+	size_t _share;
+	size_t _inFlight;
+	Director::RoundResults _empty;
+	Director::RoundResults _results;
+
+public:
+	// The population is written to packFolder/shard.pack every round, or to
+	// /dev/shm if there are local workers. With affinity, local workers on
+	// another NUMA node than the coordinator share a copy on their node.
+	ShardCoordinator(const Settings& settings,
+		const std::string& rulesetname, const std::string& packFolder);
+	ShardCoordinator(const ShardCoordinator&) = delete;
+	ShardCoordinator(ShardCoordinator&&) = delete;
+	ShardCoordinator& operator=(const ShardCoordinator&) = delete;
+	ShardCoordinator& operator=(ShardCoordinator&&) = delete;
+	~ShardCoordinator();
+
+	Director::RoundResults play(size_t round,
+		const std::vector<std::shared_ptr<NeuralNewtBrain>>& brains,
+		const std::vector<GameSpec>& games);
+
+private:
+	std::string packPath(size_t node) const;
+	void copyPack(size_t node);
+	void forkWorkers(size_t count);
+	std::vector<size_t> takeShards();
+	std::vector<GameSpec> gamesOf(const std::vector<size_t>& shards) const;
+	void acceptWorkers();
+	void serve(Worker& worker, size_t round,
+		const std::vector<std::shared_ptr<NeuralNewtBrain>>& brains,
+		const std::string& population);
+};
+
+// Connects to the coordinator and plays the shards it is given until the
+// coordinator is done, reconnecting whenever the connection is lost.
+void runShardWorker(const Settings& settings, const std::string& rulesetname,
+	const std::string& host, uint16_t port);
@@ -0,0 +1,233 @@
+/**
+ * Part of Epicinium NeuralNewt
+ * developed by A Bunch of Hacks.
+ *
+ * Copyright (c) 2020 A Bunch of Hacks
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * [authors:]
+ * Daan Mulder (daan@abunchofhacks.coop)
+ */
+
+
+#include "socket.hpp"
+
+#include <cstring>
+#include <cerrno>
+#include <stdexcept>
+#ifndef _WIN32
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <netdb.h>
+#include <poll.h>
+#include <unistd.h>
+#endif
+
+
+struct Frame
+{
+	uint32_t type;
+	uint32_t reserved;
+	uint64_t size;
+};
+
+#ifdef _WIN32
+Socket& Socket::operator=(Socket&& other)
+{
+	_fd = other._fd;
+	other._fd = -1;
+	return *this;
+}
+
+Socket::~Socket() = default;
+
+void Socket::close() {}
+
+Socket Socket::listen(uint16_t /**/, bool /**/)
+{
+	throw std::runtime_error("Sockets are not supported on Windows");
+}
+
+Socket Socket::connect(const std::string& /**/, uint16_t /**/)
+{
+	throw std::runtime_error("Sockets are not supported on Windows");
+}
+
+Socket Socket::accept(int /**/) { return Socket(); }
+uint16_t Socket::localPort() const { return 0; }
+void Socket::setTimeout(size_t /**/) {}
+void Socket::send(uint32_t /**/, const std::string& /**/) {}
+uint32_t Socket::receive(std::string& /**/) { return 0; }
+#else
+Socket& Socket::operator=(Socket&& other)
+{
+	close();
+	_fd = other._fd;
+	other._fd = -1;
+	return *this;
+}
+
+Socket::~Socket()
+{
+	close();
+}
+
+void Socket::close()
+{
+	if (_fd >= 0) ::close(_fd);
+	_fd = -1;
+}
+
+Socket Socket::listen(uint16_t port, bool loopback)
+{
+	int fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (fd < 0) throw std::runtime_error("Cannot create socket");
+	int reuse = 1;
+	setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+	sockaddr_in address;
+	std::memset(&address, 0, sizeof(address));
+	address.sin_family = AF_INET;
+	address.sin_port = htons(port);
+	address.sin_addr.s_addr = htonl(loopback ? INADDR_LOOPBACK : INADDR_ANY);
+	if (bind(fd, (const sockaddr*) &address, sizeof(address)) != 0
+		|| ::listen(fd, 16) != 0)
+	{
+		::close(fd);
+		throw std::runtime_error("Cannot listen on port "
+			+ std::to_string(port));
+	}
+	return Socket(fd);
+}
+
+uint16_t Socket::localPort() const
+{
+	sockaddr_in address;
+	socklen_t size = sizeof(address);
+	if (getsockname(_fd, (sockaddr*) &address, &size) != 0)
+	{
+		throw std::runtime_error("Cannot determine port of socket");
+	}
+	return ntohs(address.sin_port);
+}
+
+void Socket::setTimeout(size_t milliseconds)
+{
+	timeval timeout;
+	timeout.tv_sec = milliseconds / 1000;
+	timeout.tv_usec = (milliseconds % 1000) * 1000;
+	setsockopt(_fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+	setsockopt(_fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+}
+
+Socket Socket::connect(const std::string& host, uint16_t port)
+{
+	addrinfo hints;
+	std::memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	addrinfo* addresses = nullptr;
+	if (getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints,
+		&addresses) != 0)
+	{
+		throw std::runtime_error("Cannot resolve " + host);
+	}
+	int fd = -1;
+	for (addrinfo* a = addresses; a != nullptr; a = a->ai_next)
+	{
+		fd = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+		if (fd < 0) continue;
+		if (::connect(fd, a->ai_addr, a->ai_addrlen) == 0) break;
+		::close(fd);
+		fd = -1;
+	}
+	freeaddrinfo(addresses);
+	if (fd < 0)
+	{
+		throw std::runtime_error("Cannot connect to " + host + ":"
+			+ std::to_string(port));
+	}
+	// Messages are written in one go, so there is no need to wait for more.
+	int nodelay = 1;
+	setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+	// Notice a machine that has disappeared without closing the connection.
+	int keepalive = 1;
+	setsockopt(fd, SOL_SOCKET, SO_KEEPALIVE, &keepalive, sizeof(keepalive));
+	return Socket(fd);
+}
+
+Socket Socket::accept(int milliseconds)
+{
+	pollfd listening = {_fd, POLLIN, 0};
+	if (poll(&listening, 1, milliseconds) <= 0) return Socket();
+	int fd = ::accept(_fd, nullptr, nullptr);
+	if (fd < 0) return Socket();
+	int nodelay = 1;
+	setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+	int keepalive = 1;
+	setsockopt(fd, SOL_SOCKET, SO_KEEPALIVE, &keepalive, sizeof(keepalive));
+	return Socket(fd);
+}
+
+static void sendAll(int fd, const char* data, size_t size)
+{
+	while (size > 0)
+	{
+		ssize_t n = ::send(fd, data, size, MSG_NOSIGNAL);
+		if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+		{
+			throw std::runtime_error("Timed out while sending");
+		}
+		if (n <= 0) throw std::runtime_error("Connection lost while sending");
+		data += n;
+		size -= n;
+	}
+}
+
+static void receiveAll(int fd, char* data, size_t size)
+{
+	while (size > 0)
+	{
+		ssize_t n = ::recv(fd, data, size, 0);
+		if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+		{
+			throw std::runtime_error("Timed out while receiving");
+		}
+		if (n <= 0)
+		{
+			throw std::runtime_error("Connection lost while receiving");
+		}
+		data += n;
+		size -= n;
+	}
+}
+
+void Socket::send(uint32_t type, const std::string& payload)
+{
+	Frame frame = {type, 0, payload.size()};
+	sendAll(_fd, (const char*) &frame, sizeof(frame));
+	sendAll(_fd, payload.data(), payload.size());
+}
+
+uint32_t Socket::receive(std::string& payload)
+{
+	Frame frame;
+	receiveAll(_fd, (char*) &frame, sizeof(frame));
+	payload.resize(frame.size);
+	receiveAll(_fd, &payload[0], frame.size);
+	return frame.type;
+}
+#endif
@@ -0,0 +1,68 @@
+/**
+ * Part of Epicinium NeuralNewt
+ * developed by A Bunch of Hacks.
+ *
+ * Copyright (c) 2020 A Bunch of Hacks
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * [authors:]
+ * Daan Mulder (daan@abunchofhacks.coop)
+ */
+
+
+#pragma once
+
+#include <string>
+#include <cstdint>
+
+
+// A TCP connection that exchanges framed messages, each a type and a payload
+// of any size. Both ends are assumed to have the same byte order.
+class Socket
+{
+private:
+	int _fd;
+
+	explicit Socket(int fd) : _fd(fd) {}
+
+public:
+	Socket() : _fd(-1) {}
+	Socket(const Socket&) = delete;
+	Socket(Socket&& other) : _fd(other._fd) { other._fd = -1; }
+	Socket& operator=(const Socket&) = delete;
+	Socket& operator=(Socket&& other);
+	~Socket();
+
+	// Listens on all interfaces, so that workers on other machines can
+	// connect, or only on the loopback interface. Port 0 picks a free port.
+	static Socket listen(uint16_t port, bool loopback = false);
+	static Socket connect(const std::string& host, uint16_t port);
+
+	// Blocks for at most the given number of milliseconds; returns an invalid
+	// socket if no connection was made in that time.
+	Socket accept(int milliseconds);
+
+	bool valid() const { return _fd >= 0; }
+	uint16_t localPort() const;
+	void close();
+
+	// Makes send() and receive() give up after the given number of
+	// milliseconds without progress, or never if it is 0.
+	void setTimeout(size_t milliseconds);
+
+	// Both throw a std::runtime_error if the connection is lost or if they
+	// time out.
+	void send(uint32_t type, const std::string& payload);
+	uint32_t receive(std::string& payload);
+};
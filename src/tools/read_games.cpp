@@ -0,0 +1,208 @@
+/**
+ * Part of Epicinium NeuralNewt
+ * developed by A Bunch of Hacks.
+ *
+ * Copyright (c) 2020 A Bunch of Hacks
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * [authors:]
+ * Daan Mulder (daan@abunchofhacks.coop)
+ */
+
+
+#include <iostream>
+#include <iomanip>
+#include <map>
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+
+#include "gamelog.hpp"
+
+
+struct Tally
+{
+	uint64_t games = 0;
+	uint64_t wins = 0;
+	uint64_t draws = 0;
+	uint64_t losses = 0;
+	int64_t score = 0;
+	uint64_t turns = 0;
+	uint64_t milliseconds = 0;
+
+	void add(int result, int32_t points, uint16_t numTurns, uint32_t ms)
+	{
+		games++;
+		if (result > 0) wins++;
+		else if (result < 0) losses++;
+		else draws++;
+		score += points;
+		turns += numTurns;
+		milliseconds += ms;
+	}
+};
+
+static std::ostream& operator<<(std::ostream& os, const Tally& tally)
+{
+	double n = std::max(tally.games, uint64_t(1));
+	os << std::setw(9) << tally.games
+		<< std::setw(8) << 100.0 * tally.wins / n
+		<< std::setw(8) << 100.0 * tally.draws / n
+		<< std::setw(8) << 100.0 * tally.losses / n
+		<< std::setw(9) << tally.score / n
+		<< std::setw(8) << tally.turns / n
+		<< std::setw(9) << tally.milliseconds / n;
+	return os;
+}
+
+static void printHeader(const std::string& title)
+{
+	std::cout << "\n" << std::left << std::setw(24) << title << std::right
+		<< std::setw(9) << "games" << std::setw(8) << "win%"
+		<< std::setw(8) << "draw%" << std::setw(8) << "loss%"
+		<< std::setw(9) << "score" << std::setw(8) << "turns"
+		<< std::setw(9) << "ms" << "\n";
+}
+
+// The result of a game from the point of view of the given side.
+static int result(GameLog::Outcome outcome, bool first)
+{
+	switch (outcome)
+	{
+		case GameLog::Outcome::FIRST_WON: return first ? 1 : -1;
+		case GameLog::Outcome::SECOND_WON: return first ? -1 : 1;
+		case GameLog::Outcome::DRAW: return 0;
+		case GameLog::Outcome::UNDECIDED: return 0;
+	}
+	return 0;
+}
+
+static void run(int argc, char* argv[])
+{
+	size_t numBrains = 0;
+	std::vector<std::string> filenames;
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		if (arg == "--brains" && i + 1 < argc)
+		{
+			numBrains = std::stoul(argv[++i]);
+		}
+		else filenames.push_back(arg);
+	}
+	if (filenames.empty())
+	{
+		throw std::runtime_error("Usage: read_games [--brains N]"
+			" logs/games-*.games");
+	}
+
+	// Games against baseline AIs are tallied from the brain's point of view,
+	// games between brains from the point of view of the first player.
+	std::map<std::string, Tally> byOpponent;
+	std::map<std::string, Tally> byMap;
+	std::map<std::string, Tally> byBrain;
+	std::map<uint32_t, Tally> byRound;
+	for (const std::string& filename : filenames)
+	{
+		GameLog log(filename);
+		std::map<uint32_t, std::string> names;
+		for (size_t b = 0; b < log.numBrains(); b++)
+		{
+			names[log.brainId(b)] = log.brainName(b);
+		}
+
+		const uint32_t* first = log.first();
+		const uint32_t* second = log.second();
+		const int32_t* firstScore = log.firstScore();
+		const int32_t* secondScore = log.secondScore();
+		const uint32_t* milliseconds = log.milliseconds();
+		const uint16_t* map = log.map();
+		const uint16_t* turns = log.turns();
+		const uint8_t* opponent = log.opponent();
+		const GameLog::Outcome* outcome = log.outcome();
+		for (size_t i = 0; i < log.size(); i++)
+		{
+			bool brainFirst = (first[i] != GameLog::NONE);
+			int r = result(outcome[i], brainFirst);
+			int32_t score = brainFirst ? firstScore[i] : secondScore[i];
+			byOpponent[log.opponentName(opponent[i])].add(r, score, turns[i],
+				milliseconds[i]);
+			byMap[log.mapName(map[i])].add(r, score, turns[i],
+				milliseconds[i]);
+			byRound[log.round()].add(r, score, turns[i], milliseconds[i]);
+			if (numBrains == 0) continue;
+			if (first[i] != GameLog::NONE)
+			{
+				byBrain[names[first[i]]].add(result(outcome[i], true),
+					firstScore[i], turns[i], milliseconds[i]);
+			}
+			if (second[i] != GameLog::NONE)
+			{
+				byBrain[names[second[i]]].add(result(outcome[i], false),
+					secondScore[i], turns[i], milliseconds[i]);
+			}
+		}
+	}
+
+	std::cout << std::fixed << std::setprecision(1);
+	printHeader("round");
+	for (const auto& pair : byRound)
+	{
+		std::cout << std::left << std::setw(24) << pair.first << std::right
+			<< pair.second << "\n";
+	}
+	printHeader("opponent");
+	for (const auto& pair : byOpponent)
+	{
+		std::cout << std::left << std::setw(24) << pair.first << std::right
+			<< pair.second << "\n";
+	}
+	printHeader("map");
+	for (const auto& pair : byMap)
+	{
+		std::cout << std::left << std::setw(24) << pair.first << std::right
+			<< pair.second << "\n";
+	}
+	if (numBrains > 0)
+	{
+		std::vector<std::pair<std::string, Tally>> brains(byBrain.begin(),
+			byBrain.end());
+		std::sort(brains.begin(), brains.end(),
+			[](const std::pair<std::string, Tally>& a,
+					const std::pair<std::string, Tally>& b) {
+				return a.second.score * int64_t(b.second.games)
+					> b.second.score * int64_t(a.second.games);
+			});
+		printHeader("brain");
+		for (size_t i = 0; i < brains.size() && i < numBrains; i++)
+		{
+			std::cout << std::left << std::setw(24) << brains[i].first
+				<< std::right << brains[i].second << "\n";
+		}
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	try
+	{
+		run(argc, argv);
+	}
+	catch (const std::exception& e)
+	{
+		std::cerr << "Exception: " << e.what() << std::endl;
+		return 1;
+	}
+	return 0;
+}
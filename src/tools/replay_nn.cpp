@@ -0,0 +1,207 @@
+/**
+ * Part of Epicinium NeuralNewt
+ * developed by A Bunch of Hacks.
+ *
+ * Copyright (c) 2020 A Bunch of Hacks
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * [authors:]
+ * Daan Mulder (daan@abunchofhacks.coop)
+ */
+
+
+#include <iostream>
+#include <sstream>
+#include <cmath>
+#include <torch/torch.h>
+
+#include "libs/jsoncpp/json.h"
+
+#include "setting.hpp"
+#include "brainname.hpp"
+#include "nnet/network.hpp"
+#include "nnet/neuralnewtbrain.hpp"
+#include "nnet/litenetwork.hpp"
+#include "nnet/brainpack.hpp"
+#include "nnet/inferencecapture.hpp"
+#include "bench/benchmark.hpp"
+
+
+// Evaluates every captured batch, as it was batched during the round, and
+// keeps the outputs of the last iteration.
+static Json::Value replay(const Network& network,
+	const InferenceCapture& capture, size_t iterations,
+	std::vector<float>& outputs)
+{
+	size_t boards = 0;
+	for (const auto& batch : capture.batches()) boards += batch.count;
+	outputs.assign(boards * network.outputSize(), 0.0f);
+
+	std::vector<double> times;
+	uint64_t allocations = 0;
+	double total = 0;
+	for (size_t i = 0; i <= iterations; i++)
+	{
+		float* output = outputs.data();
+		for (const auto& batch : capture.batches())
+		{
+			uint64_t before = Benchmark::allocations();
+			Benchmark::Stopwatch stopwatch;
+			network.evaluate(batch.input, batch.count, output);
+			double elapsed = stopwatch.elapsed();
+			output += batch.count * network.outputSize();
+			// The first pass is a warm-up.
+			if (i == 0) continue;
+			times.push_back(elapsed);
+			total += elapsed;
+			allocations += Benchmark::allocations() - before;
+		}
+	}
+
+	// Batches have different sizes, so the items per second of the summary
+	// are batches; boards per second are added separately.
+	Json::Value json = Benchmark::summarize(times, 1, allocations);
+	json["boards_per_second"] = (total > 0)
+		? boards * iterations / (total / 1e6) : 0.0;
+	return json;
+}
+
+static Json::Value compare(const std::vector<float>& outputs1,
+	const std::vector<float>& outputs2)
+{
+	double maximum = 0;
+	double sum = 0;
+	for (size_t i = 0; i < outputs1.size(); i++)
+	{
+		double difference = std::fabs(outputs1[i] - outputs2[i]);
+		maximum = std::max(maximum, difference);
+		sum += difference;
+	}
+	Json::Value json = Json::objectValue;
+	json["max_abs_diff"] = maximum;
+	json["mean_abs_diff"] = outputs1.empty() ? 0.0 : sum / outputs1.size();
+	return json;
+}
+
+static void run(int argc, char* argv[])
+{
+	std::vector<std::string> paths;
+	size_t brain = 0;
+	std::string backends = "torch,lite";
+	size_t iterations = 5;
+	std::string output = "replay_nn.json";
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		if (arg.compare(0, 2, "--") != 0)
+		{
+			paths.push_back(arg);
+			continue;
+		}
+		if (i + 1 >= argc)
+		{
+			throw std::runtime_error("Missing value for " + arg);
+		}
+		std::string value = argv[++i];
+		if (arg == "--brain") brain = std::stoul(value);
+		else if (arg == "--backends") backends = value;
+		else if (arg == "--iterations") iterations = std::stoul(value);
+		else if (arg == "--output") output = value;
+		else throw std::runtime_error("Unknown argument " + arg);
+	}
+	if (paths.size() != 2)
+	{
+		throw std::runtime_error("Usage: replay_nn [capture] [pack]"
+			" [--brain i] [--backends torch,lite] [--iterations n]"
+			" [--output file]");
+	}
+
+	Settings settings = Setting::readSettings("settings.json");
+	if (settings.torchThreads > 0)
+		torch::set_num_threads(settings.torchThreads);
+	if (settings.cuda && !torch::cuda::is_available()) settings.cuda = false;
+
+	InferenceCapture capture(paths[0]);
+	auto pack = std::make_shared<const BrainPack>(paths[1]);
+	if (brain >= pack->size())
+	{
+		throw std::runtime_error(paths[1] + " has only "
+			+ std::to_string(pack->size()) + " brains");
+	}
+
+	Json::Value json = Json::objectValue;
+	json["capture"] = paths[0];
+	json["pack"] = paths[1];
+	json["brain"] = pack->name(brain);
+	json["batches"] = Json::UInt64(capture.batches().size());
+	json["torch_threads"] = torch::get_num_threads();
+	json["backends"] = Json::objectValue;
+
+	std::vector<std::string> names;
+	std::vector<std::vector<float>> outputs;
+	std::stringstream list(backends);
+	std::string backend;
+	while (std::getline(list, backend, ','))
+	{
+		std::shared_ptr<const Network> network;
+		std::shared_ptr<NeuralNewtBrain> torchBrain;
+		if (backend == "torch")
+		{
+			torchBrain = std::make_shared<NeuralNewtBrain>(settings,
+				std::make_shared<RestoredBrainName>(pack->name(brain), 0));
+			torchBrain->restore(*pack, brain);
+			network = torchBrain->network();
+		}
+		else if (backend == "lite")
+		{
+			network = std::make_shared<LiteNetwork>(pack, brain);
+		}
+		else throw std::runtime_error("Unknown backend " + backend);
+
+		if (network->inputSize() != capture.inputSize())
+		{
+			throw std::runtime_error("Capture " + paths[0] + " does not match"
+				" the input size of the network");
+		}
+		std::cout << "Replaying " << capture.batches().size() << " batches"
+			" with " << backend << std::endl;
+		outputs.emplace_back();
+		json["backends"][backend] = replay(*network, capture, iterations,
+			outputs.back());
+		names.push_back(backend);
+	}
+
+	// Differences are relative to the first backend.
+	for (size_t b = 1; b < names.size(); b++)
+	{
+		json["backends"][names[b]]["diff_vs_" + names[0]] =
+			compare(outputs[0], outputs[b]);
+	}
+
+	Benchmark::writeJson(json, output);
+}
+
+int main(int argc, char* argv[])
+{
+	try
+	{
+		run(argc, argv);
+	}
+	catch (const std::exception& e)
+	{
+		std::cerr << "Exception: " << e.what() << std::endl;
+		return 1;
+	}
+	return 0;
+}